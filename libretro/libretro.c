@@ -27,6 +27,7 @@
 
 #include "cs0.h"
 #include "cs2.h"
+#include "memory.h"
 
 #include "m68kcore.h"
 #include "vidogl.h"
@@ -70,6 +71,10 @@ static bool service_enabled = false;
 static bool stv_mode = false;
 static int pad_type[12] = {1,1,1,1,1,1,1,1,1,1,1,1};
 static int multitap[2] = {0,0};
+static int runahead = 0;
+static bool runahead_mute = false;
+static void *runahead_state = NULL;
+static size_t runahead_capacity = 0;
 static unsigned players = 7;
 
 struct retro_perf_callback perf_cb;
@@ -99,6 +104,7 @@ void retro_set_environment(retro_environment_t cb)
       { "kronos_polygon_mode", "Polygon Mode; perspective_correction|gpu_tesselation|cpu_tesselation" },
       { "kronos_scanlines", "Scanlines; disabled|enabled" },
       { "kronos_service_enabled", "ST-V Service/Test Buttons; disabled|enabled" },
+      { "kronos_runahead", "Run-Ahead (frames); disabled|1|2|3|4" },
       { NULL, NULL },
    };
 
@@ -565,8 +571,12 @@ static void sdlConvert32uto16s(int32_t *srcL, int32_t *srcR, int16_t *dst, size_
 
 static void SNDLIBRETROUpdateAudio(u32 *leftchanbuffer, u32 *rightchanbuffer, u32 num_samples)
 {
-   sdlConvert32uto16s((int32_t*)leftchanbuffer, (int32_t*)rightchanbuffer, sound_buf, num_samples);
-   audio_batch_cb(sound_buf, num_samples);
+   // Frames emulated ahead of the real one are never heard
+   if (!runahead_mute)
+   {
+      sdlConvert32uto16s((int32_t*)leftchanbuffer, (int32_t*)rightchanbuffer, sound_buf, num_samples);
+      audio_batch_cb(sound_buf, num_samples);
+   }
 
    audio_size -= num_samples;
 }
@@ -929,6 +939,16 @@ void check_variables(void)
       else
          service_enabled = false;
    }
+
+   var.key = "kronos_runahead";
+   var.value = NULL;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         runahead = 0;
+      else
+         runahead = atoi(var.value);
+   }
 }
 
 void retro_get_system_av_info(struct retro_system_av_info *info)
@@ -969,29 +989,19 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
 
 size_t retro_serialize_size(void)
 {
-   void *buffer;
    size_t size;
 
    ScspMuteAudio(SCSP_MUTE_SYSTEM);
-   YabSaveStateBuffer (&buffer, &size);
+   size = YabSaveStateSize();
    ScspUnMuteAudio(SCSP_MUTE_SYSTEM);
 
-   free(buffer);
-
    return size;
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-   void *buffer;
-   size_t out_size;
-
-   int error = YabSaveStateBuffer (&buffer, &out_size);
-
-   memcpy(data, buffer, size);
-
-   free(buffer);
-   return !error;
+   // Serialized straight into the frontend's buffer
+   return (YabSaveStateToBuffer(data, size, NULL) == 0);
 }
 
 bool retro_unserialize(const void *data, size_t size)
@@ -1131,6 +1141,7 @@ bool retro_load_game_common()
    yinit.numthreads              = numthreads;
 #ifdef SPRITE_CACHE
    yinit.useVdp1cache            = 0;
+   yinit.vdp1cachesize           = 0;
 #endif
    yinit.usecache                = 0;
    yinit.skip_load               = 0;
@@ -1507,6 +1518,9 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info *i
 void retro_unload_game(void)
 {
    YabauseDeInit();
+   free(runahead_state);
+   runahead_state = NULL;
+   runahead_capacity = 0;
 }
 
 unsigned retro_get_region(void)
@@ -1540,6 +1554,63 @@ void retro_reset(void)
    //YabauseResetButton();
 }
 
+static bool runahead_reserve(void)
+{
+   size_t size = YabSaveStateSize();
+   void *state;
+
+   if (size == 0)
+      return false;
+   size += size >> 3;
+   if ((state = realloc(runahead_state, size)) == NULL)
+      return false;
+   runahead_state = state;
+   runahead_capacity = size;
+   return true;
+}
+
+// Emulates the real frame, saves it, then emulates runahead frames ahead
+// with the same input and shows the last one before going back to the
+// saved state. Hidden frames are neither composed nor heard, and the state
+// skips the thumbnail and the movie, so a frame or two ahead stays cheap.
+static bool runahead_frame(void)
+{
+   size_t size = 0;
+   int i;
+
+   if (runahead_state == NULL && !runahead_reserve())
+      return false;
+
+   yabsys.skipRender = 1;
+   audio_size = soundlen;
+   YabauseExec();
+
+   if (YabSaveStateToBufferEx(runahead_state, runahead_capacity, &size, YAB_STATE_QUIET) != 0)
+   {
+      // The state outgrew the buffer
+      if (!runahead_reserve() ||
+          YabSaveStateToBufferEx(runahead_state, runahead_capacity, &size, YAB_STATE_QUIET) != 0)
+      {
+         yabsys.skipRender = 0;
+         runahead = 0;
+         return true;
+      }
+   }
+
+   runahead_mute = true;
+   for (i = 0; i < runahead; i++)
+   {
+      if (i == runahead - 1)
+         yabsys.skipRender = 0;
+      audio_size = soundlen;
+      YabauseExec();
+   }
+   runahead_mute = false;
+
+   YabLoadStateBufferEx(runahead_state, size, YAB_STATE_QUIET);
+   return true;
+}
+
 void retro_run(void)
 {
    unsigned i;
@@ -1557,6 +1628,9 @@ void retro_run(void)
       VIDCore->SetSettingValue(VDP_SETTING_SCANLINE, scanlines);
    }
 
+   if (runahead > 0 && runahead_frame())
+      return;
+
    //YabauseExec(); runs from handle events
    YabauseExec();
 }
@@ -0,0 +1,364 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file audit.c
+    \brief Determinism audit.
+
+    Rewind, run-ahead and rollback all assume that loading a state and
+    emulating the same inputs again gives the same frames. The audit
+    checks it on the running game: it takes a state, records the inputs
+    and a hash of each subsystem at the end of every frame for a window of
+    frames, then loads the state back, plays the window again without
+    rendering and compares the hashes frame by frame. The live state is
+    put back afterwards, so the game goes on as if nothing happened.
+
+    The inputs are recorded at the end of each frame, whoever set them, so
+    a movie being recorded or played keeps running. Only the replay takes
+    the input provider over, for the length of the window. Netplay rolls
+    back on its own and cannot run with the audit.
+
+    The subsystem that differs first usually points at the cause: state
+    the savestate leaves out, the asynchronous SCSP thread not being in
+    step with the SH2s, or the SMPC clock following the host time.
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audit.h"
+#include "movie.h"
+#include "memory.h"
+#include "peripheral.h"
+#include "scsp.h"
+#include "sh2core.h"
+#include "smpc.h"
+#include "vdp1.h"
+#include "vdp2.h"
+#include "error.h"
+#include "yabause.h"
+
+#define AUDIT_INPUT_SIZE 8
+
+static const char *auditnames[AUDIT_COUNT] =
+{
+   "SMPC",
+   "SCSP",
+   "sound RAM",
+   "master SH2",
+   "slave SH2",
+   "VDP1",
+   "VDP2",
+   "low work RAM",
+   "high work RAM",
+};
+
+static const char *audithints[AUDIT_COUNT] =
+{
+   "SMPC output differs, the clock follows the host time unless clocksync is set",
+   "the sound side runs on its own thread (ASYNC_SCSP), check it is in step when the state is taken",
+   "the sound side runs on its own thread (ASYNC_SCSP), check it is in step when the state is taken",
+   "CPU state differs first, look for SH2 state the savestate leaves out",
+   "CPU state differs first, look for SH2 state the savestate leaves out",
+   "look for VDP1 state the savestate leaves out or the renderer writes back",
+   "look for VDP2 state the savestate leaves out or the renderer writes back",
+   "only memory differs, look for a source not in the savestate (DMA, CD block)",
+   "only memory differs, look for a source not in the savestate (DMA, CD block)",
+};
+
+static struct
+{
+   int window;
+   FILE *log;
+   int replaying;
+   int pos;
+   u32 frame;
+   u32 mismatches;
+
+   void *start;
+   size_t startsize;
+   AuditHash_struct *hash;
+   u8 (*input)[2][AUDIT_INPUT_SIZE];
+   int diverged[AUDIT_COUNT];
+} audit;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static u64 AuditHash(u64 hash, const void *data, size_t size)
+{
+   const u8 *p = (const u8 *)data;
+   u64 val;
+
+   // One multiply per 8 bytes, the mixing of xxHash64
+   while (size >= 8)
+   {
+      memcpy(&val, p, 8);
+      hash ^= val * 0xC2B2AE3D27D4EB4FULL;
+      hash = ((hash << 31) | (hash >> 33)) * 0x9E3779B185EBCA87ULL;
+      p += 8;
+      size -= 8;
+   }
+   while (size > 0)
+   {
+      hash = (hash ^ *p++) * 0x9E3779B185EBCA87ULL;
+      size--;
+   }
+   return hash ^ (hash >> 29);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AuditHashState(AuditHash_struct *hash)
+{
+   sh2regs_struct regs;
+   const void *slots;
+   size_t size;
+   u64 h;
+
+   hash->hash[AUDIT_SMPC] = AuditHash(0, SmpcRegs, sizeof(Smpc));
+
+   slots = ScspGetSlotState(&size);
+   hash->hash[AUDIT_SCSP] = AuditHash(0, slots, size);
+   hash->hash[AUDIT_SOUNDRAM] = AuditHash(0, SoundRam, 0x80000);
+
+   SH2GetRegisters(MSH2, &regs);
+   hash->hash[AUDIT_MSH2] = AuditHash(0, &regs, sizeof(regs));
+   SH2GetRegisters(SSH2, &regs);
+   hash->hash[AUDIT_SSH2] = AuditHash(0, &regs, sizeof(regs));
+
+   // Vdp1 is malloc'ed, leave the padding before addr out
+   h = AuditHash(0, Vdp1Regs, offsetof(Vdp1, MODR) + sizeof(Vdp1Regs->MODR));
+   h = AuditHash(h, &Vdp1Regs->addr, sizeof(Vdp1) - offsetof(Vdp1, addr));
+   hash->hash[AUDIT_VDP1] = AuditHash(h, Vdp1Ram, 0x80000);
+
+   h = AuditHash(0, Vdp2Regs, sizeof(Vdp2));
+   h = AuditHash(h, Vdp2ColorRam, 0x1000);
+   hash->hash[AUDIT_VDP2] = AuditHash(h, Vdp2Ram, 0x100000);
+
+   hash->hash[AUDIT_LWRAM] = AuditHash(0, LowWram, 0x100000);
+   hash->hash[AUDIT_HWRAM] = AuditHash(0, HighWram, 0x100000);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+const char *AuditName(int subsystem)
+{
+   if (subsystem < 0 || subsystem >= AUDIT_COUNT)
+      return "unknown";
+   return auditnames[subsystem];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void AuditInput(void)
+{
+   if (audit.pos >= audit.window)
+      return;
+   memcpy(PORTDATA1.data, audit.input[audit.pos][0], AUDIT_INPUT_SIZE);
+   memcpy(PORTDATA2.data, audit.input[audit.pos][1], AUDIT_INPUT_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int AuditBegin(void)
+{
+   free(audit.start);
+   audit.start = NULL;
+   audit.pos = 0;
+   return YabSaveStateBufferEx(&audit.start, &audit.startsize, YAB_STATE_QUIET);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void AuditReport(void)
+{
+   int first = -1;
+   int i;
+
+   for (i = 0; i < AUDIT_COUNT; i++)
+   {
+      if (audit.diverged[i] >= 0 && (first < 0 || audit.diverged[i] < audit.diverged[first]))
+         first = i;
+   }
+   if (first < 0)
+      return;
+
+   audit.mismatches++;
+   fprintf(audit.log, "Audit: frames %u-%u did not play the same twice\n",
+           (unsigned)audit.frame, (unsigned)(audit.frame + audit.window - 1));
+   fprintf(audit.log, "Audit: %s diverged first, at frame %u\n",
+           auditnames[first], (unsigned)(audit.frame + audit.diverged[first]));
+   for (i = 0; i < AUDIT_COUNT; i++)
+   {
+      if (i != first && audit.diverged[i] >= 0)
+         fprintf(audit.log, "Audit: then %s at frame %u\n",
+                 auditnames[i], (unsigned)(audit.frame + audit.diverged[i]));
+   }
+   if (first == AUDIT_SMPC && SmpcInternalVars->clocksync)
+      fprintf(audit.log, "Audit: hint: SMPC output differs with clocksync set\n");
+   else
+      fprintf(audit.log, "Audit: hint: %s\n", audithints[first]);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void AuditVerify(void)
+{
+   u8 live[2][AUDIT_INPUT_SIZE];
+   MovieInputProvider_func provider;
+   void *end = NULL;
+   size_t endsize;
+   int skip = yabsys.skipRender;
+   int i;
+
+   if (YabSaveStateBufferEx(&end, &endsize, YAB_STATE_QUIET) != 0)
+      return;
+   memcpy(live[0], PORTDATA1.data, AUDIT_INPUT_SIZE);
+   memcpy(live[1], PORTDATA2.data, AUDIT_INPUT_SIZE);
+
+   if (YabLoadStateBufferEx(audit.start, audit.startsize, YAB_STATE_QUIET) == 0)
+   {
+      for (i = 0; i < AUDIT_COUNT; i++)
+         audit.diverged[i] = -1;
+
+      // The recorded inputs stand in for the movie while the window is
+      // played again, so it neither records nor reads those frames twice
+      provider = MovieSetInputProvider(AuditInput);
+      audit.replaying = 1;
+      audit.pos = 0;
+      yabsys.skipRender = 1;
+      ScspDiscardAudio(1);
+      for (i = 0; i < audit.window; i++)
+         YabauseEmulate();
+      ScspDiscardAudio(0);
+      yabsys.skipRender = skip;
+      audit.replaying = 0;
+      MovieSetInputProvider(provider);
+
+      AuditReport();
+   }
+
+   // Go on from the live run whatever the replay gave
+   YabLoadStateBufferEx(end, endsize, YAB_STATE_QUIET);
+   free(end);
+   memcpy(PORTDATA1.data, live[0], AUDIT_INPUT_SIZE);
+   memcpy(PORTDATA2.data, live[1], AUDIT_INPUT_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int AuditInit(int window, FILE *log)
+{
+   AuditDeInit();
+   if (window <= 0)
+      return 0;
+
+   // Netplay owns the inputs and plays frames again on its own
+   if (MovieGetInputProvider() != NULL)
+   {
+      YabSetError(YAB_ERR_CANNOTINIT, "Audit (netplay is running)");
+      return -1;
+   }
+
+   audit.hash = (AuditHash_struct *)calloc(window, sizeof(AuditHash_struct));
+   audit.input = (u8 (*)[2][AUDIT_INPUT_SIZE])calloc(window, sizeof(*audit.input));
+   if (audit.hash == NULL || audit.input == NULL)
+   {
+      AuditDeInit();
+      YabSetError(YAB_ERR_CANNOTINIT, "Audit");
+      return -1;
+   }
+
+   audit.window = window;
+   audit.log = log != NULL ? log : stderr;
+   if (!SmpcInternalVars->clocksync)
+      fprintf(audit.log, "Audit: clocksync is off, the SMPC clock follows the host time\n");
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int AuditIsEnabled(void)
+{
+   return audit.window > 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AuditDeInit(void)
+{
+   free(audit.start);
+   free(audit.hash);
+   free(audit.input);
+   memset(&audit, 0, sizeof(audit));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int AuditFrame(void)
+{
+   AuditHash_struct hash;
+   int i;
+
+   if (audit.window <= 0)
+      return 0;
+
+   if (audit.replaying)
+   {
+      AuditHashState(&hash);
+      for (i = 0; i < AUDIT_COUNT; i++)
+      {
+         if (audit.diverged[i] < 0 && hash.hash[i] != audit.hash[audit.pos].hash[i])
+            audit.diverged[i] = audit.pos;
+      }
+      audit.pos++;
+      return 1;
+   }
+
+   // The first window starts once a whole frame has gone by
+   if (audit.start == NULL)
+   {
+      audit.frame = 1;
+      if (AuditBegin() != 0)
+      {
+         AuditDeInit();
+         YabSetError(YAB_ERR_OTHER, "Audit: unable to take a state");
+      }
+      return 0;
+   }
+
+   memcpy(audit.input[audit.pos][0], PORTDATA1.data, AUDIT_INPUT_SIZE);
+   memcpy(audit.input[audit.pos][1], PORTDATA2.data, AUDIT_INPUT_SIZE);
+   AuditHashState(&audit.hash[audit.pos]);
+   if (++audit.pos < audit.window)
+      return 0;
+
+   AuditVerify();
+   audit.frame += audit.window;
+   if (AuditBegin() != 0)
+   {
+      AuditDeInit();
+      YabSetError(YAB_ERR_OTHER, "Audit: unable to take a state");
+   }
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+u32 AuditMismatches(void)
+{
+   return audit.mismatches;
+}
@@ -0,0 +1,62 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include <stdio.h>
+#include "core.h"
+
+// Ordered from the usual causes of a divergence to the places it ends up
+// in, so the first one reported is the best lead
+enum
+{
+   AUDIT_SMPC,
+   AUDIT_SCSP,
+   AUDIT_SOUNDRAM,
+   AUDIT_MSH2,
+   AUDIT_SSH2,
+   AUDIT_VDP1,
+   AUDIT_VDP2,
+   AUDIT_LWRAM,
+   AUDIT_HWRAM,
+   AUDIT_COUNT
+};
+
+typedef struct
+{
+   u64 hash[AUDIT_COUNT];
+} AuditHash_struct;
+
+void AuditHashState(AuditHash_struct *hash);
+const char *AuditName(int subsystem);
+
+// Every window frames, load the state taken at the start of the window
+// and play it again with the same inputs, comparing the hashes of every
+// frame. Mismatches are written to log (stderr when NULL).
+int AuditInit(int window, FILE *log);
+void AuditDeInit(void);
+int AuditIsEnabled(void);
+
+// Called by the emulation once per frame. Returns 1 for the frames being
+// played again.
+int AuditFrame(void);
+
+// Windows that did not play the same twice
+u32 AuditMismatches(void);
+
+#endif
@@ -0,0 +1,203 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file frameskip.c
+    \brief Frame skipping driven by the measured emulation and render time.
+
+    Every paced frame is timed from start to end, and the time spent in
+    the renderer (VDP1 command submission, VDP2 drawing and the wait for
+    it) is timed apart. Both are averaged. Rendering one frame out of
+    skip + 1 costs
+
+        emulation + render / (skip + 1)
+
+    per frame, and the frameskip picks the smallest skip that keeps it
+    within the frame time. The skipped frames are still emulated and
+    paced, so the game and the sound keep their full speed; only the
+    picture is updated less often.
+
+    To avoid flickering between two values, skip goes up as soon as the
+    cost goes over the frame time but only comes back down once the lower
+    value would leave an eighth of the frame free, and it stays put for
+    FRAMESKIP_HOLD rendered frames after each change.
+
+    skip only changes on rendered frames, so while frames are being
+    skipped it is known which one comes right before a rendered frame.
+    That one still has VDP1 draw, since the rendered frame shows it.
+*/
+
+#include <string.h>
+#include "frameskip.h"
+#include "yabause.h"
+
+#define FRAMESKIP_HOLD 30
+
+static struct
+{
+   int maxskip;
+   int skip;       // Frames skipped between two rendered frames
+   int skipped;    // Frames skipped since the last rendered frame
+   int hold;
+   int active;
+   int rendering;
+   u32 total;
+
+   u64 start;
+   u64 renderstart;
+   u64 render;     // Ticks spent in the renderer this frame
+   s64 emu;        // Average ticks to emulate a frame, without rendering
+   s64 draw;       // Average ticks to render a frame
+} fs;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void FrameSkipAverage(s64 *average, s64 sample)
+{
+   *average += (sample - *average) / 8;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static s64 FrameSkipCost(int skip)
+{
+   return fs.emu + fs.draw / (skip + 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void FrameSkipAdapt(void)
+{
+   s64 budget = (s64)yabsys.OneFrameTime;
+
+   if (fs.hold > 0)
+   {
+      fs.hold--;
+      return;
+   }
+
+   if (fs.skip < fs.maxskip && FrameSkipCost(fs.skip) > budget)
+   {
+      fs.skip++;
+      fs.hold = FRAMESKIP_HOLD;
+   }
+   else if (fs.skip > 0 && FrameSkipCost(fs.skip - 1) * 8 < budget * 7)
+   {
+      fs.skip--;
+      fs.hold = FRAMESKIP_HOLD;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int FrameSkipInit(int maxskip)
+{
+   FrameSkipDeInit();
+   if (maxskip < 0)
+      maxskip = 0;
+   fs.maxskip = maxskip;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void FrameSkipDeInit(void)
+{
+   u32 total = fs.total;
+
+   memset(&fs, 0, sizeof(fs));
+   fs.total = total;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int FrameSkipIsEnabled(void)
+{
+   return fs.maxskip > 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int FrameSkipBegin(void)
+{
+   if (fs.maxskip <= 0)
+      return 0;
+
+   fs.active = 1;
+   fs.render = 0;
+   fs.rendering = fs.skipped >= fs.skip;
+   if (fs.rendering)
+      fs.skipped = 0;
+   else
+   {
+      fs.skipped++;
+      fs.total++;
+   }
+
+   fs.start = YabauseGetTicks();
+   return !fs.rendering;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int FrameSkipEnd(void)
+{
+   s64 work;
+
+   if (!fs.active)
+      return 0;
+   fs.active = 0;
+
+   work = (s64)(YabauseGetTicks() - fs.start);
+   FrameSkipAverage(&fs.emu, work - (s64)fs.render);
+   if (fs.rendering)
+   {
+      FrameSkipAverage(&fs.draw, (s64)fs.render);
+      FrameSkipAdapt();
+   }
+   return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int FrameSkipNextRenders(void)
+{
+   return fs.maxskip <= 0 || fs.skipped >= fs.skip;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void FrameSkipRenderStart(void)
+{
+   // Frames the frameskip does not pace (netplay, audit...) are not timed
+   if (fs.active)
+      fs.renderstart = YabauseGetTicks();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void FrameSkipRenderStop(void)
+{
+   if (fs.active)
+      fs.render += YabauseGetTicks() - fs.renderstart;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+u32 FrameSkipGetSkipped(void)
+{
+   return fs.total;
+}
@@ -0,0 +1,44 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef FRAMESKIP_H
+#define FRAMESKIP_H
+
+#include "core.h"
+
+// Skip the rendering of at most maxskip frames in a row when emulating
+// and rendering a frame takes longer than the frame lasts
+int FrameSkipInit(int maxskip);
+void FrameSkipDeInit(void);
+int FrameSkipIsEnabled(void);
+
+// Called around a frame the frameskip paces. FrameSkipBegin returns 1
+// when the frame should not be rendered, FrameSkipEnd returns 1 when the
+// frame that just ended was started by FrameSkipBegin.
+int FrameSkipBegin(void);
+int FrameSkipEnd(void);
+// Whether the frame after the one FrameSkipBegin started is rendered
+int FrameSkipNextRenders(void);
+
+// Called by the video side around the work done to render a frame
+void FrameSkipRenderStart(void);
+void FrameSkipRenderStop(void);
+
+// Frames whose rendering was skipped since the start
+u32 FrameSkipGetSkipped(void);
+
+#endif
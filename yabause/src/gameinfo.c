@@ -18,11 +18,13 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "gameinfo.h"
 #include "cdbase.h"
 #include "cs2.h"
+#include "statefile.h"
 
 extern ip_struct * cdip;
 
@@ -40,84 +42,92 @@ int GameInfoFromPath(const char * filename, GameInfo * info)
    return 1;
 }
 
-int LoadStateSlotScreenshotStream(FILE * fp, int * outputwidth, int * outputheight, u32 ** buffer)
+// Steps over a chunk header, returns the size of the chunk data or -1
+static int StateBufferHeader(const u8 * state, size_t size, size_t * pos, const char * name)
 {
-   int version, chunksize;
-   int totalsize;
-   size_t fread_result = 0;
-
-   fseek(fp, 0x14, SEEK_SET);
+   int chunksize;
 
-   if (StateCheckRetrieveHeader(fp, "CART", &version, &chunksize) != 0)
+   if (*pos + 12 > size || memcmp(state + *pos, name, 4) != 0)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
+   memcpy(&chunksize, state + *pos + 8, sizeof(chunksize));
+   *pos += 12;
+   return chunksize;
+}
 
-   if (StateCheckRetrieveHeader(fp, "CS2 ", &version, &chunksize) != 0)
+static int LoadStateSlotScreenshotBuffer(const u8 * state, size_t size, int * outputwidth, int * outputheight, u32 ** buffer)
+{
+   static const char * chunks[] = { "CART", "CS2 ", "MSH2", "SSH2", "SCSP", "SCU ", "SMPC", "VDP1", "VDP2" };
+   size_t pos = 0x14;
+   size_t totalsize;
+   int chunksize;
+   unsigned int i;
+
+   for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+   {
+      if ((chunksize = StateBufferHeader(state, size, &pos, chunks[i])) < 0)
+         return -1;
+      pos += chunksize;
+   }
+
+   if (StateBufferHeader(state, size, &pos, "OTHR") < 0)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
 
-   if (StateCheckRetrieveHeader(fp, "MSH2", &version, &chunksize) != 0)
+   // Work RAM and the timing fields come before the picture
+   pos += 0x210000 + sizeof(int) * 9;
+   if (pos + sizeof(int) * 2 > size)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
 
-   if (StateCheckRetrieveHeader(fp, "SSH2", &version, &chunksize) != 0)
-      return -1;
-   fseek(fp, chunksize, SEEK_CUR);
+   memcpy(outputwidth, state + pos, sizeof(int));
+   memcpy(outputheight, state + pos + sizeof(int), sizeof(int));
+   pos += sizeof(int) * 2;
 
-   if (StateCheckRetrieveHeader(fp, "SCSP", &version, &chunksize) != 0)
+   if (*outputwidth < 0 || *outputheight < 0)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
-
-   if (StateCheckRetrieveHeader(fp, "SCU ", &version, &chunksize) != 0)
+   totalsize = (size_t)*outputwidth * *outputheight * sizeof(u32);
+   if (pos + totalsize > size)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
 
-   if (StateCheckRetrieveHeader(fp, "SMPC", &version, &chunksize) != 0)
+   *buffer = malloc(totalsize);
+   if (*buffer == NULL && totalsize != 0)
       return -1;
-   fseek(fp, chunksize, SEEK_CUR);
+   memcpy(*buffer, state + pos, totalsize);
 
-   if (StateCheckRetrieveHeader(fp, "VDP1", &version, &chunksize) != 0)
-      return -1;
-   fseek(fp, chunksize, SEEK_CUR);
+   return 0;
+}
 
-   if (StateCheckRetrieveHeader(fp, "VDP2", &version, &chunksize) != 0)
-      return -1;
-   fseek(fp, chunksize, SEEK_CUR);
+int LoadStateSlotScreenshotStream(FILE * fp, int * outputwidth, int * outputheight, u32 ** buffer)
+{
+   void * state;
+   size_t size;
+   int status;
 
-   if (StateCheckRetrieveHeader(fp, "OTHR", &version, &chunksize) != 0)
+   // State files are deflated, the picture is looked for in the whole state
+   fseek(fp, 0, SEEK_SET);
+   if (StateFileReadStream(fp, &state, &size) != 0)
       return -1;
 
-   fseek(fp, 0x210000, SEEK_CUR);
-
-   fseek(fp, sizeof(int) * 9, SEEK_CUR);
-
-   fread_result = fread((void *) outputwidth, sizeof(int), 1, fp);
-   fread_result = fread((void *) outputheight, sizeof(int), 1, fp);
+   status = LoadStateSlotScreenshotBuffer(state, size, outputwidth, outputheight, buffer);
 
-   totalsize = *outputwidth * *outputheight * sizeof(u32);
+   free(state);
 
-   *buffer = malloc(totalsize);
-
-   fread_result = fread(*buffer, totalsize, 1, fp);
-
-   return 0;
+   return status;
 }
 
 int LoadStateSlotScreenshot(const char * dirpath, const char * itemnum, int slot, int * outputwidth, int * outputheight, u32 ** buffer)
 {
    char filename[512];
-   FILE * fp;
+   void * state;
+   size_t size;
    int status;
 
    sprintf(filename, "%s/%s_%03d.yss", dirpath, itemnum, slot);
 
-   fp = fopen(filename, "r");
-   if (fp == NULL)
+   if (StateFileRead(filename, &state, &size) != 0)
       return -1;
 
-   status = LoadStateSlotScreenshotStream(fp, outputwidth, outputheight, buffer);
+   status = LoadStateSlotScreenshotBuffer(state, size, outputwidth, outputheight, buffer);
 
-   fclose(fp);
+   free(state);
 
    return status;
 }
@@ -40,6 +40,9 @@
 #include "../cs2.h"
 #include "../cdbase.h"
 #include "../scsp.h"
+#include "../rewind.h"
+#include "../netplay.h"
+#include "../replay.h"
 #include "../sndsdl.h"
 #include "../sndal.h"
 #include "../persdljoy.h"
@@ -144,11 +147,25 @@ NULL
 static int fullscreen = 0;
 static int scanline = 0;
 static int lowres_mode = 0;
+#ifdef PLATFORM_HEADLESS
+static int headless_frames = 0;
+static const char *headless_dump = NULL;
+#endif
 
 static char biospath[256] = "\0";
 static char cdpath[256] = "\0";
 static char stvgamepath[256] = "\0";
 static char stvbiospath[256] = "\0";
+static char netplayhost[256] = "\0";
+static int netplayplayer = 0;
+static int netplaylocalport = 0;
+static int netplayport = 0;
+static const char *replaymovie = NULL;
+static const char *replayreference = NULL;
+static const char *replayout = NULL;
+static int replayinterval = REPLAY_DEFAULT_INTERVAL;
+static int fastforwardinterval = 8;
+static int fastforwardturbo = 0;
 
 yabauseinit_struct yinit;
 
@@ -181,7 +198,7 @@ void YuiSwapBuffers(void) {
 }
 
 int YuiGetFB(void) {
-  return 0;
+  return platform_getFB();
 }
 
 void YuiInit() {
@@ -218,8 +235,10 @@ void YuiInit() {
 	yinit.usethreads = 1;
 	yinit.numthreads = 4;
         yinit.usecache = 0;
+        yinit.presentthread = 0;
 #ifdef SPRITE_CACHE
         yinit.useVdp1cache = 0;
+        yinit.vdp1cachesize = 0;
 #endif
 }
 
@@ -242,6 +261,42 @@ void displayGameInfo(char *filename) {
   printf("Game Info:\n\tSystem: %s\n\tCompany: %s\n\tItemNum:%s\n\tVersion:%s\n\tDate:%s\n\tCDInfo:%s\n\tRegion:%s\n\tPeripheral:%s\n\tGamename:%s\n", info.system, info.company, info.itemnum, info.version, info.date, info.cdinfo, info.region, info.peripheral, info.gamename);
 }
 
+// Plays a movie back without window, sound or pacing and prints the
+// checkpoint hashes. Exits with 1 when they differ from the reference.
+static int RunReplay() {
+  FILE *reference = NULL;
+  FILE *out = stdout;
+  int ret;
+
+  yinit.vidcoretype = VIDCORE_DUMMY;
+  yinit.sndcoretype = SNDCORE_DUMMY;
+  // The RTC must not follow the host clock, or no two runs would match
+  yinit.clocksync = 1;
+  if (yinit.basetime == 0) yinit.basetime = 946684800; // 2000-01-01
+
+  if (replayreference != NULL && (reference = fopen(replayreference, "r")) == NULL) {
+    printf("Can't open %s\n", replayreference);
+    return 2;
+  }
+  if (replayout != NULL && (out = fopen(replayout, "w")) == NULL) {
+    printf("Can't open %s\n", replayout);
+    if (reference != NULL) fclose(reference);
+    return 2;
+  }
+
+  if (YabauseInit(&yinit) != 0) {
+    printf("YabauseInit error \n\r");
+    ret = -1;
+  } else {
+    ret = ReplayMovie(replaymovie, replayinterval, reference, out);
+  }
+  YabauseDeInit();
+
+  if (reference != NULL) fclose(reference);
+  if (out != stdout) fclose(out);
+  return (ret < 0) ? 2 : ret;
+}
+
 void initEmulation() {
    YuiInit();
    SetupOpenGL();
@@ -253,6 +308,7 @@ void initEmulation() {
 #ifndef TEST_MODE
 int main(int argc, char *argv[]) {
 	int i;
+	int ret;
 
 	LogStart();
 	LogChangeOutput( DEBUG_STDERR, NULL );
@@ -329,6 +385,56 @@ int main(int argc, char *argv[]) {
       else if (strcmp(argv[i], "-lr") == 0 || strcmp(argv[i], "--lowres") == 0) {
         lowres_mode = 1;
       }
+      // Capture a rewind state every n frames
+      else if (strstr(argv[i], "--rewind=")) {
+        yinit.rewindinterval = atoi(argv[i] + strlen("--rewind="));
+      }
+      // Save a state in the current directory every n seconds
+      else if (strstr(argv[i], "--autosave=")) {
+        yinit.autosaveinterval = atoi(argv[i] + strlen("--autosave="));
+      }
+      // Play every n frames again from a state and report what differs
+      else if (strstr(argv[i], "--audit=")) {
+        yinit.auditwindow = atoi(argv[i] + strlen("--audit="));
+      }
+      // Headless replay of a movie, checking its hashes against a reference
+      else if (strstr(argv[i], "--replay=")) {
+        replaymovie = argv[i] + strlen("--replay=");
+      }
+      else if (strstr(argv[i], "--reference=")) {
+        replayreference = argv[i] + strlen("--reference=");
+      }
+      else if (strstr(argv[i], "--checkpoints=")) {
+        replayout = argv[i] + strlen("--checkpoints=");
+      }
+      else if (strstr(argv[i], "--checkpoint-interval=")) {
+        replayinterval = atoi(argv[i] + strlen("--checkpoint-interval="));
+      }
+      // Rollback netplay as player 1 or 2: player:localport:host:port
+      else if (strstr(argv[i], "--netplay=")) {
+        if (sscanf(argv[i] + strlen("--netplay="), "%d:%d:%255[^:]:%d",
+                   &netplayplayer, &netplaylocalport, netplayhost, &netplayport) != 4)
+          netplayplayer = 0;
+      }
+#ifndef PLATFORM_HEADLESS
+      // Swap buffers from a dedicated thread
+      else if (strcmp(argv[i], "-pt") == 0 || strcmp(argv[i], "--presentthread") == 0) {
+#ifdef YGL_PRESENT_THREAD
+        yinit.presentthread = 1;
+#else
+        printf("%s ignored: this build has no present thread (needs YAB_ASYNC_RENDERING)\n", argv[i]);
+#endif
+      }
+#else
+      // Number of frames to run, 0 for no limit
+      else if (strstr(argv[i], "--frames=")) {
+        headless_frames = atoi(argv[i] + strlen("--frames="));
+      }
+      // Raw RGBA output of every frame
+      else if (strstr(argv[i], "--dump=")) {
+        headless_dump = argv[i] + strlen("--dump=");
+      }
+#endif
       else if (strcmp(argv[i], "-sc") == 0 || strcmp(argv[i], "--softcore") == 0) {
         yinit.vidcoretype = VIDCORE_SOFT;
       }
@@ -336,6 +442,14 @@ int main(int argc, char *argv[]) {
       else if (strcmp(argv[i], "-vc") == 0 || strcmp(argv[i], "--vdp1cache") == 0) {
         yinit.useVdp1cache = 1;;
       }
+      // In MB, clamped to what the byte budget holds, 0 keeps the default
+      else if (strstr(argv[i], "--vdp1cachesize=")) {
+        long size = strtol(argv[i] + strlen("--vdp1cachesize="), NULL, 10);
+        if (size < 0) size = 0;
+        if (size > 4095) size = 4095;
+        yinit.useVdp1cache = 1;
+        yinit.vdp1cachesize = (u32)size * 1024 * 1024;
+      }
 #endif
       else if (strcmp(argv[i], "-ci") == 0 ) {
         yinit.sh2coretype = 1;
@@ -359,8 +473,33 @@ int main(int argc, char *argv[]) {
       else if (strstr(argv[i], "--vsyncoff")) {
         EnableAutoFrameSkip();
       }
+      // Frames emulated per rendered frame while fast-forwarding
+      else if (strstr(argv[i], "--fastforward=")) {
+        fastforwardinterval = atoi(argv[i] + strlen("--fastforward="));
+      }
+      // Skip rendering at most n frames in a row when the host falls behind
+      else if (strstr(argv[i], "--frameskip=")) {
+        yinit.adaptiveskip = atoi(argv[i] + strlen("--frameskip="));
+      }
+      // Fast-forward at a fixed speed instead of as fast as possible
+      else if (strcmp(argv[i], "--turbo") == 0) {
+        fastforwardturbo = 1;
+      }
     }
   }
+  if (replaymovie != NULL) {
+    ret = RunReplay();
+    LogStop();
+    return ret;
+  }
+  if (netplayplayer != 0) {
+    // Both sides must boot with the same RTC, the host clocks never agree
+    yinit.clocksync = 1;
+    if (yinit.basetime == 0) yinit.basetime = 946684800; // 2000-01-01
+  }
+#ifdef PLATFORM_HEADLESS
+  platform_SetHeadlessOutput(headless_frames, headless_dump);
+#endif
   SetupOpenGL();
 
 	YabauseDeInit();
@@ -395,20 +534,38 @@ int main(int argc, char *argv[]) {
 
   platform_SetKeyCallback(PERCore->onKeyEvent);
 
+  if (netplayplayer != 0) {
+    NetplayTransport_struct transport;
+    if (NetplayUdpTransport(&transport, netplaylocalport, netplayhost, netplayport) != 0 ||
+        NetplayInit(&transport, netplayplayer, 2) != 0) {
+      printf("Netplay init error \n\r");
+      return 1;
+    }
+  }
+
   while (!platform_shouldClose())
   {
         int height;
         int width;
+        int fastforward;
         platform_getFBSize(&width, &height);
         if ((Wwidth != width) || (Wheight != height)) {
           Wwidth = width;
           Wheight = height;
           VIDCore->Resize(0, 0, Wwidth, Wheight, 1);
         }
-        if (YabauseExec() == -1) platform_Close();
+        // Rewinding would take this side out of step with the peer
+        if (!NetplayIsActive() && platform_isRewinding()) RewindStep();
+        fastforward = !NetplayIsActive() && (fastforwardinterval > 1) && platform_isFastForwarding();
+        if (fastforward != isFastForward()) {
+          if (fastforward) EnableFastForward(fastforwardinterval, fastforwardturbo);
+          else DisableFastForward();
+        }
+        if (NetplayExec() == -1) platform_Close();
         platform_HandleEvent();
   }
 
+	NetplayDeInit();
 	YabauseDeInit();
 	LogStop();
   platform_Deinit();
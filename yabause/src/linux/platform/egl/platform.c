@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <string.h>
+#include "platform.h"
+#include "../ygl.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Headless platform: the GL core renders in a surfaceless EGL context
+// (Mesa EGL_MESA_platform_surfaceless, or any display supporting
+// EGL_KHR_surfaceless_context) into a framebuffer object which stands for
+// the window. Frames are handed back through the GL core readback ring.
+//
+// There is a single context, so rendering is not split between a window
+// context and a shared one: YuiUseOGLOnThisThread and
+// YuiRevokeOGLOnThisThread do nothing, like on the Qt port.
+
+static EGLDisplay g_display = EGL_NO_DISPLAY;
+static EGLContext g_context = EGL_NO_CONTEXT;
+static GLuint g_fbo = 0;
+static GLuint g_color = 0;
+static GLuint g_depth = 0;
+static int g_width = 0;
+static int g_height = 0;
+
+static int g_close = 0;
+static int g_frames = 0;
+static int g_maxframes = 0;
+static const char *g_outpath = NULL;
+static FILE *g_out = NULL;
+
+int platform_YuiRevokeOGLOnThisThread(){
+  return 0;
+}
+
+int platform_YuiUseOGLOnThisThread(){
+  return 0;
+}
+
+static void frame_callback(const u8 *pixels, int width, int height, void *arg) {
+  if (g_out != NULL) fwrite(pixels, 4, width * height, g_out);
+}
+
+void platform_SetHeadlessOutput(int frames, const char *path) {
+  g_maxframes = frames;
+  g_outpath = path;
+}
+
+void platform_swapBuffers(void) {
+  g_frames++;
+  if ((g_maxframes != 0) && (g_frames >= g_maxframes)) g_close = 1;
+}
+
+void platform_getFBSize(int *w, int*h) {
+  *w = g_width;
+  *h = g_height;
+}
+
+int platform_getFB(void) {
+  return g_fbo;
+}
+
+int platform_isRewinding(void) {
+  return 0;
+}
+
+int platform_isFastForwarding(void) {
+  return 0;
+}
+
+static EGLDisplay platform_GetDisplay(void) {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  const char *ext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if ((ext != NULL) && (strstr(ext, "EGL_MESA_platform_surfaceless") != NULL)) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+      display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  return display;
+}
+
+int platform_SetupOpenGL(int w, int h, int fullscreen) {
+  EGLint major, minor;
+  EGLConfig config;
+  EGLint count = 0;
+  const char *ext;
+  static const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+#ifdef _OGLES3_
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+#else
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+#endif
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+  };
+  static const EGLint context_attribs[][7] = {
+#ifdef _OGLES3_
+    { EGL_CONTEXT_MAJOR_VERSION_KHR, 3, EGL_CONTEXT_MINOR_VERSION_KHR, 0, EGL_NONE },
+#else
+    { EGL_CONTEXT_MAJOR_VERSION_KHR, 4, EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR, EGL_NONE },
+    { EGL_CONTEXT_MAJOR_VERSION_KHR, 3, EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR, EGL_NONE },
+#endif
+  };
+  int i;
+
+  g_display = platform_GetDisplay();
+  if ((g_display == EGL_NO_DISPLAY) || !eglInitialize(g_display, &major, &minor)) {
+    fprintf(stderr, "EGL: no display\n");
+    return 0;
+  }
+  ext = eglQueryString(g_display, EGL_EXTENSIONS);
+  if ((ext == NULL) || (strstr(ext, "EGL_KHR_surfaceless_context") == NULL)) {
+    fprintf(stderr, "EGL: surfaceless contexts are not supported\n");
+    eglTerminate(g_display);
+    return 0;
+  }
+
+#ifdef _OGLES3_
+  eglBindAPI(EGL_OPENGL_ES_API);
+#else
+  eglBindAPI(EGL_OPENGL_API);
+#endif
+  if (!eglChooseConfig(g_display, config_attribs, &config, 1, &count) || (count == 0)) {
+    fprintf(stderr, "EGL: no suitable config\n");
+    eglTerminate(g_display);
+    return 0;
+  }
+  for (i = 0; (i < sizeof(context_attribs)/sizeof(context_attribs[0])) && (g_context == EGL_NO_CONTEXT); i++)
+    g_context = eglCreateContext(g_display, config, EGL_NO_CONTEXT, context_attribs[i]);
+  if ((g_context == EGL_NO_CONTEXT) || !eglMakeCurrent(g_display, EGL_NO_SURFACE, EGL_NO_SURFACE, g_context)) {
+    fprintf(stderr, "EGL: unable to create a context\n");
+    eglTerminate(g_display);
+    return 0;
+  }
+
+#if defined(_USEGLEW_)
+  glewExperimental=GL_TRUE;
+  glewInit();
+#endif
+
+  printf("OpenGL version is %s (%s, %s), EGL %d.%d\n", glGetString(GL_VERSION), glGetString(GL_VENDOR), glGetString(GL_RENDERER), major, minor);
+
+  // There is no default framebuffer, this one is left bound so the GL core
+  // picks it as its output
+  g_width = w;
+  g_height = h;
+  glGenRenderbuffers(1, &g_color);
+  glBindRenderbuffer(GL_RENDERBUFFER, g_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+  glGenRenderbuffers(1, &g_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, g_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &g_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, g_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, g_color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, g_depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "EGL: incomplete output framebuffer\n");
+    return 0;
+  }
+
+  if (g_outpath != NULL) {
+    g_out = fopen(g_outpath, "wb");
+    if (g_out == NULL) fprintf(stderr, "Unable to open %s\n", g_outpath);
+    else printf("Writing %dx%d RGBA frames (bottom-up) to %s\n", w, h, g_outpath);
+  }
+  YglReadbackInit(0, frame_callback, NULL);
+  return 1;
+}
+
+int platform_shouldClose() {
+  return g_close;
+}
+
+void platform_Close() {
+  g_close = 1;
+}
+
+int platform_Deinit(void) {
+  YglReadbackFlush();
+  YglReadbackInit(0, NULL, NULL);
+  if (g_out != NULL) fclose(g_out);
+  g_out = NULL;
+  if (g_fbo != 0) glDeleteFramebuffers(1, &g_fbo);
+  if (g_color != 0) glDeleteRenderbuffers(1, &g_color);
+  if (g_depth != 0) glDeleteRenderbuffers(1, &g_depth);
+  g_fbo = g_color = g_depth = 0;
+  if (g_display != EGL_NO_DISPLAY) {
+    eglMakeCurrent(g_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (g_context != EGL_NO_CONTEXT) eglDestroyContext(g_display, g_context);
+    eglTerminate(g_display);
+  }
+  g_context = EGL_NO_CONTEXT;
+  g_display = EGL_NO_DISPLAY;
+  return 0;
+}
+
+void platform_HandleEvent(void) {
+}
+
+void platform_SetKeyCallback(k_callback call) {
+}
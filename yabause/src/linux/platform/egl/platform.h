@@ -0,0 +1,33 @@
+#ifndef PLATFORM_EGL_H
+#define PLATFORM_EGL_H
+
+#ifdef PLATFORM_LINUX
+#error "A platform has already been set"
+#else
+#define PLATFORM_LINUX
+#endif
+
+// Surfaceless EGL context, no window and no display server needed
+#define PLATFORM_HEADLESS
+
+typedef void (*k_callback)(unsigned int key, unsigned char state);
+
+extern int platform_SetupOpenGL(int w, int h, int fullscreen);
+extern int platform_YuiRevokeOGLOnThisThread();
+extern int platform_YuiUseOGLOnThisThread();
+extern void platform_swapBuffers(void);
+extern int platform_shouldClose();
+extern void platform_Close();
+extern int platform_Deinit(void);
+extern void platform_HandleEvent();
+extern void platform_SetKeyCallback(k_callback call);
+extern void platform_getFBSize(int *w, int*h);
+extern int platform_getFB(void);
+extern int platform_isRewinding(void);
+extern int platform_isFastForwarding(void);
+
+// Stop after the given number of frames (0 runs until closed) and write
+// each frame as raw RGBA8 to the given file (NULL discards them)
+extern void platform_SetHeadlessOutput(int frames, const char *path);
+
+#endif
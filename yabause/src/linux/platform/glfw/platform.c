@@ -140,6 +140,20 @@ void platform_getFBSize(int *w, int*h) {
    glfwGetFramebufferSize(g_window, w, h);
 }
 
+int platform_getFB(void) {
+  return 0;
+}
+
+// Backspace steps back through the rewind history while held
+int platform_isRewinding(void) {
+  return glfwGetKey(g_window, GLFW_KEY_BACKSPACE) == GLFW_PRESS;
+}
+
+// Tab fast-forwards while held
+int platform_isFastForwarding(void) {
+  return glfwGetKey(g_window, GLFW_KEY_TAB) == GLFW_PRESS;
+}
+
 int platform_SetupOpenGL(int w, int h, int fullscreen) {
   int i;
   if (!glfwInit())
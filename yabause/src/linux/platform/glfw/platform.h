@@ -19,5 +19,8 @@ extern int platform_Deinit(void);
 extern void platform_HandleEvent();
 extern void platform_SetKeyCallback(k_callback call);
 extern void platform_getFBSize(int *w, int*h);
+extern int platform_getFB(void);
+extern int platform_isRewinding(void);
+extern int platform_isFastForwarding(void);
 
 #endif
@@ -22,6 +22,9 @@
     \brief Memory access functions.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE // fopencookie
+#endif
 #ifdef PSP  // see FIXME in T1MemoryInit()
 # include <stdint.h>
 #endif
@@ -48,6 +51,8 @@
 #include "movie.h"
 #include "bios.h"
 #include "peripheral.h"
+#include "statefile.h"
+#include "zlib/zlib.h"
 
 //#ifdef HAVE_LIBGL
 //#define USE_OPENGL
@@ -1586,38 +1591,276 @@ void FormatBackupRam(void *mem, u32 size)
 
 //////////////////////////////////////////////////////////////////////////////
 
-int YabSaveStateBuffer(void ** buffer, size_t * size)
+/*
+  In-memory states
+
+  The state code writes through stdio, so memory states use a FILE whose
+  backend is a plain buffer (fopencookie on glibc, funopen on the BSDs):
+  the caller's buffer is filled directly, no temporary file is involved,
+  and a stream without buffer only counts bytes to give the exact size of
+  a state. Other platforms go through tmpfile().
+*/
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__ANDROID__)
+#define STATE_MEM_STREAM
+#endif
+
+typedef struct
+{
+   u8 *buffer;       // NULL to measure only
+   size_t capacity;
+   size_t pos;
+   size_t size;      // furthest byte written or readable
+   int grow;         // buffer is ours and is reallocated on demand
+   int overflow;
+} StateMem_struct;
+
+// Size of the last state saved without a thumbnail, movie block left out.
+// Apart from the movie only the cart changes the size of a state, so
+// YabSaveStateSize adds the movie block to it instead of measuring again.
+static struct
+{
+   size_t base;
+   int carttype;
+} statesize;
+
+#ifdef STATE_MEM_STREAM
+
+static int StateMemReserve(StateMem_struct *mem, size_t end)
+{
+   u8 *buf;
+   size_t capacity;
+
+   if (end <= mem->capacity || mem->buffer == NULL)
+      return 1;
+   if (!mem->grow)
+      return 0;
+
+   capacity = mem->capacity ? mem->capacity : 0x400000;
+   while (capacity < end)
+      capacity *= 2;
+   if ((buf = (u8 *)realloc(mem->buffer, capacity)) == NULL)
+      return 0;
+   mem->buffer = buf;
+   mem->capacity = capacity;
+   return 1;
+}
+
+static int StateMemWrite(void *cookie, const char *buf, int len)
+{
+   StateMem_struct *mem = (StateMem_struct *)cookie;
+
+   if (!StateMemReserve(mem, mem->pos + len))
+   {
+      // Caller's buffer is too small, the state is rejected at the end
+      mem->overflow = 1;
+      return len;
+   }
+   if (mem->buffer != NULL)
+      memcpy(mem->buffer + mem->pos, buf, len);
+   mem->pos += len;
+   if (mem->pos > mem->size)
+      mem->size = mem->pos;
+   return len;
+}
+
+static int StateMemRead(void *cookie, char *buf, int len)
+{
+   StateMem_struct *mem = (StateMem_struct *)cookie;
+
+   if (mem->pos >= mem->size)
+      return 0;
+   if ((size_t)len > mem->size - mem->pos)
+      len = (int)(mem->size - mem->pos);
+   memcpy(buf, mem->buffer + mem->pos, len);
+   mem->pos += len;
+   return len;
+}
+
+static s64 StateMemSeek(StateMem_struct *mem, s64 offset, int whence)
+{
+   s64 pos;
+
+   switch (whence)
+   {
+      case SEEK_SET: pos = offset; break;
+      case SEEK_CUR: pos = (s64)mem->pos + offset; break;
+      case SEEK_END: pos = (s64)mem->size + offset; break;
+      default: return -1;
+   }
+   if (pos < 0)
+      return -1;
+   mem->pos = (size_t)pos;
+   return pos;
+}
+
+#ifdef __GLIBC__
+static ssize_t StateMemWriteCookie(void *cookie, const char *buf, size_t len)
+{
+   return StateMemWrite(cookie, buf, (int)len);
+}
+
+static ssize_t StateMemReadCookie(void *cookie, char *buf, size_t len)
+{
+   return StateMemRead(cookie, buf, (int)len);
+}
+
+static int StateMemSeekCookie(void *cookie, off64_t *offset, int whence)
+{
+   s64 pos = StateMemSeek((StateMem_struct *)cookie, *offset, whence);
+   if (pos < 0)
+      return -1;
+   *offset = pos;
+   return 0;
+}
+#else
+static fpos_t StateMemSeekCookie(void *cookie, fpos_t offset, int whence)
+{
+   return (fpos_t)StateMemSeek((StateMem_struct *)cookie, offset, whence);
+}
+#endif
+
+static FILE *StateMemOpen(StateMem_struct *mem, const char *mode)
+{
+   FILE *fp;
+#ifdef __GLIBC__
+   cookie_io_functions_t io = { StateMemReadCookie, StateMemWriteCookie, StateMemSeekCookie, NULL };
+   fp = fopencookie(mem, mode, io);
+#else
+   fp = funopen(mem, StateMemRead, StateMemWrite, StateMemSeekCookie, NULL);
+#endif
+   // Unbuffered, so writes and reads go straight to the caller's memory
+   if (fp != NULL)
+      setvbuf(fp, NULL, _IONBF, 0);
+   return fp;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int YabSaveStateMem(StateMem_struct *mem, int flags)
 {
    FILE * fp;
    int status;
-   size_t num_read = 0;
-
-   if (buffer != NULL) *buffer = NULL;
-   *size = 0;
 
-   fp = tmpfile();
+#ifdef STATE_MEM_STREAM
+   if ((fp = StateMemOpen(mem, "wb")) == NULL)
+      return -1;
+#else
+   if ((fp = tmpfile()) == NULL)
+      return -1;
+#endif
 
+   // Only state files ask for a thumbnail, rewind, netplay and the like
+   // never touch the video pipeline
    ScspLockThread();
-   status = YabSaveStateStream(fp);
+   status = YabSaveStateStreamEx(fp, flags);
    ScspUnLockThread();
 
-   if (status != 0)
+#ifndef STATE_MEM_STREAM
+   if (status == 0)
    {
-      fclose(fp);
-      return status;
+      fseek(fp, 0, SEEK_END);
+      mem->size = ftell(fp);
+      fseek(fp, 0, SEEK_SET);
+      if (mem->grow && (mem->buffer = (u8 *)malloc(mem->size)) != NULL)
+         mem->capacity = mem->size;
+      if (mem->size > mem->capacity && mem->buffer != NULL)
+         mem->overflow = 1;
+      else if (mem->buffer != NULL)
+         fread(mem->buffer, 1, mem->size, fp);
    }
+#endif
+   fclose(fp);
 
-   fseek(fp, 0, SEEK_END);
-   *size = ftell(fp);
-   fseek(fp, 0, SEEK_SET);
+   if (status == 0 && mem->overflow)
+      status = -1;
 
-   if (buffer != NULL)
+   if (status == 0 && !(flags & YAB_STATE_THUMBNAIL))
    {
-      *buffer = malloc(*size);
-      num_read = fread(*buffer, 1, *size, fp);
+      statesize.base = mem->size - ((flags & YAB_STATE_MOVIE) ? MovieStateSize() : 0);
+      statesize.carttype = CartridgeArea->carttype;
    }
+   return status;
+}
 
-   fclose(fp);
+//////////////////////////////////////////////////////////////////////////////
+
+size_t YabSaveStateSize(void)
+{
+   StateMem_struct mem;
+
+   if (statesize.base == 0 || statesize.carttype != CartridgeArea->carttype)
+   {
+      memset(&mem, 0, sizeof(mem));
+      if (YabSaveStateMem(&mem, YAB_STATE_MOVIE) != 0)
+         return 0;
+   }
+   return statesize.base + MovieStateSize();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabSaveStateToBuffer(void * buffer, size_t capacity, size_t * size)
+{
+   return YabSaveStateToBufferEx(buffer, capacity, size, YAB_STATE_MOVIE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabSaveStateToBufferEx(void * buffer, size_t capacity, size_t * size, int flags)
+{
+   StateMem_struct mem;
+   int status;
+
+   if (buffer == NULL)
+      return -1;
+   memset(&mem, 0, sizeof(mem));
+   mem.buffer = (u8 *)buffer;
+   mem.capacity = capacity;
+   status = YabSaveStateMem(&mem, flags);
+   if (size != NULL)
+      *size = mem.size;
+   return status;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabSaveStateBuffer(void ** buffer, size_t * size)
+{
+   if (buffer == NULL)
+   {
+      *size = YabSaveStateSize();
+      return (*size != 0) ? 0 : -1;
+   }
+   return YabSaveStateBufferEx(buffer, size, YAB_STATE_MOVIE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabSaveStateBufferEx(void ** buffer, size_t * size, int flags)
+{
+   StateMem_struct mem;
+   int status;
+
+   *buffer = NULL;
+   *size = 0;
+   memset(&mem, 0, sizeof(mem));
+   mem.grow = 1;
+#ifdef STATE_MEM_STREAM
+   if ((mem.buffer = (u8 *)malloc(0x400000)) == NULL)
+      return -2;
+   mem.capacity = 0x400000;
+#endif
+   status = YabSaveStateMem(&mem, flags);
+   if (status != 0)
+   {
+      free(mem.buffer);
+      return status;
+   }
+   *buffer = mem.buffer;
+   *size = mem.size;
    return 0;
 }
 
@@ -1625,7 +1868,8 @@ int YabSaveStateBuffer(void ** buffer, size_t * size)
 
 int YabSaveState(const char *filename)
 {
-   FILE *fp;
+   void *buffer;
+   size_t size;
    int status;
 
    //use a second set of savestates for movies
@@ -1633,14 +1877,13 @@ int YabSaveState(const char *filename)
    if (!filename)
       return -1;
 
-   if ((fp = fopen(filename, "wb")) == NULL)
-      return -1;
-   ScspLockThread();
-   status = YabSaveStateStream(fp);
-   ScspUnLockThread();
-   fclose(fp);
+   // Only the snapshot is taken here, deflating and writing the file is
+   // left to the state file thread
+   status = YabSaveStateBufferEx(&buffer, &size, YAB_STATE_THUMBNAIL | YAB_STATE_MOVIE);
+   if (status != 0)
+      return status;
 
-   return status;
+   return StateFileQueue(filename, buffer, size);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1659,11 +1902,18 @@ int YabSaveState(const char *filename)
 //    [sh2core.c] wdt probably needs to be written as well
 
 int YabSaveStateStream(FILE *fp)
+{
+   return YabSaveStateStreamEx(fp, YAB_STATE_THUMBNAIL | YAB_STATE_MOVIE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabSaveStateStreamEx(FILE *fp, int flags)
 {
    u32 i;
    int offset;
    IOCheck_struct check;
-   u8 *buf;
+   u8 *buf = NULL;
    int totalsize;
    int outputwidth;
    int outputheight;
@@ -1729,33 +1979,34 @@ int YabSaveStateStream(FILE *fp)
    ywrite(&check, (void *)&yabsys.CurSH2FreqType, sizeof(int), 1, fp);
    ywrite(&check, (void *)&yabsys.IsPal, sizeof(int), 1, fp);
 
-   VIDCore->GetGlSize(&outputwidth, &outputheight);
-
-   totalsize=outputwidth * outputheight * sizeof(u32);
-
-   if ((buf = (u8 *)malloc(totalsize)) == NULL)
+   // The thumbnail is the last frame the video core has already read back,
+   // a state without one stores a 0x0 picture
+   outputwidth = 0;
+   outputheight = 0;
+   if ((flags & YAB_STATE_THUMBNAIL) && (VIDCore != NULL) && (VIDCore->GetThumbnail != NULL))
    {
-      return -2;
+      if (VIDCore->GetThumbnail(&buf, &outputwidth, &outputheight) != 0)
+      {
+         outputwidth = 0;
+         outputheight = 0;
+      }
    }
-
-   //YuiSwapBuffers();
-   #ifdef USE_OPENGL
-   glPixelZoom(1,1);
-   glReadBuffer(GL_BACK);
-   glReadPixels(0, 0, outputwidth, outputheight, GL_RGBA, GL_UNSIGNED_BYTE, buf);
-   #else
-   //memcpy(buf, dispbuffer, totalsize);
-   #endif
-   //YuiSwapBuffers();
+   totalsize=outputwidth * outputheight * sizeof(u32);
 
    ywrite(&check, (void *)&outputwidth, sizeof(outputwidth), 1, fp);
    ywrite(&check, (void *)&outputheight, sizeof(outputheight), 1, fp);
 
-   ywrite(&check, (void *)buf, totalsize, 1, fp);
+   if (totalsize != 0)
+      ywrite(&check, (void *)buf, totalsize, 1, fp);
 
-   movieposition=ftell(fp);
-   //write the movie to the end of the savestate
-   SaveMovieInState(fp, check);
+   // A position of 0 tells the loader there is no movie block
+   movieposition = 0;
+   if (flags & YAB_STATE_MOVIE)
+   {
+      movieposition=ftell(fp);
+      //write the movie to the end of the savestate
+      SaveMovieInState(fp, check);
+   }
 
    i += StateFinishHeader(fp, offset);
 
@@ -1767,24 +2018,43 @@ int YabSaveStateStream(FILE *fp)
 
    free(buf);
 
-   OSDPushMessage(OSDMSG_STATUS, 150, "STATE SAVED");
+   if (!(flags & YAB_STATE_QUIET))
+      OSDPushMessage(OSDMSG_STATUS, 150, "STATE SAVED");
    return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
 int YabLoadStateBuffer(const void * buffer, size_t size)
+{
+   return YabLoadStateBufferEx(buffer, size, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabLoadStateBufferEx(const void * buffer, size_t size, int flags)
 {
    FILE * fp;
    int status;
-
-   fp = tmpfile();
+#ifdef STATE_MEM_STREAM
+   StateMem_struct mem;
+
+   memset(&mem, 0, sizeof(mem));
+   mem.buffer = (u8 *)buffer;
+   mem.capacity = size;
+   mem.size = size;
+   if ((fp = StateMemOpen(&mem, "rb")) == NULL)
+      return -1;
+#else
+   if ((fp = tmpfile()) == NULL)
+      return -1;
    fwrite(buffer, 1, size, fp);
 
    fseek(fp, 0, SEEK_SET);
+#endif
 
    ScspLockThread();
-   status = YabLoadStateStream(fp);
+   status = YabLoadStateStreamEx(fp, flags);
    ScspUnLockThread();
 
    fclose(fp);
@@ -1792,25 +2062,163 @@ int YabLoadStateBuffer(const void * buffer, size_t size)
    return status;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Incremental states
+//
+// A delta holds the pages of a serialized state that differ from a base
+// state. Work RAM, VDP and sound RAM sit at fixed offsets of the state, so
+// a frame usually touches a handful of pages out of ~1300. The header
+// names its base by size and Adler-32, a delta is only ever applied to the
+// state it was made from.
+//
+// Pages are found by comparing both states rather than by hooking the
+// memory handlers: DMA, the dynarec, the 68k and the VDP caches all write
+// through raw pointers, and a comparison at memory bandwidth costs less
+// than a check on every store.
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+   char id[3];
+   u8 endian;
+   u32 version;
+   u32 size;
+   u32 basesize;
+   u32 baseadler;
+   u32 count;
+} StateDeltaHeader_struct;
+
+//////////////////////////////////////////////////////////////////////////////
+
+size_t YabStateDeltaBound(size_t size)
+{
+   size_t pages = (size + YAB_STATE_PAGE_SIZE - 1) / YAB_STATE_PAGE_SIZE;
+   return sizeof(StateDeltaHeader_struct) + pages * (sizeof(u32) + YAB_STATE_PAGE_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabStateDeltaCreate(const void * base, size_t basesize, const void * state, size_t size, void * delta, size_t capacity, size_t * deltasize)
+{
+   const u8 *b = (const u8 *)base;
+   const u8 *s = (const u8 *)state;
+   u8 *out = (u8 *)delta;
+   StateDeltaHeader_struct header;
+   size_t pos = sizeof(header);
+   uLong adler = adler32(0L, Z_NULL, 0);
+   u32 page;
+   u32 pages = (u32)((size + YAB_STATE_PAGE_SIZE - 1) / YAB_STATE_PAGE_SIZE);
+   u32 basepages = (u32)((basesize + YAB_STATE_PAGE_SIZE - 1) / YAB_STATE_PAGE_SIZE);
+
+   if (delta == NULL || capacity < sizeof(header))
+      return -1;
+
+   memcpy(header.id, "YSD", 3);
+#ifdef WORDS_BIGENDIAN
+   header.endian = 0x00;
+#else
+   header.endian = 0x01;
+#endif
+   header.version = 1;
+   header.size = (u32)size;
+   header.basesize = (u32)basesize;
+   header.count = 0;
+
+   for (page = 0; page < pages || page < basepages; page++)
+   {
+      size_t offset = (size_t)page * YAB_STATE_PAGE_SIZE;
+      size_t length = YAB_STATE_PAGE_SIZE;
+      size_t baselength = YAB_STATE_PAGE_SIZE;
+
+      if (offset + length > size)
+         length = offset < size ? size - offset : 0;
+      if (offset + baselength > basesize)
+         baselength = offset < basesize ? basesize - offset : 0;
+
+      if (baselength != 0)
+         adler = adler32(adler, b + offset, (uInt)baselength);
+
+      if (length == 0)
+         continue;
+      if (length == baselength && memcmp(s + offset, b + offset, length) == 0)
+         continue;
+
+      if (pos + sizeof(u32) + length > capacity)
+         return -1;
+      memcpy(out + pos, &page, sizeof(u32));
+      memcpy(out + pos + sizeof(u32), s + offset, length);
+      pos += sizeof(u32) + length;
+      header.count++;
+   }
+
+   header.baseadler = (u32)adler;
+   memcpy(out, &header, sizeof(header));
+   if (deltasize != NULL)
+      *deltasize = pos;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabStateDeltaApply(void * state, size_t capacity, size_t basesize, const void * delta, size_t deltasize, size_t * size)
+{
+   u8 *s = (u8 *)state;
+   const u8 *in = (const u8 *)delta;
+   StateDeltaHeader_struct header;
+   size_t pos = sizeof(header);
+   u32 i;
+
+   if (deltasize < sizeof(header))
+      return -2;
+   memcpy(&header, in, sizeof(header));
+   if (strncmp(header.id, "YSD", 3) != 0 || header.version != 1)
+      return -2;
+   if (header.basesize != basesize || header.size > capacity)
+      return -3;
+   if (adler32(adler32(0L, Z_NULL, 0), s, (uInt)basesize) != header.baseadler)
+      return -3;
+
+   for (i = 0; i < header.count; i++)
+   {
+      u32 page;
+      size_t offset;
+      size_t length;
+
+      if (pos + sizeof(u32) > deltasize)
+         return -2;
+      memcpy(&page, in + pos, sizeof(u32));
+      offset = (size_t)page * YAB_STATE_PAGE_SIZE;
+      if (offset >= header.size)
+         return -2;
+      length = header.size - offset < YAB_STATE_PAGE_SIZE ? header.size - offset : YAB_STATE_PAGE_SIZE;
+      if (pos + sizeof(u32) + length > deltasize)
+         return -2;
+      memcpy(s + offset, in + pos + sizeof(u32), length);
+      pos += sizeof(u32) + length;
+   }
+
+   if (size != NULL)
+      *size = header.size;
+   return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 int YabLoadState(const char *filename)
 {
-   FILE *fp;
+   void *buffer;
+   size_t size;
    int status;
 
    filename = MakeMovieStateName(filename);
    if (!filename)
       return -1;
 
-   if ((fp = fopen(filename, "rb")) == NULL)
+   if (StateFileRead(filename, &buffer, &size) != 0)
       return -1;
 
-   ScspLockThread();
-   status = YabLoadStateStream(fp);
-   ScspUnLockThread();
-
-   fclose(fp);
+   status = YabLoadStateBuffer(buffer, size);
+   free(buffer);
 
    return status;
 }
@@ -1818,6 +2226,13 @@ int YabLoadState(const char *filename)
 //////////////////////////////////////////////////////////////////////////////
 
 int YabLoadStateStream(FILE *fp)
+{
+   return YabLoadStateStreamEx(fp, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabLoadStateStreamEx(FILE *fp, int flags)
 {
    char id[3];
    u8 endian;
@@ -1997,37 +2412,42 @@ int YabLoadStateStream(FILE *fp)
 
    totalsize=outputwidth * outputheight * sizeof(u32);
 
-   if ((buf = (u8 *)malloc(totalsize)) == NULL)
-   {
-      return -2;
-   }
+   if (totalsize != 0) {
+      if ((buf = (u8 *)malloc(totalsize)) == NULL)
+      {
+         return -2;
+      }
 
-   yread(&check, (void *)buf, totalsize, 1, fp);
+      yread(&check, (void *)buf, totalsize, 1, fp);
 
-   YuiSwapBuffers();
+      YuiSwapBuffers();
 
    #ifdef USE_OPENGL
-   if(VIDCore->id == VIDCORE_SOFT)
-     glRasterPos2i(0, outputheight);
-   if(VIDCore->id == VIDCORE_OGL)
-	 glRasterPos2i(0, outputheight/2);
+      if(VIDCore->id == VIDCORE_SOFT)
+        glRasterPos2i(0, outputheight);
+      if(VIDCore->id == VIDCORE_OGL)
+        glRasterPos2i(0, outputheight/2);
    #endif
 
-   VIDCore->GetGlSize(&curroutputwidth, &curroutputheight);
+      VIDCore->GetGlSize(&curroutputwidth, &curroutputheight);
    #ifdef USE_OPENGL
-   glPixelZoom((float)curroutputwidth / (float)outputwidth, ((float)curroutputheight / (float)outputheight));
-   glDrawPixels(outputwidth, outputheight, GL_RGBA, GL_UNSIGNED_BYTE, buf);
+      glPixelZoom((float)curroutputwidth / (float)outputwidth, ((float)curroutputheight / (float)outputheight));
+      glDrawPixels(outputwidth, outputheight, GL_RGBA, GL_UNSIGNED_BYTE, buf);
    #endif
-   YuiSwapBuffers();
-   free(buf);
+      YuiSwapBuffers();
+      free(buf);
+   }
 
-   fseek(fp, movieposition, SEEK_SET);
-   MovieReadState(fp);
+   if (movieposition != 0) {
+      fseek(fp, movieposition, SEEK_SET);
+      MovieReadState(fp);
+   }
    }
 
    ScspUnMuteAudio(SCSP_MUTE_SYSTEM);
 
-   OSDPushMessage(OSDMSG_STATUS, 150, "STATE LOADED");
+   if (!(flags & YAB_STATE_QUIET))
+      OSDPushMessage(OSDMSG_STATUS, 150, "STATE LOADED");
    return 0;
 }
 
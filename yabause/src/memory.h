@@ -442,10 +442,29 @@ extern "C" {
   int YabLoadState(const char *filename);
   int YabSaveStateSlot(const char *dirpath, u8 slot);
   int YabLoadStateSlot(const char *dirpath, u8 slot);
+  // YabSaveStateStreamEx/YabLoadStateStreamEx flags
+  #define YAB_STATE_THUMBNAIL 0x01 // Store the last displayed frame
+  #define YAB_STATE_MOVIE     0x02 // Append the movie being recorded or played
+  #define YAB_STATE_QUIET     0x04 // No on-screen message
+
   int YabSaveStateStream(FILE *stream);
+  int YabSaveStateStreamEx(FILE *stream, int flags);
   int YabLoadStateStream(FILE *stream);
+  int YabLoadStateStreamEx(FILE *stream, int flags);
   int YabSaveStateBuffer(void **buffer, size_t *size);
+  int YabSaveStateBufferEx(void **buffer, size_t *size, int flags);
+  size_t YabSaveStateSize(void);
+  int YabSaveStateToBuffer(void *buffer, size_t capacity, size_t *size);
+  int YabSaveStateToBufferEx(void *buffer, size_t capacity, size_t *size, int flags);
   int YabLoadStateBuffer(const void *buffer, size_t size);
+  int YabLoadStateBufferEx(const void *buffer, size_t size, int flags);
+
+  // Incremental states, the pages of a state that differ from a base state.
+  // YabStateDeltaApply turns the base in state into the new state in place.
+  #define YAB_STATE_PAGE_SIZE 0x1000
+  size_t YabStateDeltaBound(size_t size);
+  int YabStateDeltaCreate(const void *base, size_t basesize, const void *state, size_t size, void *delta, size_t capacity, size_t *deltasize);
+  int YabStateDeltaApply(void *state, size_t capacity, size_t basesize, const void *delta, size_t deltasize, size_t *size);
 
   int BackupInit(const char* path, int extended);
   void BackupFlush();
@@ -154,11 +154,31 @@ static void IncrementLagAndFrameCounter(void)
 
 int framelength=16;
 
+static MovieInputProvider_func MovieInputProvider = NULL;
+
+MovieInputProvider_func MovieSetInputProvider(MovieInputProvider_func provider) {
+	MovieInputProvider_func previous = MovieInputProvider;
+	MovieInputProvider = provider;
+	return previous;
+}
+
+MovieInputProvider_func MovieGetInputProvider(void) {
+	return MovieInputProvider;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void DoMovie(void) {
 
 	int x;
    size_t num_read = 0;
 
+	//Someone else owns the controller data (netplay)
+	if (MovieInputProvider != NULL) {
+		MovieInputProvider();
+		return;
+	}
+
 	if (Movie.Status == 0)
 		return;
 
@@ -395,6 +415,24 @@ void SaveMovieInState(FILE* fp, IOCheck_struct check) {
 
 //////////////////////////////////////////////////////////////////////////////
 
+// Bytes SaveMovieInState appends to a state
+int MovieStateSize(void) {
+
+	long fpos;
+	long size;
+
+	if(Movie.Status != Recording && Movie.Status != Playback)
+		return 0;
+
+	fpos = ftell(Movie.fp);
+	fseek(Movie.fp, 0, SEEK_END);
+	size = ftell(Movie.fp);
+	fseek(Movie.fp, fpos, SEEK_SET);
+	return 4 + (int)size;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void MovieReadState(FILE* fp) {
 
 	ReadMovieInState(fp);
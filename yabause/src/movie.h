@@ -31,6 +31,14 @@
 
 void DoMovie(void);
 
+typedef void (*MovieInputProvider_func)(void);
+
+// Fill PORTDATA1/PORTDATA2 from provider at the start of every frame instead
+// of recording or playing back a movie (NULL gives them back to the movie).
+// Returns the provider it replaces.
+MovieInputProvider_func MovieSetInputProvider(MovieInputProvider_func provider);
+MovieInputProvider_func MovieGetInputProvider(void);
+
 struct MovieStruct
 {
 	int Status;
@@ -55,6 +63,7 @@ struct MovieBufferStruct ReadMovieIntoABuffer(FILE* fp);
 void MovieLoadState(void);
 
 void SaveMovieInState(FILE* fp, IOCheck_struct check);
+int MovieStateSize(void);
 void ReadMovieInState(FILE* fp); 
 
 void TestWrite(struct MovieBufferStruct tempbuffer);
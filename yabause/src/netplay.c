@@ -0,0 +1,627 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file netplay.c
+    \brief Rollback netplay.
+
+    Each peer emulates the whole machine and only the controller data goes
+    over the wire, the same 8 bytes per port and per frame a movie records.
+    The session takes the place of the movie in DoMovie and feeds the
+    inputs of the frame being emulated to both ports.
+
+    The local input is sent as soon as it is read, delay frames ahead. The
+    peer's input is predicted until it arrives by repeating its last known
+    one. A state is kept in memory at the start of each of the last
+    NETPLAY_MAX_ROLLBACK + 1 frames; when an input arrives that differs
+    from what was predicted, the state of that frame is loaded back and the
+    frames since are emulated again with the right input, without drawing,
+    pacing or sound. A peer that is more than NETPLAY_MAX_ROLLBACK frames
+    ahead of the other's inputs waits for them.
+
+    Packets carry every local input the peer has not acknowledged yet, so a
+    lost packet is covered by the next one.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "netplay.h"
+#include "movie.h"
+#include "memory.h"
+#include "peripheral.h"
+#include "scsp.h"
+#include "sock.h"
+#include "threads.h"
+#include "audit.h"
+#include "error.h"
+#include "yabause.h"
+
+#define NETPLAY_STATES        (NETPLAY_MAX_ROLLBACK + 1)
+#define NETPLAY_INPUT_RING    128
+#define NETPLAY_INPUT_SIZE    8
+#define NETPLAY_PACKET_INPUTS 32
+#define NETPLAY_HEADER_SIZE   16
+#define NETPLAY_PACKET_MAX    (NETPLAY_HEADER_SIZE + NETPLAY_PACKET_INPUTS * NETPLAY_INPUT_SIZE)
+#define NETPLAY_SYNC_INTERVAL 30
+
+static struct
+{
+   NetplayTransport_struct transport;
+   int active;
+   int local;        // 0 when playing on port 1, 1 on port 2
+   int delay;
+
+   u8 input[NETPLAY_INPUT_RING][2][NETPLAY_INPUT_SIZE];
+   u8 neutral[NETPLAY_INPUT_SIZE];
+   u8 live[2][NETPLAY_INPUT_SIZE];
+   u32 frame;        // Next frame to emulate
+   u32 current;      // Frame being emulated
+   u32 localnext;    // First frame without a local input
+   u32 remotenext;   // First frame without a confirmed remote input
+   u32 rollback;     // Oldest mispredicted frame
+   int mispredicted;
+
+   u32 peerframe;
+   u32 peerack;
+   int peeradvantage;
+   u32 syncframe;
+
+   u8 *state[NETPLAY_STATES];
+   size_t statesize[NETPLAY_STATES];
+   size_t capacity;
+
+   NetplayStats_struct stats;
+} np;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayWrite32(u8 *p, u32 val)
+{
+   p[0] = val & 0xFF;
+   p[1] = (val >> 8) & 0xFF;
+   p[2] = (val >> 16) & 0xFF;
+   p[3] = val >> 24;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static u32 NetplayRead32(const u8 *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Loopback transport
+//////////////////////////////////////////////////////////////////////////////
+
+#define NETPLAY_LOOPBACK_SLOTS 64
+
+typedef struct
+{
+   u8 data[NETPLAY_LOOPBACK_SLOTS][NETPLAY_PACKET_MAX];
+   int size[NETPLAY_LOOPBACK_SLOTS];
+   int first;
+   int count;
+} NetplayQueue_struct;
+
+typedef struct
+{
+   NetplayQueue_struct queue[2];
+   YabMutex *mutex;
+   int refs;
+} NetplayLink_struct;
+
+typedef struct
+{
+   NetplayLink_struct *link;
+   int side;
+} NetplayLoopback_struct;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayLoopbackSend(void *data, const void *buf, int len)
+{
+   NetplayLoopback_struct *end = (NetplayLoopback_struct *)data;
+   NetplayQueue_struct *queue = &end->link->queue[!end->side];
+
+   if (len > NETPLAY_PACKET_MAX)
+      return -1;
+
+   YabThreadLock(end->link->mutex);
+   // Full, dropped like a datagram would be
+   if (queue->count < NETPLAY_LOOPBACK_SLOTS)
+   {
+      int slot = (queue->first + queue->count) % NETPLAY_LOOPBACK_SLOTS;
+      memcpy(queue->data[slot], buf, len);
+      queue->size[slot] = len;
+      queue->count++;
+   }
+   YabThreadUnLock(end->link->mutex);
+   return len;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayLoopbackReceive(void *data, void *buf, int len)
+{
+   NetplayLoopback_struct *end = (NetplayLoopback_struct *)data;
+   NetplayQueue_struct *queue = &end->link->queue[end->side];
+   int size = 0;
+
+   YabThreadLock(end->link->mutex);
+   if (queue->count > 0)
+   {
+      size = queue->size[queue->first];
+      if (size > len)
+         size = len;
+      memcpy(buf, queue->data[queue->first], size);
+      queue->first = (queue->first + 1) % NETPLAY_LOOPBACK_SLOTS;
+      queue->count--;
+   }
+   YabThreadUnLock(end->link->mutex);
+   return size;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayLoopbackClose(void *data)
+{
+   NetplayLoopback_struct *end = (NetplayLoopback_struct *)data;
+   NetplayLink_struct *link = end->link;
+   int refs;
+
+   YabThreadLock(link->mutex);
+   refs = --link->refs;
+   YabThreadUnLock(link->mutex);
+
+   if (refs == 0)
+   {
+      YabThreadFreeMutex(link->mutex);
+      free(link);
+   }
+   free(end);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int NetplayLoopbackPair(NetplayTransport_struct *a, NetplayTransport_struct *b)
+{
+   NetplayLink_struct *link;
+   NetplayLoopback_struct *end[2];
+   NetplayTransport_struct *transport[2];
+   int i;
+
+   link = (NetplayLink_struct *)calloc(1, sizeof(NetplayLink_struct));
+   end[0] = (NetplayLoopback_struct *)calloc(1, sizeof(NetplayLoopback_struct));
+   end[1] = (NetplayLoopback_struct *)calloc(1, sizeof(NetplayLoopback_struct));
+   if (link == NULL || end[0] == NULL || end[1] == NULL)
+   {
+      free(link);
+      free(end[0]);
+      free(end[1]);
+      return -1;
+   }
+
+   link->mutex = YabThreadCreateMutex();
+   link->refs = 2;
+   transport[0] = a;
+   transport[1] = b;
+   for (i = 0; i < 2; i++)
+   {
+      end[i]->link = link;
+      end[i]->side = i;
+      transport[i]->Send = NetplayLoopbackSend;
+      transport[i]->Receive = NetplayLoopbackReceive;
+      transport[i]->Close = NetplayLoopbackClose;
+      transport[i]->data = end[i];
+   }
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// UDP transport
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayUdpSend(void *data, const void *buf, int len)
+{
+   return YabSockSend(*(YabSock *)data, buf, len, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayUdpReceive(void *data, void *buf, int len)
+{
+   YabSock sock = *(YabSock *)data;
+   int ret;
+
+   if (YabSockSelect(sock, 1, 0) != 0 || !YabSockIsReadSet(sock))
+      return 0;
+   // Refused while the peer is not listening yet, try again later
+   if ((ret = YabSockReceive(sock, buf, len, 0)) < 0)
+      return 0;
+   return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayUdpClose(void *data)
+{
+   YabSockCloseSocket(*(YabSock *)data);
+   YabSockDeInit();
+   free(data);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int NetplayUdpTransport(NetplayTransport_struct *transport, int localport, const char *ip, int port)
+{
+   YabSock *sock;
+
+   if ((sock = (YabSock *)malloc(sizeof(YabSock))) == NULL)
+      return -1;
+
+   YabSockInit();
+   if (YabSockUdpSocket(localport, ip, port, sock) != 0)
+   {
+      YabSockDeInit();
+      free(sock);
+      return -1;
+   }
+
+   transport->Send = NetplayUdpSend;
+   transport->Receive = NetplayUdpReceive;
+   transport->Close = NetplayUdpClose;
+   transport->data = sock;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Session
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayAlloc(size_t size)
+{
+   size_t capacity = size + (size >> 3);
+   int i;
+
+   for (i = 0; i < NETPLAY_STATES; i++)
+   {
+      u8 *state = (u8 *)realloc(np.state[i], capacity);
+      if (state == NULL)
+         return -1;
+      np.state[i] = state;
+   }
+   np.capacity = capacity;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplaySave(u32 frame)
+{
+   int slot = frame % NETPLAY_STATES;
+   size_t size;
+
+   if (YabSaveStateToBufferEx(np.state[slot], np.capacity, &size, YAB_STATE_QUIET) != 0)
+   {
+      // The state outgrew the buffers
+      if (NetplayAlloc(YabSaveStateSize()) != 0 ||
+          YabSaveStateToBufferEx(np.state[slot], np.capacity, &size, YAB_STATE_QUIET) != 0)
+         return -1;
+   }
+   np.statesize[slot] = size;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayInput(void)
+{
+   u8 (*input)[NETPLAY_INPUT_SIZE] = np.input[np.current % NETPLAY_INPUT_RING];
+
+   // Not received yet, the peer most likely still holds the same buttons
+   if ((int)(np.current - np.remotenext) >= 0)
+   {
+      if (np.remotenext > 0)
+         memcpy(input[!np.local], np.input[(np.remotenext - 1) % NETPLAY_INPUT_RING][!np.local], NETPLAY_INPUT_SIZE);
+      else
+         memcpy(input[!np.local], np.neutral, NETPLAY_INPUT_SIZE);
+   }
+
+   memcpy(PORTDATA1.data, input[0], NETPLAY_INPUT_SIZE);
+   memcpy(PORTDATA2.data, input[1], NETPLAY_INPUT_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayParse(const u8 *packet, int len)
+{
+   int count;
+   int i;
+   u32 frame;
+   u32 ack;
+   u32 start;
+
+   if (len < NETPLAY_HEADER_SIZE || packet[0] != 'N' || packet[1] != 'P')
+      return;
+   count = packet[2];
+   if (len < NETPLAY_HEADER_SIZE + count * NETPLAY_INPUT_SIZE)
+      return;
+
+   frame = NetplayRead32(packet + 4);
+   ack = NetplayRead32(packet + 8);
+   start = NetplayRead32(packet + 12);
+
+   // Datagrams can come out of order, only keep the newest news
+   if ((int)(frame - np.peerframe) >= 0)
+   {
+      np.peerframe = frame;
+      np.peeradvantage = (s8)packet[3];
+   }
+   if ((int)(ack - np.peerack) > 0)
+      np.peerack = ack;
+
+   for (i = 0; i < count; i++)
+   {
+      const u8 *data = packet + NETPLAY_HEADER_SIZE + i * NETPLAY_INPUT_SIZE;
+      u32 f = start + i;
+      u8 *input;
+
+      if ((int)(f - np.remotenext) < 0)
+         continue;
+      if (f != np.remotenext || (int)(f - np.frame) >= NETPLAY_INPUT_RING / 2)
+         break;
+
+      input = np.input[f % NETPLAY_INPUT_RING][!np.local];
+      if ((int)(f - np.frame) < 0 && memcmp(input, data, NETPLAY_INPUT_SIZE) != 0 &&
+          (!np.mispredicted || (int)(f - np.rollback) < 0))
+      {
+         np.rollback = f;
+         np.mispredicted = 1;
+      }
+      memcpy(input, data, NETPLAY_INPUT_SIZE);
+      np.remotenext++;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplayPoll(void)
+{
+   u8 packet[NETPLAY_PACKET_MAX];
+   int len;
+
+   while ((len = np.transport.Receive(np.transport.data, packet, sizeof(packet))) > 0)
+      NetplayParse(packet, len);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void NetplaySend(void)
+{
+   u8 packet[NETPLAY_PACKET_MAX];
+   int advantage = (int)(np.frame - np.peerframe);
+   int count = (int)(np.localnext - np.peerack);
+   int i;
+
+   if (count < 0)
+      count = 0;
+   if (count > NETPLAY_PACKET_INPUTS)
+      count = NETPLAY_PACKET_INPUTS;
+   if (advantage > 127)
+      advantage = 127;
+   if (advantage < -127)
+      advantage = -127;
+
+   packet[0] = 'N';
+   packet[1] = 'P';
+   packet[2] = (u8)count;
+   packet[3] = (u8)(s8)advantage;
+   NetplayWrite32(packet + 4, np.frame);
+   NetplayWrite32(packet + 8, np.remotenext);
+   NetplayWrite32(packet + 12, np.peerack);
+   for (i = 0; i < count; i++)
+      memcpy(packet + NETPLAY_HEADER_SIZE + i * NETPLAY_INPUT_SIZE,
+             np.input[(np.peerack + i) % NETPLAY_INPUT_RING][np.local], NETPLAY_INPUT_SIZE);
+
+   np.transport.Send(np.transport.data, packet, NETPLAY_HEADER_SIZE + count * NETPLAY_INPUT_SIZE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayRollback(void)
+{
+   u64 ticks = YabauseGetTicks();
+   u32 from = np.rollback;
+   int skip = yabsys.skipRender;
+   int slot = from % NETPLAY_STATES;
+   u32 f;
+
+   np.mispredicted = 0;
+   if (YabLoadStateBufferEx(np.state[slot], np.statesize[slot], YAB_STATE_QUIET) != 0)
+      return -1;
+
+   // Catch up to where we were without showing any of the frames, the
+   // caller emulates and shows the current one right after
+   yabsys.skipRender = 1;
+   yabsys.resimulating = 1;
+   ScspDiscardAudio(1);
+   for (f = from; f != np.frame; f++)
+   {
+      if (f != from)
+         NetplaySave(f);
+      np.current = f;
+      YabauseEmulate();
+   }
+   yabsys.skipRender = skip;
+   yabsys.resimulating = 0;
+   ScspDiscardAudio(0);
+
+   np.stats.rollbacks++;
+   np.stats.resimulated += np.frame - from;
+   if (np.frame - from > np.stats.maxdepth)
+      np.stats.maxdepth = np.frame - from;
+   np.stats.lastusec = (u32)((YabauseGetTicks() - ticks) * 1000000 / yabsys.tickfreq);
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int NetplayWait(u32 usec)
+{
+   NetplaySend();
+   YabThreadUSleep(usec);
+   // Don't make up for the time spent waiting
+   resetSyncVideo();
+   np.stats.stalls++;
+   return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int NetplayInit(NetplayTransport_struct *transport, int port, int delay)
+{
+   PortData_struct *local;
+   PortData_struct *remote;
+   size_t size;
+   int i;
+
+   NetplayDeInit();
+   if (transport == NULL || (port != 1 && port != 2))
+      return -1;
+   if (delay < 0)
+      delay = 0;
+   if (delay > NETPLAY_MAX_DELAY)
+      delay = NETPLAY_MAX_DELAY;
+
+   // The audit plays frames again behind the rollbacks' back
+   if (AuditIsEnabled())
+   {
+      YabSetError(YAB_ERR_CANNOTINIT, "Netplay (the determinism audit is running)");
+      return -1;
+   }
+
+   if ((size = YabSaveStateSize()) == 0 || NetplayAlloc(size) != 0)
+   {
+      NetplayDeInit();
+      YabSetError(YAB_ERR_CANNOTINIT, "Netplay");
+      return -1;
+   }
+
+   np.transport = *transport;
+   np.local = port - 1;
+   np.delay = delay;
+   local = np.local ? &PORTDATA2 : &PORTDATA1;
+   remote = np.local ? &PORTDATA1 : &PORTDATA2;
+
+   // The first frames are played with what is held now
+   for (i = 0; i < delay; i++)
+      memcpy(np.input[i][np.local], local->data, NETPLAY_INPUT_SIZE);
+   np.localnext = delay;
+   memcpy(np.neutral, remote->data, NETPLAY_INPUT_SIZE);
+
+   np.active = 1;
+   MovieSetInputProvider(NetplayInput);
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void NetplayDeInit(void)
+{
+   int i;
+
+   if (np.active)
+   {
+      MovieSetInputProvider(NULL);
+      np.transport.Close(np.transport.data);
+   }
+   for (i = 0; i < NETPLAY_STATES; i++)
+      free(np.state[i]);
+   memset(&np, 0, sizeof(np));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int NetplayIsActive(void)
+{
+   return np.active;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int NetplayExec(void)
+{
+   int ret = 0;
+
+   if (!np.active)
+      return YabauseExec();
+
+   // What the frontend has set, the frames below overwrite the ports
+   memcpy(np.live[0], PORTDATA1.data, NETPLAY_INPUT_SIZE);
+   memcpy(np.live[1], PORTDATA2.data, NETPLAY_INPUT_SIZE);
+
+   NetplayPoll();
+   if (np.mispredicted && NetplayRollback() != 0)
+   {
+      YabSetError(YAB_ERR_OTHER, "Netplay rollback failed");
+      memcpy(PORTDATA1.data, np.live[0], NETPLAY_INPUT_SIZE);
+      memcpy(PORTDATA2.data, np.live[1], NETPLAY_INPUT_SIZE);
+      NetplayDeInit();
+      return -1;
+   }
+
+   // A rollback brings the emulation back to np.frame, which is emulated
+   // below in the same call, so a misprediction costs no frame
+   if ((int)(np.frame - np.remotenext) >= NETPLAY_MAX_ROLLBACK ||
+       (int)(np.localnext - np.peerack) >= NETPLAY_PACKET_INPUTS)
+   {
+      // Too far ahead of the peer
+      ret = NetplayWait(1000);
+   }
+   else if (np.remotenext > 0 && (int)(np.frame - np.syncframe) >= 0 &&
+            (int)(np.frame - np.peerframe) - np.peeradvantage > 2)
+   {
+      // Running faster than the peer, give it a frame to catch up before
+      // the distance turns into rollbacks
+      np.syncframe = np.frame + NETPLAY_SYNC_INTERVAL;
+      ret = NetplayWait(1000000 / (yabsys.IsPal ? 50 : 60));
+   }
+   else
+   {
+      memcpy(np.input[np.localnext % NETPLAY_INPUT_RING][np.local], np.live[np.local], NETPLAY_INPUT_SIZE);
+      np.localnext++;
+      NetplaySend();
+
+      NetplaySave(np.frame);
+      np.current = np.frame;
+      YabauseExec();
+      np.frame++;
+   }
+
+   memcpy(PORTDATA1.data, np.live[0], NETPLAY_INPUT_SIZE);
+   memcpy(PORTDATA2.data, np.live[1], NETPLAY_INPUT_SIZE);
+   return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void NetplayGetStats(NetplayStats_struct *stats)
+{
+   *stats = np.stats;
+   stats->frame = np.frame;
+   stats->confirmed = (int)(np.remotenext - np.frame) < 0 ? np.remotenext : np.frame;
+}
@@ -0,0 +1,68 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "core.h"
+
+// Frames that can be predicted, and resimulated, ahead of the peer
+#define NETPLAY_MAX_ROLLBACK 7
+#define NETPLAY_MAX_DELAY    8
+
+typedef struct
+{
+   // Send one datagram. Returns the bytes sent, -1 on error.
+   int (*Send)(void *data, const void *buf, int len);
+   // Receive one datagram without blocking. Returns its size, 0 when none
+   // is waiting, -1 on error.
+   int (*Receive)(void *data, void *buf, int len);
+   void (*Close)(void *data);
+   void *data;
+} NetplayTransport_struct;
+
+typedef struct
+{
+   u32 frame;        // Frames emulated
+   u32 confirmed;    // Frames whose inputs from both sides are known
+   u32 rollbacks;
+   u32 resimulated;  // Frames emulated again after a misprediction
+   u32 maxdepth;     // Deepest rollback
+   u32 stalls;       // Calls that waited on the peer
+   u32 lastusec;     // Time taken by the last rollback
+} NetplayStats_struct;
+
+// Two transports connected to each other within the process
+int NetplayLoopbackPair(NetplayTransport_struct *a, NetplayTransport_struct *b);
+// Datagrams to ip:port, received on localport
+int NetplayUdpTransport(NetplayTransport_struct *transport, int localport, const char *ip, int port);
+
+// Start a session, playing on port 1 or 2 with delay frames of input
+// delay. Both peers must start from the same state, booted with
+// yinit.clocksync and the same basetime so the RTC does not follow the
+// host clock. The session owns the transport and closes it on NetplayDeInit.
+int NetplayInit(NetplayTransport_struct *transport, int port, int delay);
+void NetplayDeInit(void);
+int NetplayIsActive(void);
+
+// Replaces YabauseExec while a session is active. Returns 1 when the frame
+// was held back waiting for the peer, 0 once it has been emulated.
+int NetplayExec(void);
+
+void NetplayGetStats(NetplayStats_struct *stats);
+
+#endif
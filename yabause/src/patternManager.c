@@ -1,200 +1,462 @@
-// C implementation of Heap Sort
+// VDP1 decoded sprite cache
+//
+// Sprites are keyed on their full source content (character data plus
+// the colour lookup table for LUT sprites) and the command/register bits
+// the decoder depends on. A 64 bit hash selects the bucket, the stored
+// source copy is compared on lookup so a hash collision can never return
+// the wrong texture. The table is split in shards, each with its own lock
+// and LRU list, and entries are evicted once the byte budget is reached.
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "patternManager.h"
+#include "yui.h"
 
 //#define VDP1_CACHE_STAT
 
-#ifdef VDP1_CACHE_STAT
-static long long nbReuse = 0;
-static long long nbElem = 0;
-static long long nbColid = 0;
-#endif
+#define PATTERN_SHARD_BITS 4
+#define PATTERN_SHARDS (1 << PATTERN_SHARD_BITS)
+#define PATTERN_BUCKETS 1024
+#define PATTERN_LUT_SIZE 32
+#define PATTERN_RAM_MASK 0x7FFFF
 
-static Pattern** patternCache;
-static u8* patternUse;
+typedef struct {
+  YabMutex *mtx;
+  Pattern *bucket[PATTERN_BUCKETS];
+  Pattern *lruHead;
+  Pattern *lruTail;
+  u32 bytes;
+  u32 budget;
+  u64 entries;
+  u64 hit;
+  u64 miss;
+  u64 evict;
+} PatternShard;
 
-YabMutex *cacheMutex;
+static PatternShard *patternShard = NULL;
+static u32 patternBudget = 0;
 
-static void deleteCachePattern(Pattern** pat) {
-	if ((*pat) == NULL) return;
-	(*pat)->managed = 0;
-	if ((*pat)->pix != NULL) free((*pat)->pix);
-        (*pat)->pix = NULL;
-	free(*pat);
-        *pat = NULL;
+//////////////////////////////////////////////////////////////////////////////
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static INLINE u64 rotl64(u64 x, int r) {
+  return (x << r) | (x >> (64 - r));
 }
 
-static u16 djb2(unsigned char *str, int len)
-{
-  u16 hash = 5381;
-  u16 c;
-  int i;
-  unsigned char *tmp = str;
+static INLINE u64 read64(const u8 *p) {
+  u64 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static INLINE u32 read32(const u8 *p) {
+  u32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static INLINE u64 hashRound(u64 acc, u64 input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static INLINE u64 hashMerge(u64 acc, u64 val) {
+  acc ^= hashRound(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
 
-  for (i = 0; i<len; i++) {
-    c = *tmp++;
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+// xxHash64 over a single buffer, chained through seed for split sources
+static u64 patternHash(const u8 *p, u32 len, u64 seed) {
+  const u8 *end = p + len;
+  u64 h;
+
+  if (len >= 32) {
+    const u8 *limit = end - 32;
+    u64 v1 = seed + PRIME64_1 + PRIME64_2;
+    u64 v2 = seed + PRIME64_2;
+    u64 v3 = seed;
+    u64 v4 = seed - PRIME64_1;
+    do {
+      v1 = hashRound(v1, read64(p));
+      v2 = hashRound(v2, read64(p + 8));
+      v3 = hashRound(v3, read64(p + 16));
+      v4 = hashRound(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = hashMerge(h, v1);
+    h = hashMerge(h, v2);
+    h = hashMerge(h, v3);
+    h = hashMerge(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+  h += (u64)len;
+
+  while (p + 8 <= end) {
+    h ^= hashRound(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (u64)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
   }
-  return hash;
+  while (p < end) {
+    h ^= (*p) * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// VDP1 RAM wraps at 512KB, so a source area may come in two pieces
+static u64 hashRam(u8 *ram, u32 addr, u32 size, u64 seed) {
+  u32 first;
+  addr &= PATTERN_RAM_MASK;
+  first = PATTERN_RAM_MASK + 1 - addr;
+  if (size <= first) return patternHash(ram + addr, size, seed);
+  seed = patternHash(ram + addr, first, seed);
+  return patternHash(ram, size - first, seed);
 }
 
-static u16 getHash(u8 *p, int len) {
-  u16 hash;     
-  hash = djb2(p, len);
-  return hash;
+static u64 hashCopy(const u8 *src, u32 addr, u32 size, u64 seed) {
+  u32 first;
+  addr &= PATTERN_RAM_MASK;
+  first = PATTERN_RAM_MASK + 1 - addr;
+  if (size <= first) return patternHash(src, size, seed);
+  seed = patternHash(src, first, seed);
+  return patternHash(src + first, size - first, seed);
 }
 
-static Pattern* popCachePattern(u8 *pixSample, int w, int h) {
-  int id = getHash(pixSample, PIX_SIZE);
-  Pattern *pat = patternCache[id];
-  if ((pat!= NULL) && (memcmp(pat->pixSample, pixSample, PIX_SIZE) == 0) && (pat->width == w) && (pat->height == h)) {
-#ifdef VDP1_CACHE_STAT
-        nbReuse++;
-#endif
-	patternUse[id]++;
-  	return pat;
+static void copyRam(u8 *dst, u8 *ram, u32 addr, u32 size) {
+  u32 first;
+  addr &= PATTERN_RAM_MASK;
+  first = PATTERN_RAM_MASK + 1 - addr;
+  if (size <= first) {
+    memcpy(dst, ram + addr, size);
   } else {
-	return NULL;
-  }
-}
-
-static int addCachePattern(Pattern* pat) {
-        int id = getHash(pat->pixSample, PIX_SIZE);
-	Pattern *collider = patternCache[id];
-#ifdef VDP1_CACHE_STAT
-        nbElem++;
-#endif
-	if ((collider != NULL) && (patternUse[id] > 0)) {
-#ifdef VDP1_CACHE_STAT
-            nbColid++;
-#endif
-            return -1;
-        }
-	if (collider != NULL) {
-#ifdef VDP1_CACHE_STAT
-          nbColid++;
-#endif
-	  deleteCachePattern(&collider);
-	}
-        patternUse[id] = 1;
-	pat->managed = 1;
-	patternCache[id] = pat;
-        return 0;
-}
-
-static Pattern* createCachePattern(u8* pixSample, int w, int h, int offset) {
-	Pattern* new = malloc(sizeof(Pattern));
-        memcpy(new->pixSample, pixSample, PIX_SIZE);
-        new->width = w;
-	new->height = h;
-        new->offset = offset;
-	new->managed = 0;
-	new->pix = (u32*) malloc(h*(offset+w)*sizeof(u32));
-	return new;
-}
-
-Pattern* getPattern(vdp1cmd_struct *cmd, u8* ram, Vdp2 * regs) {
-    int characterWidth = ((cmd->CMDSIZE >> 8) & 0x3F) * 8;
-    int characterHeight = cmd->CMDSIZE & 0xFF;
-    int characterAddress = (cmd->CMDSRCA << 3) & 0x7FFFF;
-    int lutPri = T1ReadWord(ram, (T1ReadByte(ram, characterAddress) >> 4) * 2 + (cmd->CMDCOLR * 8));
-
-    if(characterWidth*characterHeight <= 256) return NULL; //Cache impact is negligible here
-
-    if ((characterWidth == 0) || (characterHeight == 0)) {
-      return NULL;
-    }
+    memcpy(dst, ram + addr, first);
+    memcpy(dst + first, ram, size - first);
+  }
+}
 
-    YabThreadLock(cacheMutex);
-    int param0 = cmd->CMDSRCA << 16 | cmd->CMDCOLR;
-    int param1 = cmd->CMDPMOD << 16 | cmd->CMDCTRL;
-    int param2 = regs->SPCTL << 16 | lutPri;
-    int param3 = regs->CCRSA << 16 | regs->PRISA;
-    u8 pixSample[PIX_SIZE];
+static int compareRam(const u8 *src, u8 *ram, u32 addr, u32 size) {
+  u32 first;
+  addr &= PATTERN_RAM_MASK;
+  first = PATTERN_RAM_MASK + 1 - addr;
+  if (size <= first) return memcmp(src, ram + addr, size);
+  if (memcmp(src, ram + addr, first) != 0) return 1;
+  return memcmp(src + first, ram, size - first);
+}
 
-    for (int i =0; i<SAMPLE; i++) {
-      pixSample[i] =  T1ReadByte(ram, (characterAddress + characterHeight*characterWidth*i/SAMPLE));
-    }
-    memcpy(&pixSample[SAMPLE], &param0, 4);
-    memcpy(&pixSample[SAMPLE+4], &param1, 4);
-    memcpy(&pixSample[SAMPLE+8], &param2, 4);
-    memcpy(&pixSample[SAMPLE+12], &param3, 4);
+static u64 hashParams(const u32 *param) {
+  u64 h = 0;
+  int i;
+  for (i = 0; i < PATTERN_PARAMS; i++)
+    h = (h ^ param[i]) * 0x100000001B3ULL;
+  return h;
+}
+
+static u64 hashKey(PatternKey *key, u8 *ram) {
+  u64 h = hashParams(key->param);
+  h = hashRam(ram, key->srcaddr, key->srcsize, h);
+  if (key->lutaddr != 0xFFFFFFFF)
+    h = hashRam(ram, key->lutaddr, PATTERN_LUT_SIZE, h);
+  return h;
+}
+
+// Same as hashKey, computed over the private copy of the source
+static u64 hashPattern(Pattern *pat, PatternKey *key) {
+  u64 h = hashParams(key->param);
+  h = hashCopy(pat->src, key->srcaddr, key->srcsize, h);
+  if (key->lutaddr != 0xFFFFFFFF)
+    h = hashCopy(pat->src + key->srcsize, key->lutaddr, PATTERN_LUT_SIZE, h);
+  return h;
+}
+
+static int matchKey(Pattern *pat, PatternKey *key, u8 *ram) {
+  u32 lutsize = (key->lutaddr != 0xFFFFFFFF) ? PATTERN_LUT_SIZE : 0;
+  if (pat->hash != key->hash) return 0;
+  if (memcmp(pat->param, key->param, sizeof(pat->param)) != 0) return 0;
+  if ((pat->width != key->width) || (pat->height != key->height)) return 0;
+  if (pat->srcsize != key->srcsize + lutsize) return 0;
+  if (compareRam(pat->src, ram, key->srcaddr, key->srcsize) != 0) return 0;
+  if (lutsize && (compareRam(pat->src + key->srcsize, ram, key->lutaddr, lutsize) != 0)) return 0;
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static INLINE PatternShard *getShard(u64 hash) {
+  return &patternShard[hash >> (64 - PATTERN_SHARD_BITS)];
+}
 
-    Pattern* curPattern = popCachePattern(pixSample, characterWidth, characterHeight);
-    YabThreadUnLock(cacheMutex);
-    return curPattern;
+static INLINE Pattern **getBucket(PatternShard *shard, u64 hash) {
+  return &shard->bucket[hash & (PATTERN_BUCKETS - 1)];
 }
 
-void addPattern(vdp1cmd_struct *cmd, u8* ram, u32 *pix, int offset, Vdp2 * regs) {
-    Pattern* curPattern;
-    int characterWidth = ((cmd->CMDSIZE >> 8) & 0x3F) * 8;
-    int characterHeight = cmd->CMDSIZE & 0xFF;
-    int characterAddress = (cmd->CMDSRCA << 3) & 0x7FFFF;
-    int lutPri = T1ReadWord(ram, (T1ReadByte(ram, characterAddress) >> 4) * 2 + (cmd->CMDCOLR * 8));
+static void lruUnlink(PatternShard *shard, Pattern *pat) {
+  if (pat->lruPrev != NULL) pat->lruPrev->lruNext = pat->lruNext;
+  else shard->lruHead = pat->lruNext;
+  if (pat->lruNext != NULL) pat->lruNext->lruPrev = pat->lruPrev;
+  else shard->lruTail = pat->lruPrev;
+  pat->lruPrev = pat->lruNext = NULL;
+}
 
-    if(characterWidth*characterHeight <= 256) {
-      return; //Cache impact is negligible here
+static void lruPushFront(PatternShard *shard, Pattern *pat) {
+  pat->lruPrev = NULL;
+  pat->lruNext = shard->lruHead;
+  if (shard->lruHead != NULL) shard->lruHead->lruPrev = pat;
+  shard->lruHead = pat;
+  if (shard->lruTail == NULL) shard->lruTail = pat;
+}
+
+static void deleteCachePattern(PatternShard *shard, Pattern *pat) {
+  Pattern **link = getBucket(shard, pat->hash);
+  while (*link != NULL) {
+    if (*link == pat) {
+      *link = pat->next;
+      break;
     }
-     YabThreadLock(cacheMutex);
-    int param0 = cmd->CMDSRCA << 16 | cmd->CMDCOLR;
-    int param1 = cmd->CMDPMOD << 16 | cmd->CMDCTRL;
-    int param2 = regs->SPCTL << 16 | lutPri;
-    int param3 = regs->CCRSA << 16 | regs->PRISA;
-    u8 pixSample[PIX_SIZE];
-
-    for (int i =0; i<SAMPLE; i++) {
-      pixSample[i] =  T1ReadByte(ram, (characterAddress + characterHeight*characterWidth*i/SAMPLE));
+    link = &(*link)->next;
+  }
+  lruUnlink(shard, pat);
+  shard->bytes -= pat->bytes;
+  shard->entries--;
+  free(pat->src);
+  free(pat->pix);
+  free(pat);
+}
+
+static void evictCachePattern(PatternShard *shard, u32 needed) {
+  while ((shard->lruTail != NULL) && (shard->bytes + needed > shard->budget)) {
+    deleteCachePattern(shard, shard->lruTail);
+    shard->evict++;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void makeKey(vdp1cmd_struct *cmd, u8* ram, Vdp2 * regs, PatternKey *key) {
+  int characterWidth = ((cmd->CMDSIZE >> 8) & 0x3F) * 8;
+  int characterHeight = cmd->CMDSIZE & 0xFF;
+  int colormode = (cmd->CMDPMOD >> 3) & 0x7;
+  u32 size = characterWidth * characterHeight;
+
+  key->valid = 0;
+  if ((characterWidth == 0) || (characterHeight == 0)) return;
+  if (size <= 256) return; //Cache impact is negligible here
+
+  switch (colormode) {
+    case 0:
+    case 1:
+      size >>= 1;
+      break;
+    case 2:
+    case 3:
+    case 4:
+      break;
+    case 5:
+      size <<= 1;
+      break;
+    default:
+      return;
+  }
+
+  key->width = characterWidth;
+  key->height = characterHeight;
+  key->srcaddr = (cmd->CMDSRCA << 3) & PATTERN_RAM_MASK;
+  key->srcsize = size;
+  key->lutaddr = (colormode == 1) ? ((cmd->CMDCOLR << 3) & PATTERN_RAM_MASK) : 0xFFFFFFFF;
+  key->param[0] = (cmd->CMDCOLR << 16) | cmd->CMDPMOD;
+  key->param[1] = (cmd->CMDSIZE << 16) | regs->SPCTL;
+  // The color calculation ratio ends up in the alpha of the texels
+  key->param[2] = (regs->CCRSA << 16) | regs->PRISA;
+  key->param[3] = cmd->CMDCTRL;
+  key->hash = hashKey(key, ram);
+  key->valid = 1;
+}
+
+int getPattern(vdp1cmd_struct *cmd, u8* ram, Vdp2 * regs, PatternKey *key, u32 *pix, int offset) {
+  PatternShard *shard;
+  Pattern *pat;
+  int i;
+
+  makeKey(cmd, ram, regs, key);
+  if (!key->valid || (patternShard == NULL)) return 0;
+
+  shard = getShard(key->hash);
+  YabThreadLock(shard->mtx);
+  for (pat = *getBucket(shard, key->hash); pat != NULL; pat = pat->next) {
+    if (matchKey(pat, key, ram)) break;
+  }
+  if (pat == NULL) {
+    shard->miss++;
+    YabThreadUnLock(shard->mtx);
+    return 0;
+  }
+  shard->hit++;
+  if (shard->lruHead != pat) {
+    lruUnlink(shard, pat);
+    lruPushFront(shard, pat);
+  }
+  // Copy while holding the lock, the entry may be evicted right after
+  for (i = 0; i < pat->height; i++) {
+    memcpy(&pix[i*(pat->width+offset)], &pat->pix[i*pat->width], pat->width*sizeof(u32));
+  }
+  YabThreadUnLock(shard->mtx);
+  return 1;
+}
+
+void addPattern(PatternKey *key, u8* ram, u32 *pix, int offset) {
+  PatternShard *shard;
+  Pattern *pat;
+  Pattern **bucket;
+  u32 lutsize;
+  int i;
+
+  if (!key->valid || (patternShard == NULL)) return;
+
+  lutsize = (key->lutaddr != 0xFFFFFFFF) ? PATTERN_LUT_SIZE : 0;
+  pat = malloc(sizeof(Pattern));
+  if (pat == NULL) return;
+  pat->hash = key->hash;
+  memcpy(pat->param, key->param, sizeof(pat->param));
+  pat->width = key->width;
+  pat->height = key->height;
+  pat->srcsize = key->srcsize + lutsize;
+  pat->src = malloc(pat->srcsize);
+  pat->pix = malloc(key->width * key->height * sizeof(u32));
+  pat->bytes = sizeof(Pattern) + pat->srcsize + key->width * key->height * sizeof(u32);
+  pat->next = pat->lruPrev = pat->lruNext = NULL;
+  if ((pat->src == NULL) || (pat->pix == NULL)) {
+    free(pat->src);
+    free(pat->pix);
+    free(pat);
+    return;
+  }
+
+  copyRam(pat->src, ram, key->srcaddr, key->srcsize);
+  if (lutsize) copyRam(pat->src + key->srcsize, ram, key->lutaddr, lutsize);
+  // The source may have been rewritten while decoding, do not store
+  // pixels which no longer match the key
+  if (hashPattern(pat, key) != key->hash) {
+    free(pat->src);
+    free(pat->pix);
+    free(pat);
+    return;
+  }
+  for (i = 0; i < key->height; i++) {
+    memcpy(&pat->pix[i*key->width], &pix[i*(key->width+offset)], key->width*sizeof(u32));
+  }
+
+  shard = getShard(key->hash);
+  YabThreadLock(shard->mtx);
+  if (pat->bytes > shard->budget) {
+    YabThreadUnLock(shard->mtx);
+    free(pat->src);
+    free(pat->pix);
+    free(pat);
+    return;
+  }
+  bucket = getBucket(shard, key->hash);
+  {
+    // Another thread may have decoded the same sprite meanwhile
+    Pattern *cur;
+    for (cur = *bucket; cur != NULL; cur = cur->next) {
+      if (matchKey(cur, key, ram)) break;
     }
-    memcpy(&pixSample[SAMPLE], &param0, 4);
-    memcpy(&pixSample[SAMPLE+4], &param1, 4);
-    memcpy(&pixSample[SAMPLE+8], &param2, 4);
-    memcpy(&pixSample[SAMPLE+12], &param3, 4);
-
-    curPattern = createCachePattern(pixSample, characterWidth, characterHeight, offset);
-    if (addCachePattern(curPattern) != 0) deleteCachePattern(&curPattern);
-    else {
-      for (int i=0; i<characterHeight; i++) {
-    	memcpy(&curPattern->pix[i*characterWidth], &pix[i*(characterWidth+offset)], characterWidth*sizeof(u32));
-      }
+    if (cur != NULL) {
+      YabThreadUnLock(shard->mtx);
+      free(pat->src);
+      free(pat->pix);
+      free(pat);
+      return;
     }
-    YabThreadUnLock(cacheMutex);
+  }
+  evictCachePattern(shard, pat->bytes);
+  pat->next = *bucket;
+  *bucket = pat;
+  lruPushFront(shard, pat);
+  shard->bytes += pat->bytes;
+  shard->entries++;
+  YabThreadUnLock(shard->mtx);
 }
 
-void releasePattern() {
-    memset(patternUse, 0, 0xFFFF);
+void getPatternCacheStats(PatternCacheStats *stats) {
+  int i;
+  memset(stats, 0, sizeof(PatternCacheStats));
+  if (patternShard == NULL) return;
+  for (i = 0; i < PATTERN_SHARDS; i++) {
+    PatternShard *shard = &patternShard[i];
+    YabThreadLock(shard->mtx);
+    stats->hit += shard->hit;
+    stats->miss += shard->miss;
+    stats->evict += shard->evict;
+    stats->entries += shard->entries;
+    stats->bytes += shard->bytes;
+    YabThreadUnLock(shard->mtx);
+  }
+  stats->budget = patternBudget;
 }
 
 void resetPatternCache(){
-    for (int i = 0; i<0x10000; i++) {
-      deleteCachePattern(&patternCache[i]);
+    int i;
+    if (patternShard == NULL) return;
+    for (i = 0; i < PATTERN_SHARDS; i++) {
+      PatternShard *shard = &patternShard[i];
+      YabThreadLock(shard->mtx);
+      while (shard->lruHead != NULL) deleteCachePattern(shard, shard->lruHead);
+      shard->hit = shard->miss = shard->evict = 0;
+      YabThreadUnLock(shard->mtx);
     }
-#ifdef VDP1_CACHE_STAT
-  nbReuse = 0;
-  nbElem = 0;
-  nbColid = 0;
-#endif
-}
-
-void initPatternCache(){
-    cacheMutex = YabThreadCreateMutex();
-    patternCache = malloc(0x10000 * sizeof(Pattern*));
-    patternUse = malloc(0x10000 * sizeof(u8));
-    for (int i = 0; i<0x10000; i++) {
-      patternCache[i] = NULL;
-      patternUse[i] = 0;
+}
+
+void initPatternCache(u32 budget){
+    int i;
+    if (patternShard != NULL) return;
+    if (budget == 0) budget = PATTERN_CACHE_DEFAULT_SIZE;
+    patternBudget = budget;
+    patternShard = calloc(PATTERN_SHARDS, sizeof(PatternShard));
+    if (patternShard == NULL) return;
+    for (i = 0; i < PATTERN_SHARDS; i++) {
+      patternShard[i].mtx = YabThreadCreateMutex();
+      patternShard[i].budget = budget / PATTERN_SHARDS;
     }
 }
 
 void deinitPatternCache(){
-    YabThreadFreeMutex(cacheMutex);
-    free(patternCache);
-    free(patternUse);
-#ifdef VDP1_CACHE_STAT
-    printf("VDP1 Cache Stat Elem(%lld), Collision(%lld), Reuse(%lld)\n", nbElem, nbColid, nbReuse);
-#endif
+    int i;
+    if (patternShard == NULL) return;
+    {
+      PatternCacheStats stats;
+      getPatternCacheStats(&stats);
+      if (stats.hit + stats.miss != 0)
+        YuiMsg("VDP1 sprite cache: %lld hits, %lld misses, %lld evictions, %lld entries (%lld of %lld bytes)\n",
+          (long long)stats.hit, (long long)stats.miss, (long long)stats.evict,
+          (long long)stats.entries, (long long)stats.bytes, (long long)stats.budget);
+    }
     resetPatternCache();
+    for (i = 0; i < PATTERN_SHARDS; i++) {
+      YabThreadFreeMutex(patternShard[i].mtx);
+    }
+    free(patternShard);
+    patternShard = NULL;
 }
-
-
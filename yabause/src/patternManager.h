@@ -5,23 +5,53 @@
 #include "vdp1.h"
 #include "vdp2.h"
 
-#define SAMPLE 24
-#define PIX_SIZE (SAMPLE+16)
+// Default cache budget when the frontend does not provide one
+#define PATTERN_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+// Command and register words the decoded texels depend on
+#define PATTERN_PARAMS 4
 
 typedef struct sPattern {
-	u32 *pix;
+	u64 hash;
+	u32 param[PATTERN_PARAMS];
 	int width;
 	int height;
-        int offset;
-	int managed;
-        u8 pixSample[PIX_SIZE];
+	u32 srcsize;
+	u8 *src;
+	u32 *pix;
+	u32 bytes;
+	struct sPattern *next;
+	struct sPattern *lruPrev;
+	struct sPattern *lruNext;
 } Pattern;
 
-Pattern* getPattern(vdp1cmd_struct *cmd, u8* ram, Vdp2 * regs);
-void releasePattern();
-void addPattern(vdp1cmd_struct *cmd, u8* ram, u32 *pix, int offset, Vdp2 * regs);
+// Identifies a sprite decode: computed once before decoding so that
+// the same key is used for lookup and insertion.
+typedef struct {
+	int valid;
+	u64 hash;
+	u32 param[PATTERN_PARAMS];
+	int width;
+	int height;
+	u32 srcaddr;
+	u32 lutaddr;
+	u32 srcsize;
+} PatternKey;
+
+typedef struct {
+	u64 hit;
+	u64 miss;
+	u64 evict;
+	u64 entries;
+	u64 bytes;
+	u64 budget;
+} PatternCacheStats;
+
+int getPattern(vdp1cmd_struct *cmd, u8* ram, Vdp2 * regs, PatternKey *key, u32 *pix, int offset);
+void addPattern(PatternKey *key, u8* ram, u32 *pix, int offset);
+void getPatternCacheStats(PatternCacheStats *stats);
 void deinitPatternCache();
 void resetPatternCache();
-void initPatternCache();
+void initPatternCache(u32 budget);
 
 #endif
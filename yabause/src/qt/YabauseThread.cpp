@@ -468,6 +468,7 @@ void YabauseThread::resetYabauseConf()
         mYabauseConf.stretch = 0;
 #ifdef SPRITE_CACHE
         mYabauseConf.useVdp1cache = 0;
+        mYabauseConf.vdp1cachesize = 0;
 #endif
 }
 
@@ -93,7 +93,8 @@ const Items mUpscaleFilterMode = Items()
 const Items mPolygonGenerationMode = Items()
 	<< Item("0", "Triangles using perspective correction")
 	<< Item("1", "CPU Tesselation")
-	<< Item("2", "GPU Tesselation");
+	<< Item("2", "GPU Tesselation")
+	<< Item("3", "GPU Compute rasterizer (OpenGL 4.3)");
 
 const Items mResolutionMode = Items()
 	<< Item("1", "Original (original resolution of the Saturn)")
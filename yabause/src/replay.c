@@ -0,0 +1,141 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file replay.c
+    \brief Unthrottled movie playback for verifying input logs.
+
+    The frames between two checkpoints are emulated with yabsys.skipRender
+    set, which leaves out VDP2 drawing and pacing but keeps every VDP1
+    side effect, so the machine state does not depend on which frames were
+    rendered. The checkpoint lines look like
+
+        <frame> <wram crc> <vdp crc>
+
+    and a replay compares them against the ones of a previous run.
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include "replay.h"
+#include "movie.h"
+#include "memory.h"
+#include "vdp1.h"
+#include "vdp2.h"
+#include "error.h"
+#include "yabause.h"
+#include "zlib/zlib.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+void ReplayHash(ReplayCheckpoint_struct *checkpoint)
+{
+   uLong crc;
+
+   crc = crc32(0L, Z_NULL, 0);
+   crc = crc32(crc, HighWram, 0x100000);
+   crc = crc32(crc, LowWram, 0x100000);
+   checkpoint->wram = (u32)crc;
+
+   // Vdp1 is malloc'ed, leave the padding before addr out
+   crc = crc32(0L, Z_NULL, 0);
+   crc = crc32(crc, (const Bytef *)Vdp1Regs, offsetof(Vdp1, MODR) + sizeof(Vdp1Regs->MODR));
+   crc = crc32(crc, (const Bytef *)&Vdp1Regs->addr, sizeof(Vdp1) - offsetof(Vdp1, addr));
+   crc = crc32(crc, Vdp1Ram, 0x80000);
+   crc = crc32(crc, (const Bytef *)Vdp2Regs, sizeof(Vdp2));
+   crc = crc32(crc, Vdp2Ram, 0x100000);
+   crc = crc32(crc, Vdp2ColorRam, 0x1000);
+   checkpoint->vdp = (u32)crc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int ReplayCheck(FILE *reference, const ReplayCheckpoint_struct *checkpoint)
+{
+   ReplayCheckpoint_struct expected;
+   char msg[256];
+
+   if (fscanf(reference, "%u %x %x", &expected.frame, &expected.wram, &expected.vdp) != 3)
+   {
+      sprintf(msg, "Replay: frame %u is past the end of the reference", (unsigned)checkpoint->frame);
+      YabSetError(YAB_ERR_OTHER, msg);
+      return 1;
+   }
+   if (expected.frame != checkpoint->frame)
+   {
+      sprintf(msg, "Replay: reference has frame %u where frame %u was expected",
+              (unsigned)expected.frame, (unsigned)checkpoint->frame);
+      YabSetError(YAB_ERR_OTHER, msg);
+      return 1;
+   }
+   if (expected.wram != checkpoint->wram || expected.vdp != checkpoint->vdp)
+   {
+      sprintf(msg, "Replay: diverged at frame %u (wram %08x, expected %08x; vdp %08x, expected %08x)",
+              (unsigned)checkpoint->frame, (unsigned)checkpoint->wram, (unsigned)expected.wram,
+              (unsigned)checkpoint->vdp, (unsigned)expected.vdp);
+      YabSetError(YAB_ERR_OTHER, msg);
+      return 1;
+   }
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int ReplayMovie(const char *filename, int interval, FILE *reference, FILE *out)
+{
+   ReplayCheckpoint_struct checkpoint;
+   int skip = yabsys.skipRender;
+   int unthrottled = isAutoFrameSkip();
+   u32 frame = 0;
+   int ret = 0;
+
+   if (interval <= 0)
+      interval = REPLAY_DEFAULT_INTERVAL;
+
+   if (PlayMovie(filename) != 0)
+   {
+      YabSetError(YAB_ERR_FILENOTFOUND, (void *)filename);
+      return -1;
+   }
+   // Only the checkpoint frames go through the frame pacing
+   if (!unthrottled)
+      EnableAutoFrameSkip();
+
+   while (Movie.Status == Playback)
+   {
+      frame++;
+      yabsys.skipRender = (frame % interval) != 0 && frame != (u32)Movie.Frames;
+      YabauseEmulate();
+      if (yabsys.skipRender)
+         continue;
+
+      ReplayHash(&checkpoint);
+      checkpoint.frame = frame;
+      if (out != NULL)
+         fprintf(out, "%u %08x %08x\n", (unsigned)checkpoint.frame, (unsigned)checkpoint.wram, (unsigned)checkpoint.vdp);
+      if (reference != NULL && ReplayCheck(reference, &checkpoint) != 0)
+      {
+         ret = 1;
+         break;
+      }
+   }
+
+   yabsys.skipRender = skip;
+   if (!unthrottled)
+      DisableAutoFrameSkip();
+   StopMovie();
+   return ret;
+}
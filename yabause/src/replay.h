@@ -0,0 +1,44 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "core.h"
+
+#define REPLAY_DEFAULT_INTERVAL 60
+
+typedef struct
+{
+   u32 frame;
+   u32 wram;   // CRC32 of high and low work RAM
+   u32 vdp;    // CRC32 of VDP1/VDP2 RAM, color RAM and registers
+} ReplayCheckpoint_struct;
+
+void ReplayHash(ReplayCheckpoint_struct *checkpoint);
+
+// Play a movie back from a reset as fast as possible, only rendering the
+// checkpoint frames: every interval frames and the last one. Checkpoints
+// are written to out (when not NULL) one per line. With a reference, a
+// file written that way, the replay stops at the first checkpoint that
+// differs from it.
+// Returns 0 when the movie played to the end, 1 on a divergence, -1 on
+// error.
+int ReplayMovie(const char *filename, int interval, FILE *reference, FILE *out);
+
+#endif
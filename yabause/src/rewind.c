@@ -0,0 +1,385 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file rewind.c
+    \brief Rewind history of in-memory states.
+
+    Every interval frames the emulation serializes a state into a capture
+    buffer and hands it to a worker thread. The newest state is kept as is
+    (the head); each older one is stored as an incremental state against
+    the state that follows it (the pages that differ, see
+    YabStateDeltaCreate), deflated at the fastest level. Two consecutive
+    states differ in a few pages, so an entry is a tiny fraction of the
+    ~5MB state.
+
+    Stepping back inflates the newest delta and applies it to the head,
+    which gives back the previous state. The oldest deltas are dropped when
+    the history goes over its memory budget.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+#include "memory.h"
+#include "threads.h"
+#include "error.h"
+#include "zlib/zlib.h"
+
+typedef struct
+{
+   u8 *data;      // Deflated delta from the next state to this one
+   u32 size;      // Deflated size
+   u32 length;    // Delta size
+} RewindEntry_struct;
+
+static struct
+{
+   int interval;
+   int frames;
+   int stepped;
+   u32 budget;
+   u32 used;
+
+   RewindEntry_struct *entries;
+   int entrycap;
+   int first;
+   int count;
+
+   // Three state buffers of the same capacity: the newest state, the one
+   // being compressed and the one being captured
+   u8 *head;
+   u32 headsize;
+   u8 *work;
+   u32 worksize;
+   u8 *capture;
+   size_t capacity;
+
+   u8 *dbuf;
+   size_t dcap;
+   u8 *zbuf;
+   uLong zcap;
+
+   YabSem *start;
+   YabMutex *mutex;
+   volatile int busy;
+   volatile int running;
+} rwd;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void RewindDropOldest(void)
+{
+   RewindEntry_struct *entry = &rwd.entries[rwd.first];
+
+   rwd.used -= entry->size;
+   free(entry->data);
+   entry->data = NULL;
+   rwd.first = (rwd.first + 1) % rwd.entrycap;
+   rwd.count--;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void RewindPush(u8 *data, u32 size, u32 length)
+{
+   RewindEntry_struct *entry;
+
+   while (rwd.count > 0 && rwd.used + size > rwd.budget)
+      RewindDropOldest();
+
+   if (rwd.count == rwd.entrycap)
+   {
+      // Grow the ring, keeping the entries in order
+      int cap = rwd.entrycap ? rwd.entrycap * 2 : 256;
+      RewindEntry_struct *entries = (RewindEntry_struct *)calloc(cap, sizeof(RewindEntry_struct));
+      int i;
+
+      if (entries == NULL)
+      {
+         free(data);
+         return;
+      }
+      for (i = 0; i < rwd.count; i++)
+         entries[i] = rwd.entries[(rwd.first + i) % rwd.entrycap];
+      free(rwd.entries);
+      rwd.entries = entries;
+      rwd.entrycap = cap;
+      rwd.first = 0;
+   }
+
+   entry = &rwd.entries[(rwd.first + rwd.count) % rwd.entrycap];
+   entry->data = data;
+   entry->size = size;
+   entry->length = length;
+   rwd.count++;
+   rwd.used += size;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void RewindCompress(void)
+{
+   size_t length;
+   uLongf zsize;
+   u8 *swap;
+
+   // The head becomes the delta that restores it from the new state
+   if (rwd.headsize != 0 &&
+       YabStateDeltaCreate(rwd.work, rwd.worksize, rwd.head, rwd.headsize, rwd.dbuf, rwd.dcap, &length) == 0)
+   {
+      zsize = rwd.zcap;
+      if (compress2(rwd.zbuf, &zsize, rwd.dbuf, (uLong)length, Z_BEST_SPEED) == Z_OK)
+      {
+         u8 *data = (u8 *)malloc(zsize);
+         if (data != NULL)
+         {
+            memcpy(data, rwd.zbuf, zsize);
+            RewindPush(data, (u32)zsize, (u32)length);
+         }
+      }
+   }
+
+   swap = rwd.head;
+   rwd.head = rwd.work;
+   rwd.headsize = rwd.worksize;
+   rwd.work = swap;
+   rwd.worksize = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void RewindThread(UNUSED void *arg)
+{
+   while (rwd.running)
+   {
+      YabSemWait(rwd.start);
+      if (!rwd.running)
+         break;
+
+      YabThreadLock(rwd.mutex);
+      RewindCompress();
+      rwd.busy = 0;
+      YabThreadUnLock(rwd.mutex);
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void RewindWaitIdle(void)
+{
+   while (rwd.busy)
+      YabThreadYield();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int RewindAlloc(size_t size)
+{
+   size_t capacity = size + (size >> 3);
+   size_t dcap = YabStateDeltaBound(capacity);
+   uLong zcap = compressBound((uLong)dcap);
+   u8 *buf[3];
+   u8 *dbuf;
+   u8 *zbuf;
+   int i;
+
+   buf[0] = (u8 *)malloc(capacity);
+   buf[1] = (u8 *)malloc(capacity);
+   buf[2] = (u8 *)malloc(capacity);
+   dbuf = (u8 *)malloc(dcap);
+   zbuf = (u8 *)malloc(zcap);
+   if (buf[0] == NULL || buf[1] == NULL || buf[2] == NULL || dbuf == NULL || zbuf == NULL)
+   {
+      for (i = 0; i < 3; i++)
+         free(buf[i]);
+      free(dbuf);
+      free(zbuf);
+      return -1;
+   }
+
+   // The history stays valid, deltas only depend on the state contents
+   if (rwd.head != NULL)
+      memcpy(buf[0], rwd.head, rwd.headsize);
+   free(rwd.head);
+   free(rwd.work);
+   free(rwd.capture);
+   free(rwd.dbuf);
+   free(rwd.zbuf);
+   rwd.head = buf[0];
+   rwd.work = buf[1];
+   rwd.capture = buf[2];
+   rwd.dbuf = dbuf;
+   rwd.dcap = dcap;
+   rwd.zbuf = zbuf;
+   rwd.zcap = zcap;
+   rwd.capacity = capacity;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int RewindInit(int interval, u32 budget)
+{
+   size_t size;
+
+   RewindDeInit();
+   if (interval <= 0)
+      return 0;
+
+   memset(&rwd, 0, sizeof(rwd));
+   rwd.interval = interval;
+   rwd.budget = budget ? budget : REWIND_DEFAULT_BUDGET;
+
+   if ((size = YabSaveStateSize()) == 0 || RewindAlloc(size) != 0)
+   {
+      YabSetError(YAB_ERR_CANNOTINIT, "Rewind");
+      return -1;
+   }
+
+   rwd.mutex = YabThreadCreateMutex();
+   rwd.start = YabThreadCreateSem(0);
+   rwd.running = 1;
+   if (YabThreadStart(YAB_THREAD_REWIND, RewindThread, NULL) != 0)
+   {
+      rwd.running = 0;
+      RewindDeInit();
+      return -1;
+   }
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void RewindDeInit(void)
+{
+   if (rwd.running)
+   {
+      RewindWaitIdle();
+      rwd.running = 0;
+      YabSemPost(rwd.start);
+      YabThreadWait(YAB_THREAD_REWIND);
+   }
+   while (rwd.count > 0)
+      RewindDropOldest();
+   free(rwd.entries);
+   free(rwd.head);
+   free(rwd.work);
+   free(rwd.capture);
+   free(rwd.dbuf);
+   free(rwd.zbuf);
+   if (rwd.mutex != NULL)
+      YabThreadFreeMutex(rwd.mutex);
+   if (rwd.start != NULL)
+      YabThreadFreeSem(rwd.start);
+   memset(&rwd, 0, sizeof(rwd));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int RewindIsEnabled(void)
+{
+   return rwd.interval > 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void RewindFrame(void)
+{
+   size_t size = 0;
+   u8 *swap;
+
+   if (rwd.interval <= 0)
+      return;
+   if (++rwd.frames < rwd.interval)
+      return;
+   // Still compressing the previous capture, try again next frame
+   if (rwd.busy)
+      return;
+
+   if (YabSaveStateToBufferEx(rwd.capture, rwd.capacity, &size, YAB_STATE_MOVIE | YAB_STATE_QUIET) != 0)
+   {
+      // The state outgrew the buffers
+      size = YabSaveStateSize();
+      if (size <= rwd.capacity || RewindAlloc(size) != 0)
+         return;
+      if (YabSaveStateToBufferEx(rwd.capture, rwd.capacity, &size, YAB_STATE_MOVIE | YAB_STATE_QUIET) != 0)
+         return;
+   }
+   rwd.frames = 0;
+   rwd.stepped = 0;
+
+   YabThreadLock(rwd.mutex);
+   swap = rwd.work;
+   rwd.work = rwd.capture;
+   rwd.worksize = (u32)size;
+   rwd.capture = swap;
+   rwd.busy = 1;
+   YabThreadUnLock(rwd.mutex);
+   YabSemPost(rwd.start);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int RewindStep(void)
+{
+   RewindEntry_struct *entry;
+   uLongf length;
+   size_t size;
+   int ret;
+
+   if (rwd.interval <= 0)
+      return -1;
+   RewindWaitIdle();
+
+   if (rwd.headsize == 0)
+      return -1;
+
+   // Frames were run since the newest state was captured, go back to it
+   // first. Once it has been restored, each step pops a delta.
+   if (rwd.frames == 0 || rwd.stepped)
+   {
+      if (rwd.count == 0)
+         return -1;
+
+      entry = &rwd.entries[(rwd.first + rwd.count - 1) % rwd.entrycap];
+      length = (uLongf)rwd.dcap;
+      if (uncompress(rwd.dbuf, &length, entry->data, entry->size) != Z_OK || length != entry->length)
+         return -1;
+      if (YabStateDeltaApply(rwd.head, rwd.capacity, rwd.headsize, rwd.dbuf, length, &size) != 0)
+         return -1;
+      rwd.headsize = (u32)size;
+
+      rwd.used -= entry->size;
+      free(entry->data);
+      entry->data = NULL;
+      rwd.count--;
+   }
+
+   ret = YabLoadStateBufferEx(rwd.head, rwd.headsize, YAB_STATE_QUIET);
+   rwd.frames = 0;
+   rwd.stepped = 1;
+   return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int RewindCount(void)
+{
+   if (rwd.headsize == 0)
+      return 0;
+   return rwd.count + (rwd.frames > 0 && !rwd.stepped ? 1 : 0);
+}
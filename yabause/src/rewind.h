@@ -0,0 +1,41 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "core.h"
+
+#define REWIND_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+// Start capturing a state every interval frames, keeping at most budget
+// bytes of compressed history (0 for the default)
+int RewindInit(int interval, u32 budget);
+void RewindDeInit(void);
+int RewindIsEnabled(void);
+
+// Called by the emulation once per frame
+void RewindFrame(void);
+
+// Go back to the previous captured state. Returns -1 when the history is
+// empty. Must be called between frames.
+int RewindStep(void);
+
+// Number of states that can still be restored
+int RewindCount(void);
+
+#endif
@@ -86,6 +86,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <math.h>
 #include <limits.h>
 
@@ -1794,6 +1795,7 @@ static void scsp_slot_update_keyon(slot_t *slot);
 //////////////////////////////////////////////////////////////////////////////
 
 static int scsp_mute_flags = 0;
+static int scsp_discard_audio = 0;
 static int scsp_volume = 100;
 static int thread_running = 0;
 static int scsp_sample_count = 0;
@@ -5510,6 +5512,7 @@ void ScspAsynMainRT( void * p ){
         frame_count = 0;
       }
       int sleeptime = 0;
+      int speed = YabauseGetSpeed();
       u64 checktime = 0;
       m68kcycle = 0;
       sh2_read_req = 0;
@@ -5521,8 +5524,9 @@ void ScspAsynMainRT( void * p ){
         else{
           difftime = now + (ULLONG_MAX - before);
         }
-        sleeptime = ((1000000/fps) - difftime);
-        if ((sleeptime > 0) && (isAutoFrameSkip()==0)) YabThreadUSleep(sleeptime);
+        // Fast-forward and turbo keep the sound in step with the frames
+        sleeptime = (speed != 0) ? ((1000000/fps/speed) - difftime) : 0;
+        if (sleeptime > 0) YabThreadUSleep(sleeptime);
 
         if(sh2_read_req != 0) {
           for (i = 0; i < samplecnt; i += step) {
@@ -5533,7 +5537,7 @@ void ScspAsynMainRT( void * p ){
           new_scsp_exec((samplecnt << 1));
           sh2_read_req = 0;
         }
-      } while ((sleeptime > 0) && (isAutoFrameSkip()==0));
+      } while (sleeptime > 0);
       checktime = YabauseGetTicks() * 1000000 / yabsys.tickfreq;
       //yprintf("vsynctime = %d(%d)\n", (s32)(checktime - before), (s32)(operation_time - before));
       before = checktime;
@@ -5583,6 +5587,10 @@ void ScspExecAsync() {
      scspsoundoutleft += scspsoundlen;
   }
 
+  // These samples were already played once (netplay resimulation)
+  if (scsp_discard_audio)
+     scspsoundoutleft = 0;
+
   while (scspsoundoutleft > 0 &&
      (audiosize = SNDCore->GetAudioSpace()) > 0)
   {
@@ -5702,6 +5710,24 @@ ScspUnMuteAudio (int flags)
 
 //////////////////////////////////////////////////////////////////////////////
 
+void
+ScspDiscardAudio (int discard)
+{
+  scsp_discard_audio = discard;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+const void *
+ScspGetSlotState (size_t *size)
+{
+  // The sound stack and the slots, debug_mode is not machine state
+  *size = offsetof(struct Scsp, debug_mode);
+  return &new_scsp;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void
 ScspSetVolume (int volume)
 {
@@ -113,6 +113,8 @@ void ScspSlotResetDebug(u8 slotnum);
 int ScspSlotDebugAudioSaveWav(u8 slotnum, const char *filename);
 void ScspMuteAudio(int flags);
 void ScspUnMuteAudio(int flags);
+void ScspDiscardAudio(int discard);
+const void *ScspGetSlotState(size_t *size);
 void ScspSetVolume(int volume);
 void ScspAsynMain(void * p);
 void ScspExecAsync();
@@ -30,6 +30,8 @@ int YabSockConnectSocket(const char *ip, int port, YabSock *sock) { return -1; }
 
 int YabSockListenSocket(int port, YabSock *sock) { return -1; }
 
+int YabSockUdpSocket(int localport, const char *ip, int port, YabSock *sock) { return -1; }
+
 int YabSockCloseSocket(YabSock sock) { return -1; }
 
 int YabSockSelect(YabSock sock, int check_read, int check_write ) { return -1; }
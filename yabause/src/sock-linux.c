@@ -117,6 +117,59 @@ int YabSockListenSocket(int port, YabSock *sock)
    return 0;
 }
 
+int YabSockUdpSocket(int localport, const char *ip, int port, YabSock *sock)
+{
+   struct addrinfo *result = NULL;
+   struct addrinfo hints;
+   struct sockaddr_in addr;
+   char port_str[256];
+
+   memset(&hints, 0, sizeof(hints));
+
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+   hints.ai_protocol = IPPROTO_UDP;
+
+   sprintf(port_str, "%d", port);
+   if (getaddrinfo(ip, port_str, &hints, &result) != 0)
+   {
+      perror("getaddrinfo");
+      return -1;
+   }
+
+   if ((sock[0] = socket(result->ai_family, result->ai_socktype,
+      result->ai_protocol)) == -1)
+   {
+      freeaddrinfo(result);
+      perror("socket");
+      return -1;
+   }
+
+   memset(&addr, 0, sizeof(struct sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = INADDR_ANY;
+   addr.sin_port = htons(localport);
+   if (bind(sock[0], (struct sockaddr *) &addr, sizeof(addr)) == -1)
+   {
+      fprintf(stderr, "Can't bind to port %d\n", localport);
+      freeaddrinfo(result);
+      close(sock[0]);
+      return -1;
+   }
+
+   // A connected datagram socket filters out other senders
+   if (connect(sock[0], result->ai_addr, (int)result->ai_addrlen) == -1)
+   {
+      perror("connect");
+      freeaddrinfo(result);
+      close(sock[0]);
+      return -1;
+   }
+
+   freeaddrinfo(result);
+   return 0;
+}
+
 int YabSockCloseSocket(YabSock sock)
 {
    return close(sock);
@@ -38,6 +38,11 @@ int YabSockConnectSocket(const char *ip, int port, YabSock *sock);
 // Returns 0 on success. -1 on error.
 int YabSockListenSocket(int port, YabSock *sock);
 
+// YabSockUdpSocket: Opens a datagram socket bound to localport whose
+// sends go to, and receives only come from, the specified ip and port.
+// Returns 0 on success. -1 on error.
+int YabSockUdpSocket(int localport, const char *ip, int port, YabSock *sock);
+
 // YabSockCloseSocket: Closes previously opened socket.
 // Returns 0 on success. -1 on error.
 int YabSockCloseSocket(YabSock sock);
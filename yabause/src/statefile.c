@@ -0,0 +1,467 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*! \file statefile.c
+    \brief Background writing of state files and periodic autosave.
+
+    Saving a state used to serialize, then write to disk from the emulation
+    thread with the sound thread locked. Now the emulation thread only takes
+    the in-memory snapshot; a writer thread deflates it into a temporary
+    file next to the target and renames it over, so a crash or a full disk
+    never leaves a truncated state behind. A failed write is reported from
+    the emulation thread, the next time it queues, flushes or autosaves.
+
+    State files are gzip streams. gzread passes plain files through, so the
+    states written before stay loadable.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "statefile.h"
+#include "memory.h"
+#include "threads.h"
+#include "error.h"
+#include "cs2.h"
+#include "yabause.h"
+#include "zlib/zlib.h"
+
+typedef struct StateFileJob_struct
+{
+   char *filename;
+   void *buffer;
+   size_t size;
+   struct StateFileJob_struct *next;
+} StateFileJob_struct;
+
+static struct
+{
+   StateFileJob_struct *first;
+   StateFileJob_struct *last;
+   volatile int pending;
+   volatile int running;
+   int flushing;
+   char *failed;
+   YabMutex *mutex;
+   YabSem *start;
+   YabSem *done;
+} writer;
+
+static struct
+{
+   int interval;
+   int frames;
+   char dirpath[512];
+} autosave;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int StateFileWrite(const char *filename, const void *buffer, size_t size)
+{
+   char *tmpname;
+   gzFile gz;
+   int ret = -1;
+
+   if ((tmpname = (char *)malloc(strlen(filename) + 5)) == NULL)
+      return -1;
+   sprintf(tmpname, "%s.tmp", filename);
+
+   if ((gz = gzopen(tmpname, "wb")) != NULL)
+   {
+      if (gzwrite(gz, buffer, (unsigned)size) == (int)size)
+         ret = 0;
+      if (gzclose(gz) != Z_OK)
+         ret = -1;
+   }
+
+   if (ret == 0)
+   {
+#ifdef WIN32
+      // rename does not replace an existing file there
+      remove(filename);
+#endif
+      if (rename(tmpname, filename) != 0)
+         ret = -1;
+   }
+   if (ret != 0)
+      remove(tmpname);
+
+   free(tmpname);
+   return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void StateFileThread(UNUSED void *arg)
+{
+   StateFileJob_struct *job;
+   int done;
+
+   while (writer.running || writer.first != NULL)
+   {
+      YabSemWait(writer.start);
+
+      for (;;)
+      {
+         YabThreadLock(writer.mutex);
+         job = writer.first;
+         if (job != NULL)
+         {
+            writer.first = job->next;
+            if (writer.first == NULL)
+               writer.last = NULL;
+         }
+         YabThreadUnLock(writer.mutex);
+         if (job == NULL)
+            break;
+
+         if (StateFileWrite(job->filename, job->buffer, job->size) != 0)
+         {
+            // Keep the first failure for the emulation thread to report
+            YabThreadLock(writer.mutex);
+            if (writer.failed == NULL)
+            {
+               writer.failed = job->filename;
+               job->filename = NULL;
+            }
+            YabThreadUnLock(writer.mutex);
+         }
+
+         free(job->filename);
+         free(job->buffer);
+         free(job);
+
+         YabThreadLock(writer.mutex);
+         writer.pending--;
+         done = (writer.pending == 0 && writer.flushing);
+         if (done)
+            writer.flushing = 0;
+         YabThreadUnLock(writer.mutex);
+         if (done)
+            YabSemPost(writer.done);
+      }
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int StateFileStart(void)
+{
+   if (writer.running)
+      return 0;
+
+   writer.mutex = YabThreadCreateMutex();
+   writer.start = YabThreadCreateSem(0);
+   writer.done = YabThreadCreateSem(0);
+   writer.running = 1;
+   if (YabThreadStart(YAB_THREAD_STATEFILE, StateFileThread, NULL) != 0)
+   {
+      writer.running = 0;
+      YabThreadFreeMutex(writer.mutex);
+      YabThreadFreeSem(writer.start);
+      YabThreadFreeSem(writer.done);
+      writer.mutex = NULL;
+      writer.start = NULL;
+      writer.done = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void StateFileReportError(void)
+{
+   char *failed;
+
+   if (!writer.running)
+      return;
+
+   YabThreadLock(writer.mutex);
+   failed = writer.failed;
+   writer.failed = NULL;
+   YabThreadUnLock(writer.mutex);
+
+   if (failed != NULL)
+   {
+      YabSetError(YAB_ERR_FILEWRITE, failed);
+      free(failed);
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int StateFileQueue(const char *filename, void *buffer, size_t size)
+{
+   StateFileJob_struct *job;
+
+   StateFileReportError();
+
+   if ((job = (StateFileJob_struct *)calloc(1, sizeof(StateFileJob_struct))) == NULL ||
+       (job->filename = (char *)malloc(strlen(filename) + 1)) == NULL)
+   {
+      free(job);
+      free(buffer);
+      return -1;
+   }
+   strcpy(job->filename, filename);
+   job->buffer = buffer;
+   job->size = size;
+
+   if (StateFileStart() != 0)
+   {
+      // No thread, write it from here
+      int ret = StateFileWrite(job->filename, buffer, size);
+      free(job->filename);
+      free(job);
+      free(buffer);
+      return ret;
+   }
+
+   YabThreadLock(writer.mutex);
+   if (writer.last != NULL)
+      writer.last->next = job;
+   else
+      writer.first = job;
+   writer.last = job;
+   writer.pending++;
+   YabThreadUnLock(writer.mutex);
+   YabSemPost(writer.start);
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int StateFileIsBusy(void)
+{
+   return writer.pending != 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void StateFileFlush(void)
+{
+   int wait;
+
+   if (!writer.running)
+      return;
+
+   YabThreadLock(writer.mutex);
+   wait = (writer.pending != 0);
+   if (wait)
+      writer.flushing = 1;
+   YabThreadUnLock(writer.mutex);
+   if (wait)
+      YabSemWait(writer.done);
+
+   StateFileReportError();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void StateFileDeInit(void)
+{
+   if (!writer.running)
+      return;
+
+   StateFileFlush();
+   writer.running = 0;
+   YabSemPost(writer.start);
+   YabThreadWait(YAB_THREAD_STATEFILE);
+   YabThreadFreeMutex(writer.mutex);
+   YabThreadFreeSem(writer.start);
+   YabThreadFreeSem(writer.done);
+   free(writer.failed);
+   memset(&writer, 0, sizeof(writer));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int StateFileReserve(u8 **buf, size_t *capacity, size_t end)
+{
+   u8 *grown;
+   size_t size = *capacity ? *capacity : 0x800000;
+
+   if (end <= *capacity)
+      return 0;
+   while (size < end)
+      size *= 2;
+   if ((grown = (u8 *)realloc(*buf, size)) == NULL)
+      return -1;
+   *buf = grown;
+   *capacity = size;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int StateFileRead(const char *filename, void **buffer, size_t *size)
+{
+   gzFile gz;
+   u8 *buf = NULL;
+   size_t capacity = 0;
+   size_t pos = 0;
+   int len;
+
+   *buffer = NULL;
+   *size = 0;
+
+   // A state being written must land first
+   StateFileFlush();
+
+   if ((gz = gzopen(filename, "rb")) == NULL)
+      return -1;
+
+   for (;;)
+   {
+      if (StateFileReserve(&buf, &capacity, pos + 1) != 0)
+      {
+         free(buf);
+         gzclose(gz);
+         return -1;
+      }
+      len = gzread(gz, buf + pos, (unsigned)(capacity - pos));
+      if (len < 0)
+      {
+         free(buf);
+         gzclose(gz);
+         return -1;
+      }
+      if (len == 0)
+         break;
+      pos += len;
+   }
+   gzclose(gz);
+
+   *buffer = buf;
+   *size = pos;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int StateFileReadStream(FILE *fp, void **buffer, size_t *size)
+{
+   z_stream zs;
+   u8 in[0x4000];
+   u8 *buf = NULL;
+   size_t capacity = 0;
+   size_t pos = 0;
+   size_t len;
+   int status = Z_OK;
+   int deflated;
+
+   *buffer = NULL;
+   *size = 0;
+
+   len = fread(in, 1, sizeof(in), fp);
+   deflated = (len >= 2 && in[0] == 0x1f && in[1] == 0x8b);
+
+   memset(&zs, 0, sizeof(zs));
+   if (deflated && inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+      return -1;
+
+   while (len > 0 && status != Z_STREAM_END)
+   {
+      if (!deflated)
+      {
+         // Written before states were deflated, copied as is
+         if (StateFileReserve(&buf, &capacity, pos + len) != 0)
+            break;
+         memcpy(buf + pos, in, len);
+         pos += len;
+      }
+      else
+      {
+         zs.next_in = in;
+         zs.avail_in = (uInt)len;
+         do
+         {
+            if (StateFileReserve(&buf, &capacity, pos + 1) != 0)
+            {
+               status = Z_MEM_ERROR;
+               break;
+            }
+            zs.next_out = buf + pos;
+            zs.avail_out = (uInt)(capacity - pos);
+            status = inflate(&zs, Z_NO_FLUSH);
+            pos = capacity - zs.avail_out;
+         } while (status == Z_OK && (zs.avail_in > 0 || zs.avail_out == 0));
+         // Z_BUF_ERROR only asks for more input
+         if (status == Z_BUF_ERROR)
+            status = Z_OK;
+         if (status != Z_OK && status != Z_STREAM_END)
+            break;
+      }
+      len = fread(in, 1, sizeof(in), fp);
+   }
+
+   if (deflated)
+      inflateEnd(&zs);
+   // Stopped early, or the stream ended before the end of the state
+   if ((deflated ? status != Z_STREAM_END : len > 0) || pos == 0)
+   {
+      free(buf);
+      return -1;
+   }
+
+   *buffer = buf;
+   *size = pos;
+   return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AutosaveInit(int interval, const char *dirpath)
+{
+   autosave.interval = interval;
+   autosave.frames = 0;
+   if (dirpath == NULL)
+      dirpath = ".";
+   strncpy(autosave.dirpath, dirpath, sizeof(autosave.dirpath) - 1);
+   autosave.dirpath[sizeof(autosave.dirpath) - 1] = '\0';
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void AutosaveFrame(void)
+{
+   char filename[600];
+   void *buffer;
+   size_t size;
+
+   StateFileReportError();
+
+   if (autosave.interval <= 0)
+      return;
+   if (++autosave.frames < autosave.interval * (yabsys.IsPal ? 50 : 60))
+      return;
+   // Never let autosaves pile up behind a slow disk
+   if (cdip == NULL || StateFileIsBusy())
+      return;
+   autosave.frames = 0;
+
+#ifdef WIN32
+   sprintf(filename, "%s\\%s_auto.yss", autosave.dirpath, cdip->itemnum);
+#else
+   sprintf(filename, "%s/%s_auto.yss", autosave.dirpath, cdip->itemnum);
+#endif
+
+   if (YabSaveStateBufferEx(&buffer, &size, YAB_STATE_THUMBNAIL | YAB_STATE_MOVIE | YAB_STATE_QUIET) != 0)
+      return;
+   StateFileQueue(filename, buffer, size);
+}
@@ -0,0 +1,43 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+#ifndef STATEFILE_H
+#define STATEFILE_H
+
+#include "core.h"
+
+// Hand a serialized state to the writer thread, which deflates it into
+// filename through a temporary file and a rename. The buffer is freed by
+// the writer.
+int StateFileQueue(const char *filename, void *buffer, size_t size);
+
+// Wait for the queued states to be on disk
+void StateFileFlush(void);
+int StateFileIsBusy(void);
+void StateFileDeInit(void);
+
+// Read a state file, deflated or not, into a malloc'ed buffer
+int StateFileRead(const char *filename, void **buffer, size_t *size);
+// Same for a state file already opened, read from the current position
+int StateFileReadStream(FILE *fp, void **buffer, size_t *size);
+
+// Save <dirpath>/<game id>_auto.yss every interval seconds (0 disables it)
+void AutosaveInit(int interval, const char *dirpath);
+// Called by the emulation once per frame
+void AutosaveFrame(void);
+
+#endif
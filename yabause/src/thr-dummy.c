@@ -35,4 +35,6 @@ void YabThreadRemoteSleep(unsigned int id) {}
 
 void YabThreadWake(unsigned int id) {}
 
+int YabThreadGetCoreCount(void) { return 1; }
+
 //////////////////////////////////////////////////////////////////////////////
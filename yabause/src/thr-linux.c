@@ -491,6 +491,14 @@ int YabThreadGetCurrentThreadAffinityMask()
     return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
+int YabThreadGetCoreCount(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+}
+
 
 
 //////////////////////////////////////////////////////////////////////////////
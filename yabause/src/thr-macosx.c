@@ -22,6 +22,7 @@
 
 #include <pthread.h>
 #include <sched.h>
+#include <unistd.h>
 
 /* Thread handle structure. */
 struct thd_s {
@@ -135,3 +136,8 @@ void YabThreadWake(unsigned int id) {
 
     pthread_cond_signal(&thread_handle[id].cond);
 }
+
+int YabThreadGetCoreCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
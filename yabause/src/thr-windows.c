@@ -406,4 +406,10 @@ int YabThreadGetCurrentThreadAffinityMask(){
 	return GetCurrentProcessorNumber();
 }
 
+int YabThreadGetCoreCount(void){
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
 //////////////////////////////////////////////////////////////////////////////
@@ -32,6 +32,10 @@ extern "C" {
 // Thread constants
 ///////////////////////////////////////////////////////////////////////////
 
+// Upper bound of the VDP1 texture decoding workers, the actual count
+// depends on the host
+#define YAB_NUM_VDP1_THREADS 8
+
 // Thread IDs
 enum {
    YAB_THREAD_SCSP = 0,
@@ -58,9 +62,7 @@ enum {
    YAB_THREAD_VIDSOFT_LAYER_SPRITE,
 
    YAB_THREAD_VDP1_0,
-   YAB_THREAD_VDP1_1,
-   YAB_THREAD_VDP1_2,
-   YAB_THREAD_VDP1_3,
+   YAB_THREAD_VDP1_LAST = YAB_THREAD_VDP1_0 + YAB_NUM_VDP1_THREADS - 1,
 
    YAB_THREAD_VDP2_BACK,
    YAB_THREAD_VDP2_LINE,
@@ -70,6 +72,9 @@ enum {
    YAB_THREAD_VDP2_NBG0,
    YAB_THREAD_VDP2_RBG0,
    YAB_THREAD_VDP2_RBG1,
+   YAB_THREAD_PRESENT,
+   YAB_THREAD_REWIND,
+   YAB_THREAD_STATEFILE,
    YAB_NUM_THREADS      // Total number of subthreads
 };
 
@@ -130,7 +135,7 @@ typedef void * YabSem;
 void YabSemPost( YabSem * mtx );
 void YabSemWait( YabSem * mtx );
 YabSem * YabThreadCreateSem(int val);
-void YabThreadFreeMutex( YabSem * mtx);
+void YabThreadFreeSem( YabSem * mtx );
 
 typedef void * YabMutex;
 
@@ -156,6 +161,10 @@ int YabThreadGetCurrentThreadAffinityMask();
 
 void YabThreadUSleep( unsigned int stime );
 
+// YabThreadGetCoreCount: number of processors available to the process,
+// at least 1.
+int YabThreadGetCoreCount(void);
+
 ///////////////////////////////////////////////////////////////////////////
 
 #ifdef __cplusplus
@@ -34,6 +34,7 @@
 #include "threads.h"
 #include "sh2core.h"
 #include "ygl.h"
+#include "frameskip.h"
 
 u8 * Vdp1Ram;
 
@@ -479,6 +480,7 @@ void Vdp1FakeDrawCommands(u8 * ram, Vdp1 * regs)
    u32 returnAddr = 0xffffffff;
 
    while (!(command & 0x8000) && commandCounter < 2000) { // fix me
+      regs->COPR = regs->addr >> 3;
       // First, process the command
       if (!(command & 0x4000)) { // if (!skip)
          switch (command & 0x000F) {
@@ -557,7 +559,17 @@ void Vdp1Draw(void)
      /* this should be done after a frame change or a plot trigger */
      Vdp1Regs->COPR = 0;
 
-     VIDCore->Vdp1Draw();
+     // What is drawn here is shown by the next frame. When that one is
+     // skipped as well, only walk the command list, so the registers, the
+     // draw end interrupt and the swaps stay the same
+     if (yabsys.skipVdp1)
+        Vdp1FakeDrawCommands(Vdp1Ram, Vdp1Regs);
+     else
+     {
+        FrameSkipRenderStart();
+        VIDCore->Vdp1Draw();
+        FrameSkipRenderStop();
+     }
    }
 
    FRAMELOG("Vdp1Draw end at %d line", yabsys.LineCount);
@@ -1421,6 +1433,7 @@ void VIDDummSetFilterMode(int type, int value){};
 void VIDDummSync(){};
 void VIDDummyGetNativeResolution(int *width, int * height, int *interlace);
 void VIDDummyVdp2DispOff(void);
+int VIDDummyGetThumbnail(u8 **pixels, int *width, int *height);
 
 VideoInterface_struct VIDDummy = {
 	VIDCORE_DUMMY,
@@ -1451,6 +1464,7 @@ VideoInterface_struct VIDDummy = {
 	VIDDummSync,
 	VIDDummyGetNativeResolution,
 	VIDDummyVdp2DispOff,
+	VIDDummyGetThumbnail,
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1596,6 +1610,16 @@ void VIDDummyVdp2DispOff(void)
 
 //////////////////////////////////////////////////////////////////////////////
 
+int VIDDummyGetThumbnail(u8 **pixels, int *width, int *height)
+{
+   *pixels = NULL;
+   *width = 0;
+   *height = 0;
+   return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void Vdp1HBlankIN(void)
 {
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
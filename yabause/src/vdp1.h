@@ -89,6 +89,9 @@ typedef struct
    void(*Sync)();
    void (*GetNativeResolution)(int *width, int *height, int * interlace);
    void(*Vdp2DispOff)(void);
+   // Last displayed frame as RGBA8, bottom row first. The caller frees
+   // the pixels. Returns -1 when no frame is available.
+   int (*GetThumbnail)(u8 **pixels, int *width, int *height);
 } VideoInterface_struct;
 
 extern VideoInterface_struct *VIDCore;
@@ -25,6 +25,7 @@
 */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include "vdp2.h"
 #include "debug.h"
 #include "peripheral.h"
@@ -39,6 +40,7 @@
 #include "yui.h"
 #include "ygl.h"
 #include "frameprofile.h"
+#include "frameskip.h"
 
 u8 * Vdp2Ram;
 u8 * Vdp2ColorRam;
@@ -47,14 +49,21 @@ Vdp2Internal_struct Vdp2Internal;
 Vdp2External_struct Vdp2External;
 
 u8 Vdp2ColorRamUpdated = 0;
-u8 A0_Updated = 0;
-u8 A1_Updated = 0;
-u8 B0_Updated = 0;
-u8 B1_Updated = 0;
+u32 Vdp2RamDirty[VDP2_RAM_DIRTY_WORDS];
+u32 Vdp2ColorRamDirty = 0;
+u32 Vdp2RamDirtyFrame[VDP2_RAM_DIRTY_WORDS];
+u32 Vdp2ColorRamDirtyFrame = 0;
+u32 Vdp2RamPageGeneration[VDP2_RAM_PAGES];
+u32 Vdp2DirtyGeneration = 0;
 
 struct CellScrollData cell_scroll_data[270];
 Vdp2 Vdp2Lines[270];
 
+// Registers written since the last captured line, and the registers the
+// per-line alpha flags are computed from
+static u32 Vdp2RegWritten[VDP2_REG_MASK_WORDS];
+static u32 Vdp2RegAlphaMask[VDP2_REG_MASK_WORDS];
+
 int vdp2_is_odd_frame = 0;
 
 static void startField(void);// VBLANK-OUT handler
@@ -66,6 +75,139 @@ int g_frame_count = 0;
 
 //////////////////////////////////////////////////////////////////////////////
 
+static INLINE void Vdp2RegMaskSet(u32 *mask, u32 offset)
+{
+   u32 i = offset >> 1;
+   mask[i >> 5] |= 1 << (i & 0x1F);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+#define VDP2_REG_NONE 0xFFFF // Reserved or read-only
+#define VDP2_REG_PAIR 1      // Half of a 32-bit register
+
+// Offset in Vdp2 of the register at each bus address. The struct has no
+// word for the reserved 0x0C and aligns its 32-bit registers, so the two
+// do not line up.
+static const u16 Vdp2RegOffset[0x120 >> 1] =
+{
+   /* 0x000 */ offsetof(Vdp2, TVMD), offsetof(Vdp2, EXTEN), VDP2_REG_NONE, offsetof(Vdp2, VRSIZE),
+   /* 0x008 */ VDP2_REG_NONE, VDP2_REG_NONE, VDP2_REG_NONE, offsetof(Vdp2, RAMCTL),
+   /* 0x010 */ offsetof(Vdp2, CYCA0L), offsetof(Vdp2, CYCA0U), offsetof(Vdp2, CYCA1L), offsetof(Vdp2, CYCA1U),
+   /* 0x018 */ offsetof(Vdp2, CYCB0L), offsetof(Vdp2, CYCB0U), offsetof(Vdp2, CYCB1L), offsetof(Vdp2, CYCB1U),
+   /* 0x020 */ offsetof(Vdp2, BGON), offsetof(Vdp2, MZCTL), offsetof(Vdp2, SFSEL), offsetof(Vdp2, SFCODE),
+   /* 0x028 */ offsetof(Vdp2, CHCTLA), offsetof(Vdp2, CHCTLB), offsetof(Vdp2, BMPNA), offsetof(Vdp2, BMPNB),
+   /* 0x030 */ offsetof(Vdp2, PNCN0), offsetof(Vdp2, PNCN1), offsetof(Vdp2, PNCN2), offsetof(Vdp2, PNCN3),
+   /* 0x038 */ offsetof(Vdp2, PNCR), offsetof(Vdp2, PLSZ), offsetof(Vdp2, MPOFN), offsetof(Vdp2, MPOFR),
+   /* 0x040 */ offsetof(Vdp2, MPABN0), offsetof(Vdp2, MPCDN0), offsetof(Vdp2, MPABN1), offsetof(Vdp2, MPCDN1),
+   /* 0x048 */ offsetof(Vdp2, MPABN2), offsetof(Vdp2, MPCDN2), offsetof(Vdp2, MPABN3), offsetof(Vdp2, MPCDN3),
+   /* 0x050 */ offsetof(Vdp2, MPABRA), offsetof(Vdp2, MPCDRA), offsetof(Vdp2, MPEFRA), offsetof(Vdp2, MPGHRA),
+   /* 0x058 */ offsetof(Vdp2, MPIJRA), offsetof(Vdp2, MPKLRA), offsetof(Vdp2, MPMNRA), offsetof(Vdp2, MPOPRA),
+   /* 0x060 */ offsetof(Vdp2, MPABRB), offsetof(Vdp2, MPCDRB), offsetof(Vdp2, MPEFRB), offsetof(Vdp2, MPGHRB),
+   /* 0x068 */ offsetof(Vdp2, MPIJRB), offsetof(Vdp2, MPKLRB), offsetof(Vdp2, MPMNRB), offsetof(Vdp2, MPOPRB),
+   /* 0x070 */ offsetof(Vdp2, SCXIN0), offsetof(Vdp2, SCXDN0), offsetof(Vdp2, SCYIN0), offsetof(Vdp2, SCYDN0),
+   /* 0x078 */ offsetof(Vdp2, ZMXN0) | VDP2_REG_PAIR, offsetof(Vdp2, ZMXN0) | VDP2_REG_PAIR, offsetof(Vdp2, ZMYN0) | VDP2_REG_PAIR, offsetof(Vdp2, ZMYN0) | VDP2_REG_PAIR,
+   /* 0x080 */ offsetof(Vdp2, SCXIN1), offsetof(Vdp2, SCXDN1), offsetof(Vdp2, SCYIN1), offsetof(Vdp2, SCYDN1),
+   /* 0x088 */ offsetof(Vdp2, ZMXN1) | VDP2_REG_PAIR, offsetof(Vdp2, ZMXN1) | VDP2_REG_PAIR, offsetof(Vdp2, ZMYN1) | VDP2_REG_PAIR, offsetof(Vdp2, ZMYN1) | VDP2_REG_PAIR,
+   /* 0x090 */ offsetof(Vdp2, SCXN2), offsetof(Vdp2, SCYN2), offsetof(Vdp2, SCXN3), offsetof(Vdp2, SCYN3),
+   /* 0x098 */ offsetof(Vdp2, ZMCTL), offsetof(Vdp2, SCRCTL), offsetof(Vdp2, VCSTA) | VDP2_REG_PAIR, offsetof(Vdp2, VCSTA) | VDP2_REG_PAIR,
+   /* 0x0A0 */ offsetof(Vdp2, LSTA0) | VDP2_REG_PAIR, offsetof(Vdp2, LSTA0) | VDP2_REG_PAIR, offsetof(Vdp2, LSTA1) | VDP2_REG_PAIR, offsetof(Vdp2, LSTA1) | VDP2_REG_PAIR,
+   /* 0x0A8 */ offsetof(Vdp2, LCTA) | VDP2_REG_PAIR, offsetof(Vdp2, LCTA) | VDP2_REG_PAIR, offsetof(Vdp2, BKTAU), offsetof(Vdp2, BKTAL),
+   /* 0x0B0 */ offsetof(Vdp2, RPMD), offsetof(Vdp2, RPRCTL), offsetof(Vdp2, KTCTL), offsetof(Vdp2, KTAOF),
+   /* 0x0B8 */ offsetof(Vdp2, OVPNRA), offsetof(Vdp2, OVPNRB), offsetof(Vdp2, RPTA) | VDP2_REG_PAIR, offsetof(Vdp2, RPTA) | VDP2_REG_PAIR,
+   /* 0x0C0 */ offsetof(Vdp2, WPSX0), offsetof(Vdp2, WPSY0), offsetof(Vdp2, WPEX0), offsetof(Vdp2, WPEY0),
+   /* 0x0C8 */ offsetof(Vdp2, WPSX1), offsetof(Vdp2, WPSY1), offsetof(Vdp2, WPEX1), offsetof(Vdp2, WPEY1),
+   /* 0x0D0 */ offsetof(Vdp2, WCTLA), offsetof(Vdp2, WCTLB), offsetof(Vdp2, WCTLC), offsetof(Vdp2, WCTLD),
+   /* 0x0D8 */ offsetof(Vdp2, LWTA0) | VDP2_REG_PAIR, offsetof(Vdp2, LWTA0) | VDP2_REG_PAIR, offsetof(Vdp2, LWTA1) | VDP2_REG_PAIR, offsetof(Vdp2, LWTA1) | VDP2_REG_PAIR,
+   /* 0x0E0 */ offsetof(Vdp2, SPCTL), offsetof(Vdp2, SDCTL), offsetof(Vdp2, CRAOFA), offsetof(Vdp2, CRAOFB),
+   /* 0x0E8 */ offsetof(Vdp2, LNCLEN), offsetof(Vdp2, SFPRMD), offsetof(Vdp2, CCCTL), offsetof(Vdp2, SFCCMD),
+   /* 0x0F0 */ offsetof(Vdp2, PRISA), offsetof(Vdp2, PRISB), offsetof(Vdp2, PRISC), offsetof(Vdp2, PRISD),
+   /* 0x0F8 */ offsetof(Vdp2, PRINA), offsetof(Vdp2, PRINB), offsetof(Vdp2, PRIR), VDP2_REG_NONE,
+   /* 0x100 */ offsetof(Vdp2, CCRSA), offsetof(Vdp2, CCRSB), offsetof(Vdp2, CCRSC), offsetof(Vdp2, CCRSD),
+   /* 0x108 */ offsetof(Vdp2, CCRNA), offsetof(Vdp2, CCRNB), offsetof(Vdp2, CCRR), offsetof(Vdp2, CCRLB),
+   /* 0x110 */ offsetof(Vdp2, CLOFEN), offsetof(Vdp2, CLOFSL), offsetof(Vdp2, COAR), offsetof(Vdp2, COAG),
+   /* 0x118 */ offsetof(Vdp2, COAB), offsetof(Vdp2, COBR), offsetof(Vdp2, COBG), offsetof(Vdp2, COBB),
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+// 32-bit registers are stored as unions whose halves are swapped on little
+// endian hosts, so a write marks both of their words
+static INLINE void Vdp2RegMarkWritten(u32 addr)
+{
+   u32 offset;
+
+   if ((addr >> 1) >= sizeof(Vdp2RegOffset) / sizeof(Vdp2RegOffset[0])) return;
+   offset = Vdp2RegOffset[addr >> 1];
+   if (offset == VDP2_REG_NONE) return;
+   if (offset & VDP2_REG_PAIR)
+   {
+      offset &= ~VDP2_REG_PAIR;
+      Vdp2RegMaskSet(Vdp2RegWritten, offset + 2);
+   }
+   Vdp2RegMaskSet(Vdp2RegWritten, offset);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp2RegLogInit(void)
+{
+   memset(Vdp2RegAlphaMask, 0, sizeof(Vdp2RegAlphaMask));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, CCRNA));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, CCRNB));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, CCRR));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, CLOFEN));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COAR));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COAG));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COAB));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COBR));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COBG));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, COBB));
+   Vdp2RegMaskSet(Vdp2RegAlphaMask, offsetof(Vdp2, PRISA));
+
+   memset(&Vdp2External.reglog_a, 0, sizeof(Vdp2RegLog_struct));
+   memset(&Vdp2External.reglog_b, 0, sizeof(Vdp2RegLog_struct));
+   Vdp2External.reglog = &Vdp2External.reglog_a;
+   Vdp2External.reglog_draw = &Vdp2External.reglog_b;
+   memset(Vdp2RegWritten, 0xFF, sizeof(Vdp2RegWritten));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Compares the registers written during the line against the previous line
+// and records the ones that changed. Returns non-zero when one of the
+// registers used for the per-line alpha flags changed.
+static int Vdp2RegLogLine(int line)
+{
+   Vdp2RegLog_struct *log = Vdp2External.reglog;
+   u16 *cur = (u16 *)&Vdp2Lines[line];
+   u16 *prev = (u16 *)&Vdp2Lines[line - 1];
+   u32 any = 0, alpha = 0;
+   u32 i, j;
+
+   for (i = 0; i < VDP2_REG_MASK_WORDS; i++)
+   {
+      u32 written = Vdp2RegWritten[i];
+      u32 changed = 0;
+
+      Vdp2RegWritten[i] = 0;
+      for (j = 0; written != 0; j++, written >>= 1)
+      {
+         u32 w = (i << 5) + j;
+         if ((written & 1) && (w < VDP2_REG_WORDS) && (cur[w] != prev[w]))
+            changed |= 1 << j;
+      }
+      log->line[line][i] = changed;
+      log->frame[i] |= changed;
+      any |= changed;
+      alpha |= changed & Vdp2RegAlphaMask[i];
+   }
+   if (any) log->changedlines++;
+   return alpha != 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 u8 FASTCALL Vdp2RamReadByte(SH2_struct *context, u8* mem, u32 addr) {
    addr &= 0xFFFFF;
    return T1ReadByte(mem, addr);
@@ -89,20 +231,7 @@ u32 FASTCALL Vdp2RamReadLong(SH2_struct *context, u8* mem, u32 addr) {
 
 void FASTCALL Vdp2RamWriteByte(SH2_struct *context, u8* mem, u32 addr, u8 val) {
    addr &= 0xFFFFF;
-
-   if (A0_Updated == 0 && addr >= 0 && addr < (0x20000<<(Vdp2Regs->VRSIZE>>15))){
-     A0_Updated = 1;
-   }
-   else if (A1_Updated == 0 &&  addr >= (0x20000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x40000<<(Vdp2Regs->VRSIZE>>15))){
-     A1_Updated = 1;
-   }
-   else if (B0_Updated == 0 && addr >= (0x40000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x60000<<(Vdp2Regs->VRSIZE>>15))){
-     B0_Updated = 1;
-   }
-   else if (B1_Updated == 0 && addr >= (0x60000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x80000<<(Vdp2Regs->VRSIZE>>15))){
-     B1_Updated = 1;
-   }
-
+   Vdp2RamMarkDirty(addr);
    T1WriteByte(mem, addr, val);
 }
 
@@ -110,20 +239,7 @@ void FASTCALL Vdp2RamWriteByte(SH2_struct *context, u8* mem, u32 addr, u8 val) {
 
 void FASTCALL Vdp2RamWriteWord(SH2_struct *context, u8* mem, u32 addr, u16 val) {
    addr &= 0xFFFFF;
-
-   if (A0_Updated == 0 && addr >= 0 && addr < (0x20000<<(Vdp2Regs->VRSIZE>>15))){
-     A0_Updated = 1;
-   }
-   else if (A1_Updated == 0 &&  addr >= (0x20000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x40000<<(Vdp2Regs->VRSIZE>>15))){
-     A1_Updated = 1;
-   }
-   else if (B0_Updated == 0 && addr >= (0x40000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x60000<<(Vdp2Regs->VRSIZE>>15))){
-     B0_Updated = 1;
-   }
-   else if (B1_Updated == 0 && addr >= (0x60000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x80000<<(Vdp2Regs->VRSIZE>>15))){
-     B1_Updated = 1;
-   }
-
+   Vdp2RamMarkDirty(addr);
    T1WriteWord(mem, addr, val);
 }
 
@@ -131,20 +247,7 @@ void FASTCALL Vdp2RamWriteWord(SH2_struct *context, u8* mem, u32 addr, u16 val)
 
 void FASTCALL Vdp2RamWriteLong(SH2_struct *context, u8* mem, u32 addr, u32 val) {
    addr &= 0xFFFFF;
-
-   if (A0_Updated == 0 && addr >= 0 && addr < (0x20000<<(Vdp2Regs->VRSIZE>>15))){
-     A0_Updated = 1;
-   }
-   else if (A1_Updated == 0 &&  addr >= (0x20000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x40000<<(Vdp2Regs->VRSIZE>>15))){
-     A1_Updated = 1;
-   }
-   else if (B0_Updated == 0 && addr >= (0x40000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x60000<<(Vdp2Regs->VRSIZE>>15))){
-     B0_Updated = 1;
-   }
-   else if (B1_Updated == 0 && addr >= (0x60000<<(Vdp2Regs->VRSIZE>>15)) && addr < (0x80000<<(Vdp2Regs->VRSIZE>>15))){
-     B1_Updated = 1;
-   }
-
+   Vdp2RamMarkDirty(addr);
    T1WriteLong(mem, addr, val);
 }
 
@@ -174,6 +277,7 @@ u32 FASTCALL Vdp2ColorRamReadLong(SH2_struct *context, u8* mem, u32 addr) {
 void FASTCALL Vdp2ColorRamWriteByte(SH2_struct *context, u8* mem, u32 addr, u8 val) {
    addr &= 0xFFF;
    //LOG("[VDP2] Update Coloram Byte %08X:%02X", addr, val);
+   Vdp2ColorRamMarkDirty(addr);
    T2WriteByte(mem, addr, val);
 }
 
@@ -182,6 +286,7 @@ void FASTCALL Vdp2ColorRamWriteByte(SH2_struct *context, u8* mem, u32 addr, u8 v
 void FASTCALL Vdp2ColorRamWriteWord(SH2_struct *context, u8* mem, u32 addr, u16 val) {
    addr &= 0xFFF;
    //LOG("[VDP2] Update Coloram Word %08X:%04X\n", addr, val);
+   Vdp2ColorRamMarkDirty(addr);
    if (Vdp2Internal.ColorMode == 0 ) {
      int up = ((addr & 0x800) != 0);
      if (val != T2ReadWord(mem, addr)) {
@@ -214,6 +319,7 @@ void FASTCALL Vdp2ColorRamWriteWord(SH2_struct *context, u8* mem, u32 addr, u16
 void FASTCALL Vdp2ColorRamWriteLong(SH2_struct *context, u8* mem, u32 addr, u32 val) {
    addr &= 0xFFF;
    //LOG("[VDP2] Update Coloram Long %08X:%08X\n", addr, val);
+   Vdp2ColorRamMarkDirty(addr);
    if (Vdp2Internal.ColorMode == 0) {
 
      int up = ((addr & 0x800) != 0);
@@ -262,6 +368,7 @@ int Vdp2Init(void) {
    Vdp2Reset();
 
    memset(Vdp2ColorRam, 0xFF, 0x1000);
+   Vdp2MarkAllDirty();
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
    for (int i = 0; i < 0x1000; i += 2) {
      YglOnUpdateColorRamWord(i);
@@ -273,6 +380,34 @@ int Vdp2Init(void) {
 
 //////////////////////////////////////////////////////////////////////////////
 
+void Vdp2MarkAllDirty(void) {
+   memset(Vdp2RamDirty, 0xFF, sizeof(Vdp2RamDirty));
+   Vdp2ColorRamDirty = 0xFFFFFFFF;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void Vdp2LatchDirty(void) {
+   int i;
+
+   Vdp2DirtyGeneration++;
+   for (i = 0; i < VDP2_RAM_DIRTY_WORDS; i++) {
+      u32 bits = Vdp2RamDirty[i];
+      Vdp2RamDirtyFrame[i] = bits;
+      Vdp2RamDirty[i] = 0;
+      while (bits) {
+         int bit = 0;
+         while (!(bits & (1 << bit))) bit++;
+         bits &= ~(1 << bit);
+         Vdp2RamPageGeneration[(i << 5) + bit] = Vdp2DirtyGeneration;
+      }
+   }
+   Vdp2ColorRamDirtyFrame = Vdp2ColorRamDirty;
+   Vdp2ColorRamDirty = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void Vdp2DeInit(void) {
    if (Vdp2Regs)
       free(Vdp2Regs);
@@ -377,6 +512,7 @@ void Vdp2Reset(void) {
    memset(Vdp2External.perline_alpha_b, 0, 270*sizeof(int));
    Vdp2External.perline_alpha = Vdp2External.perline_alpha_a;
    Vdp2External.perline_alpha_draw = Vdp2External.perline_alpha_b;
+   Vdp2RegLogInit();
 
 }
 
@@ -393,8 +529,16 @@ void Vdp2VBlankIN(void) {
    now we're lying a little here as we're not swapping the framebuffers. */
    //if (Vdp1External.manualchange) Vdp1Regs->EDSR >>= 1;
 
-   VIDCore->Vdp2Draw();
-   VIDCore->Sync();
+   // Hidden frames (run-ahead) keep the emulated state but are never shown.
+   // Their writes stay in the live dirty bitmaps until a frame is drawn.
+   if (!yabsys.skipRender)
+   {
+      Vdp2LatchDirty();
+      FrameSkipRenderStart();
+      VIDCore->Vdp2Draw();
+      VIDCore->Sync();
+      FrameSkipRenderStop();
+   }
    Vdp2Regs->TVSTAT |= 0x0008;
 
    ScuSendVBlankIN();
@@ -419,7 +563,9 @@ void Vdp2HBlankIN(void) {
   } else {
 // Fix : Function doesn't exist without those defines
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
+     FrameSkipRenderStart();
      waitVdp2DrawScreensEnd(yabsys.LineCount == yabsys.VBlankLineCount);
+     FrameSkipRenderStop();
 #endif
   }
 }
@@ -435,7 +581,19 @@ void Vdp2HBlankOUT(void) {
     {
       cell_scroll_data[yabsys.LineCount].data[i] = Vdp2RamReadLong(NULL, Vdp2Ram, cell_scroll_table_start_addr + i * 4);
     }
-    if (yabsys.LineCount == 0) return;
+    if (yabsys.LineCount == 0) {
+      // Line 0 is the reference every other line is compared to
+      memset(Vdp2External.reglog, 0, sizeof(Vdp2RegLog_struct));
+      memset(Vdp2RegWritten, 0, sizeof(Vdp2RegWritten));
+      return;
+    }
+
+    // None of the registers below changed since the previous line, so the
+    // flags against line 0 are the same as on the previous line
+    if (!Vdp2RegLogLine(yabsys.LineCount)) {
+      Vdp2External.perline_alpha[yabsys.LineCount] |= Vdp2External.perline_alpha[yabsys.LineCount - 1];
+      return;
+    }
 
     if ((Vdp2Lines[0].CCRNA & 0x00FF) != (Vdp2Lines[yabsys.LineCount].CCRNA & 0x00FF)){
       Vdp2External.perline_alpha[yabsys.LineCount] |= 0x1;
@@ -507,6 +665,14 @@ void Vdp2VBlankOUT(void) {
     Vdp2External.perline_alpha_draw = Vdp2External.perline_alpha_b;
   }
   memset(Vdp2External.perline_alpha, 0, 270*sizeof(int));
+  if (Vdp2External.reglog == &Vdp2External.reglog_a){
+    Vdp2External.reglog = &Vdp2External.reglog_b;
+    Vdp2External.reglog_draw = &Vdp2External.reglog_a;
+  }
+  else{
+    Vdp2External.reglog = &Vdp2External.reglog_a;
+    Vdp2External.reglog_draw = &Vdp2External.reglog_b;
+  }
 
 #ifdef _VDP_PROFILE_
   FrameProfileShow();
@@ -1061,6 +1227,7 @@ void Vdp2ReadReg(int addr) {
 
 void FASTCALL Vdp2WriteWord(SH2_struct *context, u8* mem, u32 addr, u16 val) {
    addr &= 0x1FF;
+   Vdp2RegMarkWritten(addr);
 
    switch (addr)
    {
@@ -1091,6 +1258,7 @@ void FASTCALL Vdp2WriteWord(SH2_struct *context, u8* mem, u32 addr, u16 val) {
          Vdp2Regs->RAMCTL = val;
          if (Vdp2Internal.ColorMode != ((val >> 12) & 0x3) ) {
            Vdp2Internal.ColorMode = (val >> 12) & 0x3;
+           Vdp2ColorRamDirty = 0xFFFFFFFF;
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
            for (int i = 0; i < 0x1000; i += 2) {
              YglOnUpdateColorRamWord(i);
@@ -1565,6 +1733,9 @@ int Vdp2LoadState(FILE *fp, UNUSED int version, int size)
    // Read internal variables
    yread(&check, (void *)&Vdp2Internal, sizeof(Vdp2Internal_struct), 1, fp);
 
+   Vdp2MarkAllDirty();
+   memset(Vdp2RegWritten, 0xFF, sizeof(Vdp2RegWritten));
+
    if(VIDCore) VIDCore->Resize(0,0,0,0,0);
 
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
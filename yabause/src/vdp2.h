@@ -32,10 +32,42 @@ extern "C" {
 extern u8 * Vdp2Ram;
 extern u8 * Vdp2ColorRam;
 extern u8 Vdp2ColorRamUpdated;
-extern u8 A0_Updated;
-extern u8 A1_Updated;
-extern u8 B0_Updated;
-extern u8 B1_Updated;
+/* VRAM and color RAM dirty tracking: one bit per 2KB VRAM page and one bit
+   per 128 bytes of color RAM. Writes only set a bit in the live bitmaps.
+   Vdp2LatchDirty runs right before the renderer draws a frame: it moves the
+   live bits into the *DirtyFrame bitmaps (what changed since the previous
+   drawn frame) and stamps each written page with the new generation, so
+   caches that live longer than a frame can compare generations instead.
+   Frames emulated with yabsys.skipRender do not latch. */
+#define VDP2_RAM_PAGE_SHIFT 11
+#define VDP2_RAM_PAGES (0x100000 >> VDP2_RAM_PAGE_SHIFT)
+#define VDP2_RAM_DIRTY_WORDS (VDP2_RAM_PAGES / 32)
+#define VDP2_COLOR_RAM_BLOCK_SHIFT 7
+
+extern u32 Vdp2RamDirty[VDP2_RAM_DIRTY_WORDS];
+extern u32 Vdp2ColorRamDirty;
+extern u32 Vdp2RamDirtyFrame[VDP2_RAM_DIRTY_WORDS];
+extern u32 Vdp2ColorRamDirtyFrame;
+extern u32 Vdp2RamPageGeneration[VDP2_RAM_PAGES];
+extern u32 Vdp2DirtyGeneration;
+
+static INLINE void Vdp2RamMarkDirty(u32 addr)
+{
+   Vdp2RamDirty[addr >> (VDP2_RAM_PAGE_SHIFT + 5)] |= 1 << ((addr >> VDP2_RAM_PAGE_SHIFT) & 0x1F);
+}
+
+static INLINE void Vdp2ColorRamMarkDirty(u32 addr)
+{
+   Vdp2ColorRamDirty |= 1 << ((addr & 0xFFF) >> VDP2_COLOR_RAM_BLOCK_SHIFT);
+}
+
+static INLINE u32 Vdp2RamGeneration(u32 addr)
+{
+   return Vdp2RamPageGeneration[(addr & 0xFFFFF) >> VDP2_RAM_PAGE_SHIFT];
+}
+
+void Vdp2MarkAllDirty(void);
+void Vdp2LatchDirty(void);
 
 u8 FASTCALL     Vdp2RamReadByte(SH2_struct *context, u8*, u32);
 u16 FASTCALL    Vdp2RamReadWord(SH2_struct *context, u8*, u32);
@@ -379,6 +411,19 @@ struct CellScrollData
 
 extern struct CellScrollData cell_scroll_data[270];
 
+// Per-line register change log, one bit per 16-bit word of the Vdp2 struct.
+// line[n] holds the registers whose value on line n differs from line n-1,
+// frame is the OR of all lines. Only registers written by the CPU are
+// tracked, status registers (TVSTAT, HCNT, VCNT) are not.
+#define VDP2_REG_WORDS (sizeof(Vdp2) >> 1)
+#define VDP2_REG_MASK_WORDS ((VDP2_REG_WORDS + 31) >> 5)
+
+typedef struct {
+   u32 line[270][VDP2_REG_MASK_WORDS];
+   u32 frame[VDP2_REG_MASK_WORDS];
+   int changedlines;
+} Vdp2RegLog_struct;
+
 // struct for Vdp2 part that shouldn't be saved
 typedef struct {
    int disptoggle;
@@ -386,6 +431,10 @@ typedef struct {
    int *perline_alpha_draw;
    int perline_alpha_a[270];
    int perline_alpha_b[270];
+   Vdp2RegLog_struct *reglog;
+   Vdp2RegLog_struct *reglog_draw;
+   Vdp2RegLog_struct reglog_a;
+   Vdp2RegLog_struct reglog_b;
 } Vdp2External_struct;
 
 extern Vdp2External_struct Vdp2External;
@@ -421,6 +470,36 @@ void ToggleFullScreen(void);
 
 Vdp2 * Vdp2RestoreRegs(int line, Vdp2* lines);
 
+// offset/size are in bytes inside the Vdp2 struct, e.g. offsetof(Vdp2, PRISA).
+// line < 0 asks whether the register changed on any line of the frame.
+static INLINE int Vdp2RegChanged(const Vdp2RegLog_struct *log, u32 offset, u32 size, int line)
+{
+   const u32 *mask;
+   u32 i;
+
+   if (line >= 270) return 0;
+   mask = (line < 0) ? log->frame : log->line[line];
+   for (i = offset >> 1; i < ((offset + size + 1) >> 1) && i < VDP2_REG_WORDS; i++)
+   {
+      if (mask[i >> 5] & (1 << (i & 0x1F)))
+         return 1;
+   }
+   return 0;
+}
+
+static INLINE int Vdp2RegLineChanged(const Vdp2RegLog_struct *log, int line)
+{
+   u32 i;
+
+   if ((line < 0) || (line >= 270)) return 0;
+   for (i = 0; i < VDP2_REG_MASK_WORDS; i++)
+   {
+      if (log->line[line][i])
+         return 1;
+   }
+   return 0;
+}
+
 #include "threads.h"
 
 int VideoSetFilterType( int video_filter_type );
@@ -25,6 +25,7 @@
 #if defined(HAVE_LIBGL) || defined(__ANDROID__) || defined(IOS)
 
 #include <math.h>
+#include <stddef.h>
 #define EPSILON (1e-10 )
 
 
@@ -157,7 +158,8 @@ YglGetGlSize,
 VIDOGLSetSettingValueMode,
 VIDOGLSync,
 VIDOGLGetNativeResolution,
-VIDOGLVdp2DispOff
+VIDOGLVdp2DispOff,
+YglGetThumbnail
 };
 
 float vdp1wratio = 1;
@@ -213,13 +215,38 @@ typedef struct {
 
 
 
+// Small sprites are batched in one job up to this many texels, bigger
+// sprites are split by lines in slices of about this size
+#define VDP1_JOB_TEXELS (128 * 128)
+#define VDP1_JOB_MAX_TASKS 32
+
+// Completion of a sprite decoded by several slices
 typedef struct {
-  vdp1cmd_struct *cmd;
-  YglTexture *texture;
-  Vdp2 *varVdp2Regs;
+  int pending;
+  int cached;
+#ifdef SPRITE_CACHE
+  PatternKey key;
+#endif
+  u32 *pix;
+  int pitch;
+} vdp1TextureDone;
+
+typedef struct {
+  vdp1cmd_struct cmd;
+  YglTexture texture;
+  Vdp2 varVdp2Regs;
   int w,h;
+  int startrow;
+  int id;
+  vdp1TextureDone *done;
 } vdp1TextureTask;
 
+typedef struct {
+  int count;
+  int texels;
+  vdp1TextureTask task[VDP1_JOB_MAX_TASKS];
+} vdp1TextureJob;
+
 #ifdef RGB_ASYNC
 YabEventQueue *rotq = NULL;
 YabEventQueue *rotq_end = NULL;
@@ -229,8 +256,12 @@ static int rotation_run = 0;
 
 #ifdef VDP1_TEXTURE_ASYNC
 YabEventQueue *vdp1q;
-YabEventQueue *vdp1q_end;
 static int vdp1text_run = 0;
+static int vdp1text_workers = 0;
+static YabMutex *vdp1text_mtx = NULL;
+static vdp1TextureJob *vdp1text_batch = NULL;
+// Textures not yet decoded, per VDP1 texture manager
+static int vdp1text_pending[2] = { 0, 0 };
 #endif
 
 
@@ -619,16 +650,28 @@ static u32 FASTCALL Vdp1ReadPolygonColor(vdp1cmd_struct *cmd, Vdp2* varVdp2Regs)
   return color;
 }
 
-static void FASTCALL Vdp1ReadTexture_in_sync(vdp1cmd_struct *cmd, int spritew, int spriteh, YglTexture *texture, Vdp2 *varVdp2Regs)
+// Number of bytes of VDP1 RAM used by one line of the sprite
+static INLINE u32 Vdp1TextureLineSize(vdp1cmd_struct *cmd, int spritew)
+{
+  switch ((cmd->CMDPMOD >> 3) & 0x7) {
+  case 0:
+  case 1:
+    return spritew / 2;
+  case 5:
+    return spritew * 2;
+  default:
+    return spritew;
+  }
+}
+
+// Decodes spriteh lines of the sprite starting at line startrow, texture
+// points to the first of these lines.
+static void FASTCALL Vdp1ReadTextureRows(vdp1cmd_struct *cmd, int spritew, int startrow, int spriteh, YglTexture *texture, Vdp2 *varVdp2Regs)
 {
   int shadow = 0;
   int normalshadow = 0;
   int priority = 0;
   int colorcl = 0;
-#ifdef SPRITE_CACHE
-  u32* pixBuf = texture->textdata;
-  Pattern* pattern = NULL;
-#endif
   int endcnt = 0;
   int nromal_shadow = 0;
   u32 talpha = 0x00; // MSB Color calcuration mode
@@ -645,24 +688,9 @@ static void FASTCALL Vdp1ReadTexture_in_sync(vdp1cmd_struct *cmd, int spritew, i
  
   if (/*varVdp2Regs->SDCTL != 0 &&*/ MSB != 0) {
     MSB_SHADOW = 1;
-    _Ygl->msb_shadow_count_[_Ygl->drawframe]++;
   }
 
-#ifdef SPRITE_CACHE 
-  if (yabsys.useVdp1cache) { 
-
-    pattern = getPattern(cmd, Vdp1Ram, varVdp2Regs);
-    if (pattern != NULL) {
-      int characterWidth = ((cmd->CMDSIZE >> 8) & 0x3F) * 8;
-      int characterHeight = cmd->CMDSIZE & 0xFF;
-      for (int i=0; i<characterHeight; i++) {
-         memcpy(&texture->textdata[i*(texture->w+characterWidth)], &pattern->pix[i*characterWidth], characterWidth*sizeof(u32));
-      }
-       texture->textdata+=characterHeight*(texture->w+characterWidth);
-     return;
-    }
-  }
-#endif
+  charAddr += startrow * Vdp1TextureLineSize(cmd, spritew);
 
   Vdp1ReadPriority(cmd, &priority, &colorcl, &nromal_shadow, varVdp2Regs);
 
@@ -992,68 +1020,193 @@ static void FASTCALL Vdp1ReadTexture_in_sync(vdp1cmd_struct *cmd, int spritew, i
     VDP1LOG("Unimplemented sprite color mode: %X\n", (cmd->CMDPMOD >> 3) & 0x7);
     break;
    }
+}
+
+static void FASTCALL Vdp1ReadTexture_in_sync(vdp1cmd_struct *cmd, int spritew, int spriteh, YglTexture *texture, Vdp2 *varVdp2Regs)
+{
+#ifdef SPRITE_CACHE
+  u32* pixBuf = texture->textdata;
+  PatternKey patternKey;
+
+  if (yabsys.useVdp1cache) {
+    if (getPattern(cmd, Vdp1Ram, varVdp2Regs, &patternKey, texture->textdata, texture->w)) {
+      texture->textdata+=patternKey.height*(texture->w+patternKey.width);
+      return;
+    }
+  }
+#endif
+
+  Vdp1ReadTextureRows(cmd, spritew, 0, spriteh, texture, varVdp2Regs);
+
 #ifdef SPRITE_CACHE
   if (yabsys.useVdp1cache) {
-    addPattern(cmd, Vdp1Ram, pixBuf, texture->w, varVdp2Regs);
+    addPattern(&patternKey, Vdp1Ram, pixBuf, texture->w);
   }
 #endif
 }
 
 #ifdef VDP1_TEXTURE_ASYNC
+static void Vdp1TextureTaskDone(vdp1TextureTask *task)
+{
+  vdp1TextureDone *done = task->done;
+  int last = 1;
+
+  if (done != NULL) {
+    YabThreadLock(vdp1text_mtx);
+    last = (--done->pending == 0);
+    YabThreadUnLock(vdp1text_mtx);
+    if (!last) return;
+#ifdef SPRITE_CACHE
+    // Only the last slice can store the whole sprite in the cache
+    if (done->cached) addPattern(&done->key, Vdp1Ram, done->pix, done->pitch);
+#endif
+    free(done);
+  }
+
+  YabThreadLock(vdp1text_mtx);
+  vdp1text_pending[task->id]--;
+  YabThreadUnLock(vdp1text_mtx);
+}
+
 void Vdp1ReadTexture_in_async(void *p)
 {
    while(vdp1text_run != 0){
-     vdp1TextureTask *task = (vdp1TextureTask *)YabWaitEventQueue(vdp1q);
-     if (task != NULL) {
-       Vdp1ReadTexture_in_sync(task->cmd, task->w, task->h, task->texture, task->varVdp2Regs);
-       free(task->cmd);
-       free(task->texture);
-       free(task->varVdp2Regs);
-       free(task);
+     vdp1TextureJob *job = (vdp1TextureJob *)YabWaitEventQueue(vdp1q);
+     if (job != NULL) {
+       int i;
+       for (i = 0; i < job->count; i++) {
+         vdp1TextureTask *task = &job->task[i];
+         if (task->done != NULL)
+           Vdp1ReadTextureRows(&task->cmd, task->w, task->startrow, task->h, &task->texture, &task->varVdp2Regs);
+         else
+           Vdp1ReadTexture_in_sync(&task->cmd, task->w, task->h, &task->texture, &task->varVdp2Regs);
+         Vdp1TextureTaskDone(task);
+       }
+       free(job);
      }
-     YabWaitEventQueue(vdp1q_end);
    }
-} 
+}
 
-static void FASTCALL Vdp1ReadTexture(vdp1cmd_struct *cmd, YglSprite *sprite, YglTexture *texture, Vdp2 *varVdp2Regs) {
-   vdp1TextureTask *task = malloc(sizeof(vdp1TextureTask));
+static void Vdp1TextureInit(void) {
+  int i;
+  vdp1text_run = 1;
+  vdp1text_mtx = YabThreadCreateMutex();
+  vdp1q = YabThreadCreateQueue(NB_MSG);
+  // Keep one core for the emulation thread
+  vdp1text_workers = YabThreadGetCoreCount() - 1;
+  if (vdp1text_workers < 1) vdp1text_workers = 1;
+  if (vdp1text_workers > YAB_NUM_VDP1_THREADS) vdp1text_workers = YAB_NUM_VDP1_THREADS;
+  for (i = 0; i < vdp1text_workers; i++)
+    YabThreadStart(YAB_THREAD_VDP1_0 + i, Vdp1ReadTexture_in_async, 0);
+}
 
-   task->cmd = malloc(sizeof(vdp1cmd_struct));
-   task->texture = malloc(sizeof(YglTexture)); 
-   task->varVdp2Regs = malloc(sizeof(Vdp2));
+// Hands the pending batch over to the workers
+static void Vdp1TextureFlush(void) {
+  vdp1TextureJob *job;
+  YabThreadLock(vdp1text_mtx);
+  job = vdp1text_batch;
+  vdp1text_batch = NULL;
+  YabThreadUnLock(vdp1text_mtx);
+  if (job != NULL) YabAddEventQueue(vdp1q, job);
+}
 
-   memcpy(task->cmd, cmd, sizeof(vdp1cmd_struct));
-   memcpy(task->texture, texture, sizeof(YglTexture)); 
-   memcpy(task->varVdp2Regs, varVdp2Regs, sizeof(Vdp2));
+static void Vdp1TextureQueue(vdp1TextureTask *task) {
+  vdp1TextureJob *full = NULL;
+  int texels = task->w * task->h;
 
-   task->w = sprite->w;
-   task->h = sprite->h;
-
-   if (vdp1text_run == 0) {
-     vdp1text_run = 1;
-     vdp1q = YabThreadCreateQueue(NB_MSG);
-     vdp1q_end = YabThreadCreateQueue(NB_MSG);
-     YabThreadStart(YAB_THREAD_VDP1_0, Vdp1ReadTexture_in_async, 0);
-     YabThreadStart(YAB_THREAD_VDP1_1, Vdp1ReadTexture_in_async, 0);
-     YabThreadStart(YAB_THREAD_VDP1_2, Vdp1ReadTexture_in_async, 0);
-     YabThreadStart(YAB_THREAD_VDP1_3, Vdp1ReadTexture_in_async, 0);
+  YabThreadLock(vdp1text_mtx);
+  if (vdp1text_batch == NULL) {
+    vdp1text_batch = (vdp1TextureJob *)malloc(sizeof(vdp1TextureJob));
+    vdp1text_batch->count = 0;
+    vdp1text_batch->texels = 0;
+  }
+  memcpy(&vdp1text_batch->task[vdp1text_batch->count++], task, sizeof(vdp1TextureTask));
+  vdp1text_batch->texels += texels;
+  if ((vdp1text_batch->count == VDP1_JOB_MAX_TASKS) || (vdp1text_batch->texels >= VDP1_JOB_TEXELS)) {
+    full = vdp1text_batch;
+    vdp1text_batch = NULL;
+  }
+  YabThreadUnLock(vdp1text_mtx);
+
+  if (full != NULL) YabAddEventQueue(vdp1q, full);
+}
+
+static void FASTCALL Vdp1ReadTexture(vdp1cmd_struct *cmd, YglSprite *sprite, YglTexture *texture, Vdp2 *varVdp2Regs) {
+   vdp1TextureTask task;
+   int id = _Ygl->drawframe;
+
+   if (vdp1text_run == 0) Vdp1TextureInit();
+
+   if (cmd->CMDPMOD & 0x8000) _Ygl->msb_shadow_count_[_Ygl->drawframe]++;
+
+   memcpy(&task.cmd, cmd, sizeof(vdp1cmd_struct));
+   memcpy(&task.texture, texture, sizeof(YglTexture));
+   memcpy(&task.varVdp2Regs, varVdp2Regs, sizeof(Vdp2));
+   task.w = sprite->w;
+   task.h = sprite->h;
+   task.startrow = 0;
+   task.id = id;
+   task.done = NULL;
+
+   YabThreadLock(vdp1text_mtx);
+   vdp1text_pending[id]++;
+   YabThreadUnLock(vdp1text_mtx);
+
+   if ((sprite->w * sprite->h > VDP1_JOB_TEXELS) && (sprite->h > 1)) {
+     // Large sprite, decode it by slices of lines on several workers
+     vdp1TextureDone *done = (vdp1TextureDone *)malloc(sizeof(vdp1TextureDone));
+     int rows = MAX(VDP1_JOB_TEXELS / sprite->w, 1);
+     int slices = (sprite->h + rows - 1) / rows;
+     int i;
+
+     done->cached = 0;
+     done->pix = texture->textdata;
+     done->pitch = texture->w;
+#ifdef SPRITE_CACHE
+     if (yabsys.useVdp1cache) {
+       if (getPattern(cmd, Vdp1Ram, varVdp2Regs, &done->key, texture->textdata, texture->w)) {
+         free(done);
+         YabThreadLock(vdp1text_mtx);
+         vdp1text_pending[id]--;
+         YabThreadUnLock(vdp1text_mtx);
+         return;
+       }
+       done->cached = 1;
+     }
+#endif
+     done->pending = slices;
+     task.done = done;
+     for (i = 0; i < slices; i++) {
+       task.startrow = i * rows;
+       task.h = MIN(rows, sprite->h - task.startrow);
+       task.texture.textdata = texture->textdata + task.startrow * (sprite->w + texture->w);
+       Vdp1TextureQueue(&task);
+     }
+     // Slices are independent, start them right away
+     Vdp1TextureFlush();
+   } else {
+     Vdp1TextureQueue(&task);
    }
-   YabAddEventQueue(vdp1q_end, NULL);
-   YabAddEventQueue(vdp1q, task);
-   YabThreadYield();
 }
 
-int waitVdp1Textures( int sync) {
-    int empty = 1;
-    if (vdp1q_end == NULL) return 1;
-    while (((empty = YaGetQueueSize(vdp1q_end))!=0) && (sync == 1))
-    {
+// Waits until every texture decoded for the VDP1 texture manager id is
+// written, textures of the other frame keep on being decoded.
+int waitVdp1Textures(int id, int sync) {
+    int pending;
+    if (vdp1text_run == 0) return 1;
+    Vdp1TextureFlush();
+    do {
+      YabThreadLock(vdp1text_mtx);
+      pending = vdp1text_pending[id];
+      YabThreadUnLock(vdp1text_mtx);
+      if ((pending == 0) || (sync != 1)) break;
       YabThreadYield();
-    }
-    return (empty == 0);
+    } while (1);
+    return (pending == 0);
 }
 #else
 static void FASTCALL Vdp1ReadTexture(vdp1cmd_struct *cmd, YglSprite *sprite, YglTexture *texture, Vdp2 *varVdp2Regs) {
+   if (cmd->CMDPMOD & 0x8000) _Ygl->msb_shadow_count_[_Ygl->drawframe]++;
    Vdp1ReadTexture_in_sync(cmd, sprite->w, sprite->h, texture, varVdp2Regs);
 }
 #endif
@@ -2575,6 +2728,46 @@ static void FASTCALL Vdp2DrawBitmapCoordinateInc(vdp2draw_struct *info, YglTextu
   }
 }
 
+// Key of a decoded pattern in the frame persistent part of the VDP2 atlas:
+// everything Vdp2DrawCell_in_sync reads, plus the generation of the VRAM
+// pages holding the character data. Returns 0 when the decode also depends
+// on color RAM contents, which are not tracked by generation.
+static u64 Vdp2PatternPersistentKey(vdp2draw_struct *info, u64 cacheaddr, Vdp2 *varVdp2Regs)
+{
+  u32 addr, last, size;
+  u64 key;
+  int bits;
+
+  if ((info->specialcolormode == 3) && (info->colornumber < 3)) return 0;
+
+  switch (info->colornumber) {
+  case 0: bits = 4; break;
+  case 1: bits = 8; break;
+  case 2:
+  case 3: bits = 16; break;
+  default: bits = 32; break;
+  }
+  size = (info->patternpixelwh * info->patternpixelwh * bits) >> 3;
+
+  key = YglHashMix64(cacheaddr ^ ((u64)info->charaddr << 32));
+  key = YglHashMix64(key ^ (u64)info->colornumber ^ ((u64)info->transparencyenable << 4) ^
+    ((u64)info->specialprimode << 8) ^ ((u64)info->specialfunction << 12) ^
+    ((u64)info->specialcolormode << 16) ^ ((u64)info->specialcolorfunction << 20) ^
+    ((u64)((varVdp2Regs->CCCTL >> 8) & 0x01) << 24) ^ ((u64)info->patternwh << 28) ^
+    ((u64)((vdp2_interlace == 1) && (vdp2height > 448)) << 31) ^ ((u64)(u32)info->specialcode << 32));
+  key = YglHashMix64(key ^ (u64)(u32)info->coloroffset ^ ((u64)info->paladdr << 16) ^
+    ((u64)(u32)info->alpha << 32) ^ ((u64)(info->priority & 0xF) << 48));
+
+  addr = info->charaddr & 0x7FFFF;
+  last = (addr + size - 1) & 0x7FFFF;
+  for (;;) {
+    key = YglHashMix64(key ^ Vdp2RamGeneration(addr));
+    if ((addr >> VDP2_RAM_PAGE_SHIFT) == (last >> VDP2_RAM_PAGE_SHIFT)) break;
+    addr = (addr + (1 << VDP2_RAM_PAGE_SHIFT)) & 0x7FFFF;
+  }
+  return key | 1;
+}
+
 static void Vdp2DrawPatternPos(vdp2draw_struct *info, YglTexture *texture, int x, int y, int cx, int cy, Vdp2 *varVdp2Regs)
 {
   u64 cacheaddr = ((u32)(info->alpha >> 3) << 27) |
@@ -2582,6 +2775,7 @@ static void Vdp2DrawPatternPos(vdp2draw_struct *info, YglTexture *texture, int x
     ((info->patternpixelwh >> 4) << 1) | (((u64)(info->coloroffset >> 8) & 0x07) << 32);
 
   YglCache c;
+  u64 patternkey;
   vdp2draw_struct tile = *info;
   int winmode = 0;
   tile.dst = 0;
@@ -2642,7 +2836,20 @@ static void Vdp2DrawPatternPos(vdp2draw_struct *info, YglTexture *texture, int x
     return;
   }
 
-  YglQuadOffset(&tile, texture, &c, cx, cy, info->coordincx, info->coordincy, YglTM_vdp2);
+  // Patterns decoded in a previous frame are still in the atlas as long as
+  // their VRAM pages have not been written since
+  patternkey = Vdp2PatternPersistentKey(info, cacheaddr, varVdp2Regs);
+  if ((patternkey != 0) && (1 == YglTMFind(YglTM_vdp2, patternkey, &c)))
+  {
+    YglCachedQuadOffset(&tile, &c, cx, cy, info->coordincx, info->coordincy, YglTM_vdp2);
+    YglCacheAdd(YglTM_vdp2, cacheaddr, &c);
+    return;
+  }
+
+  if (YglTMAllocatePersistent(YglTM_vdp2, patternkey, texture, tile.cellw, tile.cellh, &c))
+    YglCachedQuadOffset(&tile, &c, cx, cy, info->coordincx, info->coordincy, YglTM_vdp2);
+  else
+    YglQuadOffset(&tile, texture, &c, cx, cy, info->coordincx, info->coordincy, YglTM_vdp2);
   YglCacheAdd(YglTM_vdp2, cacheaddr, &c);
 
   switch (info->patternwh)
@@ -3372,10 +3579,16 @@ static void finishRbgQueue() {
 
 #define ceilf(a) ((a)+0.99999f)
 
+#define VDP2_KINDEX_NONE 0x7FFFFFFF
+
 static INLINE int vdp2rGetKValue(vdp2rotationparameter_struct * parameter, int i) {
   float kval;
   int   kdata;
   int h = ceilf(parameter->KtablV + (parameter->deltaKAx * i));
+  // Same table entry as the previous read: kx/ky/lineaddr are already set
+  if (h == parameter->klastindex) return parameter->klastret;
+  parameter->klastindex = h;
+  parameter->klastret = 0;
   if (parameter->coefdatasize == 2) {
     if (parameter->k_mem_type == 0) { // vram
       kdata = T1ReadWord(Vdp2Ram, (parameter->coeftbladdr + (h << 1)) & 0x7FFFF);
@@ -3407,9 +3620,25 @@ static INLINE int vdp2rGetKValue(vdp2rotationparameter_struct * parameter, int i
     case 3:  /*ToDo*/  break;
     }
   }
+  parameter->klastret = 1;
   return 1;
 }
 
+// Rotated coordinates of a whole line for a parameter set that does not
+// change over the line. Same expression as the per pixel path, written
+// without branches so the compiler can vectorize it.
+static void Vdp2RotationSpan(vdp2rotationparameter_struct * p, int count, int * hpos, int * vpos) {
+  float ky = p->ky;
+  float Xsp = p->Xsp, Ysp = p->Ysp;
+  float dx = p->dx, dy = p->dy;
+  float Xp = p->Xp, Yp = p->Yp;
+  int i;
+  for (i = 0; i < count; i++) {
+    hpos[i] = (ky * (Xsp + dx * i) + Xp);
+    vpos[i] = (ky * (Ysp + dy * i) + Yp);
+  }
+}
+
 static void Vdp2DrawRotation_in_sync(RBGDrawInfo * rbg, Vdp2 *varVdp2Regs) {
 
   if (rbg == NULL) return;
@@ -3431,6 +3660,8 @@ static void Vdp2DrawRotation_in_sync(RBGDrawInfo * rbg, Vdp2 *varVdp2Regs) {
   int linecl = 0xFF;
   vdp2rotationparameter_struct *parameter;
   Vdp2 * regs;
+  int rpmode, use_span;
+  int hpos[VDP2_ROTATION_SPAN_MAX], vpos[VDP2_ROTATION_SPAN_MAX];
   if ((varVdp2Regs->CCCTL >> 5) & 0x01) {
     linecl = ((~varVdp2Regs->CCRLB & 0x1F) << 3) + 0x7;
   }
@@ -3470,6 +3701,14 @@ static void Vdp2DrawRotation_in_sync(RBGDrawInfo * rbg, Vdp2 *varVdp2Regs) {
 
   rbg->paraA.over_pattern_name = varVdp2Regs->OVPNRA;
   rbg->paraB.over_pattern_name = varVdp2Regs->OVPNRB;
+  rbg->paraA.klastindex = VDP2_KINDEX_NONE;
+  rbg->paraB.klastindex = VDP2_KINDEX_NONE;
+
+  // Parameter A alone, with at most one coefficient per line: the parameter
+  // set is fixed for each line and coordinates are generated per span
+  rpmode = varVdp2Regs->RPMD | rgb_type;
+  use_span = (rpmode == 0) && (hres <= VDP2_ROTATION_SPAN_MAX) &&
+             (!rbg->paraA.coefenab || (rbg->paraA.deltaKAx == 0.0f));
 
   for (j = vstart; j < vstart+vres; j++)
   {
@@ -3542,6 +3781,16 @@ static void Vdp2DrawRotation_in_sync(RBGDrawInfo * rbg, Vdp2 *varVdp2Regs) {
       }
     }
 
+    if (use_span) {
+      if (rbg->paraA.coefenab && (vdp2rGetKValue(&rbg->paraA, 0) == 0)) {
+        for (i = 0; i < hres; i++)
+          *(texture->textdata++) = 0x00000000;
+        texture->textdata += texture->w;
+        continue;
+      }
+      Vdp2RotationSpan(&rbg->paraA, hres, hpos, vpos);
+    }
+
     //	  if (regs) ReadVdp2ColorOffset(regs, info, info->linecheck_mask);
     for (i = 0; i < hres; i++)
     {
@@ -3549,58 +3798,64 @@ static void Vdp2DrawRotation_in_sync(RBGDrawInfo * rbg, Vdp2 *varVdp2Regs) {
         *(texture->textdata++) = 0x00000000;
         continue; // may be faster than GPU
       }
-      switch (varVdp2Regs->RPMD | rgb_type ) {
-      case 0:
+      if (use_span) {
         parameter = &rbg->paraA;
-        if (parameter->coefenab) {
+        h = hpos[i];
+        v = vpos[i];
+      } else {
+        switch (rpmode) {
+        case 0:
+          parameter = &rbg->paraA;
+          if (parameter->coefenab) {
+            if (vdp2rGetKValue(parameter, i) == 0) {
+              *(texture->textdata++) = 0x00000000;
+              continue;
+            }
+          }
+          break;
+        case 1:
+          parameter = &rbg->paraB;
           if (vdp2rGetKValue(parameter, i) == 0) {
             *(texture->textdata++) = 0x00000000;
             continue;
           }
-        }
-        break;
-      case 1:
-        parameter = &rbg->paraB;
-        if (vdp2rGetKValue(parameter, i) == 0) {
-          *(texture->textdata++) = 0x00000000;
-          continue;
-        }
-        break;
-      case 2:
-        if (!(rbg->paraA.coefenab)) {
-          parameter = &rbg->paraA;
-        } else {
-          if (rbg->paraB.coefenab) {
+          break;
+        case 2:
+          if (!(rbg->paraA.coefenab)) {
             parameter = &rbg->paraA;
-            if (vdp2rGetKValue(parameter, i) == 0) {
-              parameter = &rbg->paraB;
-              if( vdp2rGetKValue(parameter, i) == 0) {
-                *(texture->textdata++) = 0x00000000;
-                continue;
+          } else {
+            if (rbg->paraB.coefenab) {
+              parameter = &rbg->paraA;
+              if (vdp2rGetKValue(parameter, i) == 0) {
+                parameter = &rbg->paraB;
+                if( vdp2rGetKValue(parameter, i) == 0) {
+                  *(texture->textdata++) = 0x00000000;
+                  continue;
+                }
               }
             }
-          }
-          else {
-            parameter = &rbg->paraA;
-            if (vdp2rGetKValue(parameter, i) == 0) {
-              rbg->paraB.lineaddr = rbg->paraA.lineaddr;
-              parameter = &rbg->paraB;
+            else {
+              parameter = &rbg->paraA;
+              if (vdp2rGetKValue(parameter, i) == 0) {
+                rbg->paraB.lineaddr = rbg->paraA.lineaddr;
+                parameter = &rbg->paraB;
+              }
             }
           }
+          break;
+        default:
+          parameter = info->GetRParam(rbg, i, j, varVdp2Regs);
+          break;
+        }
+        if (parameter == NULL)
+        {
+          *(texture->textdata++) = 0x00000000;
+          continue;
         }
-        break;
-      default:
-        parameter = info->GetRParam(rbg, i, j, varVdp2Regs);
-        break;
-      }
-      if (parameter == NULL)
-      {
-        *(texture->textdata++) = 0x00000000;
-        continue;
-      }
 
-      h = (parameter->ky * (parameter->Xsp + parameter->dx * i) + parameter->Xp);
-      v = (parameter->ky * (parameter->Ysp + parameter->dy * i) + parameter->Yp);
+        h = (parameter->ky * (parameter->Xsp + parameter->dx * i) + parameter->Xp);
+        v = (parameter->ky * (parameter->Ysp + parameter->dy * i) + parameter->Yp);
+      }
 
       if (info->isbitmap)
       {
@@ -3876,7 +4131,7 @@ int VIDOGLInit(void)
 
 #ifdef SPRITE_CACHE
   if (yabsys.useVdp1cache) {
-    initPatternCache();
+    initPatternCache(yabsys.vdp1cachesize);
   }
 #endif
 
@@ -4021,15 +4276,7 @@ void VIDOGLVdp1Draw()
   _Ygl->vdp1_maxpri = maxpri;
   _Ygl->vdp1_minpri = minpri;
 
-  int firstalpha = (Vdp2External.perline_alpha_draw[0] & 0x40);
-  int prioChanged = 0;
-  int max = (yabsys.VBlankLineCount<270)?yabsys.VBlankLineCount:270;
-  for(i = 0; i<max; i++) {
-     if ((Vdp2External.perline_alpha_draw[i] & 0x40) != firstalpha) {
-       prioChanged = 1;
-       break;
-     }
-  }
+  int prioChanged = Vdp2RegChanged(Vdp2External.reglog_draw, offsetof(Vdp2, PRISA), 2, -1);
   if (prioChanged == 1) {
     u32 * linebuf;
     int line_shift = 0;
@@ -4141,13 +4388,12 @@ void VIDOGLVdp1Draw()
   _Ygl->msb_shadow_count_[_Ygl->drawframe] = 0;
 
   Vdp1DrawCommands(Vdp1Ram, Vdp1Regs, NULL);
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) YglVdp1ComputeExecute(Vdp1Ram, _Ygl->drawframe);
+#endif
   FrameProfileAdd("Vdp1Command end ");
+  YglPrefetchVDP1FB();
 
-#ifdef SPRITE_CACHE
-  if (yabsys.useVdp1cache) {
-    releasePattern();
-  }
-#endif
   _Ygl->vpd1_running = 0;
 
 }
@@ -4427,6 +4673,263 @@ printf("[(%f %f)]%f [(%f %f)]%f [(%f %f)]%f [(%f %f)]%f\n", nx[0], ny[0], entran
   return dst;
 }
 
+#ifdef YGL_VDP1_COMPUTE
+
+//////////////////////////////////////////////////////////////////////////////
+
+static INLINE int Vdp1ComputeCoord(u16 v)
+{
+  return (v & 0x400) ? (s16)(v | 0xFC00) : (s16)(v & 0x3FF);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp1ComputeSubmit(YglVdp1ComputeCmd * c, Vdp1 * regs, int nbvertex)
+{
+  int i;
+  int minx = c->vertex[0], maxx = c->vertex[0];
+  int miny = c->vertex[1], maxy = c->vertex[1];
+
+  for (i = 1; i < nbvertex; i++) {
+    minx = MIN(minx, c->vertex[2 * i]);
+    maxx = MAX(maxx, c->vertex[2 * i]);
+    miny = MIN(miny, c->vertex[2 * i + 1]);
+    maxy = MAX(maxy, c->vertex[2 * i + 1]);
+  }
+
+  minx = MAX(minx, 0);
+  miny = MAX(miny, 0);
+  maxx = MIN(maxx, regs->systemclipX2);
+  maxy = MIN(maxy, regs->systemclipY2);
+
+  // Inside user clipping, the command can not draw out of the window
+  if ((c->pmod & 0x600) == 0x400) {
+    minx = MAX(minx, c->uclip[0]);
+    miny = MAX(miny, c->uclip[1]);
+    maxx = MIN(maxx, c->uclip[2]);
+    maxy = MIN(maxy, c->uclip[3]);
+  }
+
+  if (minx > maxx || miny > maxy) return;
+
+  c->bbox[0] = minx;
+  c->bbox[1] = miny;
+  c->bbox[2] = maxx;
+  c->bbox[3] = maxy;
+  YglVdp1ComputeAdd(c);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp1ComputeLut(vdp1cmd_struct * cmd, YglVdp1ComputeCmd * c, Vdp2 * varVdp2Regs)
+{
+  u32 colorLut = cmd->CMDCOLR * 8;
+  int i;
+
+  // The CPU decoder carries priority and color calculation from pixel to
+  // pixel, here each entry of the table is resolved on its own.
+  for (i = 0; i < 16; i++) {
+    int shadow = 0;
+    int normalshadow = 0;
+    int priority = c->priority;
+    int colorcl = c->colorcl;
+    u16 temp = T1ReadWord(Vdp1Ram, (i * 2 + colorLut) & 0x7FFFF);
+    u32 color;
+
+    if (temp & 0x8000) {
+      if (c->flags & YGL_VDP1_CS_MSB)
+        color = VDP1COLOR(1, 0, priority, 1, 0);
+      else
+        color = VDP1COLOR(0, colorcl, 0, 0, VDP1COLOR16TO24(temp));
+    } else if (temp != 0x0000) {
+      Vdp1ProcessSpritePixel(varVdp2Regs->SPCTL & 0xF, &temp, &shadow, &normalshadow, &priority, &colorcl);
+      if (shadow != 0 || normalshadow != 0)
+        color = VDP1COLOR(1, 0, priority, 1, 0);
+      else if ((temp & 0x8000) && (varVdp2Regs->SPCTL & 0x20))
+        color = VDP1COLOR(0, colorcl, priority, 0, VDP1COLOR16TO24(temp));
+      else
+        color = VDP1COLOR(1, colorcl, priority, 0, temp);
+    } else {
+      color = VDP1COLOR(1, colorcl, priority, 0, 0);
+    }
+    c->lut[i] = (int)color;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp1ComputeCommand(Vdp1 * regs)
+{
+  vdp1cmd_struct cmd;
+  YglVdp1ComputeCmd c;
+  Vdp2 *varVdp2Regs = &Vdp2Lines[0];
+  int x[4], y[4];
+  int gouraud[4] = { 0, 0, 0, 0 };
+  int textured = 1;
+  int i;
+
+  Vdp1ReadCommand(&cmd, regs->addr, Vdp1Ram);
+
+  memset(&c, 0, sizeof(c));
+  c.type = YGL_VDP1_CS_QUAD;
+  c.pmod = cmd.CMDPMOD;
+  c.dir = (cmd.CMDCTRL & 0x30) >> 4;
+  c.uclip[0] = regs->userclipX1;
+  c.uclip[1] = regs->userclipY1;
+  c.uclip[2] = regs->userclipX2;
+  c.uclip[3] = regs->userclipY2;
+  c.texw = ((cmd.CMDSIZE >> 8) & 0x3F) * 8;
+  c.texh = cmd.CMDSIZE & 0xFF;
+
+  x[0] = Vdp1ComputeCoord(cmd.CMDXA) + regs->localX;
+  y[0] = Vdp1ComputeCoord(cmd.CMDYA) + regs->localY;
+  x[1] = Vdp1ComputeCoord(cmd.CMDXB) + regs->localX;
+  y[1] = Vdp1ComputeCoord(cmd.CMDYB) + regs->localY;
+  x[2] = Vdp1ComputeCoord(cmd.CMDXC) + regs->localX;
+  y[2] = Vdp1ComputeCoord(cmd.CMDYC) + regs->localY;
+  x[3] = Vdp1ComputeCoord(cmd.CMDXD) + regs->localX;
+  y[3] = Vdp1ComputeCoord(cmd.CMDYD) + regs->localY;
+
+  switch (cmd.CMDCTRL & 0xF) {
+  case 0: // Normal sprite
+    if (cmd.CMDSIZE & 0x8000) {
+      regs->EDSR |= 2;
+      return; // BAD Command
+    }
+    if (c.texw == 0 || c.texh == 0) return;
+    x[1] = x[2] = x[0] + c.texw - 1;
+    y[1] = y[0];
+    x[3] = x[0];
+    y[2] = y[3] = y[0] + c.texh - 1;
+    break;
+  case 1: // Scaled sprite
+  {
+    int rw = 0, rh = 0;
+    if (cmd.CMDSIZE == 0) return;
+    switch ((cmd.CMDCTRL & 0xF00) >> 8) {
+    case 0x0: // Only two coordinates
+      rw = x[2] - x[0];
+      rh = y[2] - y[0];
+      break;
+    case 0x5: // Upper-left
+      rw = Vdp1ComputeCoord(cmd.CMDXB);
+      rh = Vdp1ComputeCoord(cmd.CMDYB);
+      break;
+    case 0x6: // Upper-Center
+    case 0x7: // Upper-Right
+    case 0x9: // Center-left
+    case 0xA: // Center-center
+    case 0xB: // Center-right
+    case 0xD: // Lower-left
+    case 0xE: // Lower-center
+    case 0xF: // Lower-right
+      rw = Vdp1ComputeCoord(cmd.CMDXB);
+      rh = Vdp1ComputeCoord(cmd.CMDYB);
+      if ((cmd.CMDCTRL & 0x300) == 0x200) x[0] -= rw / 2;
+      if ((cmd.CMDCTRL & 0x300) == 0x300) x[0] -= rw;
+      if ((cmd.CMDCTRL & 0xC00) == 0x800) y[0] -= rh / 2;
+      if ((cmd.CMDCTRL & 0xC00) == 0xC00) y[0] -= rh;
+      break;
+    default: break;
+    }
+    x[1] = x[2] = x[0] + rw;
+    y[1] = y[0];
+    x[3] = x[0];
+    y[2] = y[3] = y[0] + rh;
+    break;
+  }
+  case 2: // Distorted sprite
+  case 3:
+    if (cmd.CMDSIZE == 0) return;
+    if (c.texh != 0 && c.texw == 0) {
+      c.texw = 8;
+      c.texh = 8;
+    }
+    if (c.texw == 0 || c.texh == 0) return;
+    break;
+  case 4: // Polygon
+  case 5: // Polyline
+  case 7:
+  case 6: // Line
+  {
+    vdp1cmd_struct color_cmd;
+    memcpy(&color_cmd, &cmd, sizeof(color_cmd));
+    c.color = (int)Vdp1ReadPolygonColor(&color_cmd, varVdp2Regs);
+    if (c.color == 0) return;
+    textured = 0;
+    break;
+  }
+  default:
+    return;
+  }
+
+  if (cmd.CMDPMOD & 0x4) {
+    for (i = 0; i < 4; i++)
+      gouraud[i] = T1ReadWord(Vdp1Ram, (cmd.CMDGRDA << 3) + (i << 1));
+  }
+
+  if (textured) {
+    int mode = (cmd.CMDPMOD >> 3) & 0x7;
+    if (mode > 5) return;
+
+    c.flags = YGL_VDP1_CS_TEXTURED | YGL_VDP1_CS_AA | YGL_VDP1_CS_SPRTYPE(varVdp2Regs->SPCTL);
+    if (cmd.CMDPMOD & 0x40) c.flags |= YGL_VDP1_CS_SPD;
+    if (cmd.CMDPMOD & 0x80) c.flags |= YGL_VDP1_CS_ECD;
+    if (cmd.CMDPMOD & 0x8000) {
+      c.flags |= YGL_VDP1_CS_MSB;
+      _Ygl->msb_shadow_count_[_Ygl->drawframe]++;
+    }
+    if (varVdp2Regs->SPCTL & 0x20) c.flags |= YGL_VDP1_CS_RGB;
+    c.srcaddr = cmd.CMDSRCA * 8;
+
+    Vdp1ReadPriority(&cmd, &c.priority, &c.colorcl, &c.normalshadow, varVdp2Regs);
+    switch (mode) {
+    case 0: c.colorbank = cmd.CMDCOLR & 0xFFF0; break;
+    case 1: Vdp1ComputeLut(&cmd, &c, varVdp2Regs); break;
+    case 2: c.colorbank = cmd.CMDCOLR & 0xFFC0; break;
+    case 3: c.colorbank = cmd.CMDCOLR & 0xFF80; break;
+    case 4: c.colorbank = cmd.CMDCOLR & 0xFF00; break;
+    default: break;
+    }
+  }
+
+  switch (cmd.CMDCTRL & 0xF) {
+  case 5: // Polyline
+  case 7:
+    c.type = YGL_VDP1_CS_LINE;
+    for (i = 0; i < 4; i++) {
+      c.vertex[0] = x[i];
+      c.vertex[1] = y[i];
+      c.vertex[2] = x[(i + 1) & 3];
+      c.vertex[3] = y[(i + 1) & 3];
+      c.gouraud[0] = gouraud[i];
+      c.gouraud[1] = gouraud[(i + 1) & 3];
+      Vdp1ComputeSubmit(&c, regs, 2);
+    }
+    break;
+  case 6: // Line
+    c.type = YGL_VDP1_CS_LINE;
+    c.vertex[0] = x[0];
+    c.vertex[1] = y[0];
+    c.vertex[2] = x[1];
+    c.vertex[3] = y[1];
+    c.gouraud[0] = gouraud[0];
+    c.gouraud[1] = gouraud[1];
+    Vdp1ComputeSubmit(&c, regs, 2);
+    break;
+  default:
+    for (i = 0; i < 4; i++) {
+      c.vertex[2 * i] = x[i];
+      c.vertex[2 * i + 1] = y[i];
+      c.gouraud[i] = gouraud[i];
+    }
+    Vdp1ComputeSubmit(&c, regs, 4);
+    break;
+  }
+}
+
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 
 void VIDOGLVdp1NormalSpriteDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
@@ -4446,6 +4949,12 @@ void VIDOGLVdp1NormalSpriteDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   Vdp2 *varVdp2Regs = &Vdp2Lines[0];
   float vert[8];
 
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   Vdp1ReadCommand(&cmd, Vdp1Regs->addr, Vdp1Ram);
   if ((cmd.CMDSIZE & 0x8000)) {
     regs->EDSR |= 2;
@@ -4589,6 +5098,12 @@ void VIDOGLVdp1ScaledSpriteDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   int i;
   Vdp2 *varVdp2Regs = &Vdp2Lines[0];
 
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   Vdp1ReadCommand(&cmd, Vdp1Regs->addr, Vdp1Ram);
   if (cmd.CMDSIZE == 0) {
     return; // BAD Command
@@ -4813,6 +5328,12 @@ void VIDOGLVdp1DistortedSpriteDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   int isSquare;
   Vdp2 *varVdp2Regs = &Vdp2Lines[0];
 
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   Vdp1ReadCommand(&cmd, Vdp1Regs->addr, Vdp1Ram);
   if (cmd.CMDSIZE == 0) {
     return; // BAD Command
@@ -5066,6 +5587,12 @@ void VIDOGLVdp1PolygonDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   vdp1cmd_struct cmd;
   float line_polygon[8];
   Vdp2 *varVdp2Regs = &Vdp2Lines[0];
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   sprite.linescreen = 0;
 
   Vdp1ReadCommand(&cmd, Vdp1Regs->addr, Vdp1Ram);
@@ -5195,6 +5722,12 @@ void VIDOGLVdp1PolylineDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   int normalshadow = 0;
   int colorcalc = 0;
   Vdp2 *varVdp2Regs = &Vdp2Lines[0];
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   polygon.blendmode = VDP1_COLOR_CL_REPLACE;
   polygon.linescreen = 0;
   polygon.dst = 0;
@@ -5460,6 +5993,12 @@ void VIDOGLVdp1LineDraw(u8 * ram, Vdp1 * regs, u8* back_framebuffer)
   int normalshadow = 0;
   int colorcalc = 0;
   u16 color2;
+#ifdef YGL_VDP1_COMPUTE
+  if (_Ygl->polygonmode == GPU_COMPUTE) {
+    Vdp1ComputeCommand(regs);
+    return;
+  }
+#endif
   polygon.cor = 0x00;
   polygon.cog = 0x00;
   polygon.cob = 0x00;
@@ -5640,6 +6179,7 @@ void VIDOGLVdp2Draw(void)
     int new_height = YglTM_vdp2->height;
     YglTMDeInit(YglTM_vdp2);
     YglTM_vdp2 = YglTMInit(new_width, new_height);
+    YglTMSetPersistentBudget(YglTM_vdp2, YGL_TM_PERSISTENT_BUDGET);
   }
   YglTmPull(YglTM_vdp2, 0);
 
@@ -6177,6 +6717,27 @@ int sameVDP2RegRBG1(Vdp2 *a, Vdp2 *b)
   return 1;
 }
 
+// Uses the register change log to tell that nothing sameVDP2Reg looks at
+// was written on this line, so the full compare can be skipped
+static int sameVDP2RegLog(int id, int line)
+{
+  Vdp2RegLog_struct *log = Vdp2External.reglog;
+  if (Vdp2RegChanged(log, offsetof(Vdp2, BGON), 2, line)) return 0;
+  if (Vdp2RegChanged(log, offsetof(Vdp2, RPTA), 4, line)) return 0;
+  switch (id) {
+    case RBG0:
+      if (Vdp2RegChanged(log, offsetof(Vdp2, PRIR), 2, line)) return 0;
+      if (Vdp2RegChanged(log, offsetof(Vdp2, RPMD), 2, line)) return 0;
+      return 1;
+    case RBG1:
+      if (Vdp2RegChanged(log, offsetof(Vdp2, PRINA), 2, line)) return 0;
+      return 1;
+    default:
+    break;
+  }
+  return 1;
+}
+
 int sameVDP2Reg(int id, Vdp2 *a, Vdp2 *b)
 {
   switch (id) {
@@ -6196,7 +6757,7 @@ static void Vdp2DrawRBG1(Vdp2 *varVdp2Regs)
   int max = (yabsys.VBlankLineCount >= 270)?270:yabsys.VBlankLineCount;
   RBGDrawInfo *rgb;
   for (line = 2; line<max; line++) {
-    if (!sameVDP2Reg(RBG1, &Vdp2Lines[line-1], &Vdp2Lines[line])) {
+    if (!sameVDP2RegLog(RBG1, line) && !sameVDP2Reg(RBG1, &Vdp2Lines[line-1], &Vdp2Lines[line])) {
       rgb = (RBGDrawInfo *)calloc(1, sizeof(RBGDrawInfo));
       rgb->rgb_type = 0x04;
       rgb->info.startLine = lastLine;
@@ -7079,10 +7640,6 @@ static void Vdp2DrawRBG0_part( RBGDrawInfo *rgb, Vdp2* varVdp2Regs)
 
   Vdp2ReadRotationTable(0, &rgb->paraA, varVdp2Regs, Vdp2Ram);
   Vdp2ReadRotationTable(1, &rgb->paraB, varVdp2Regs, Vdp2Ram);
-  A0_Updated = 0;
-  A1_Updated = 0;
-  B0_Updated = 0;
-  B1_Updated = 0;
 
   rgb->paraA.PlaneAddr = (void FASTCALL(*)(void *, int, Vdp2*))&Vdp2ParameterAPlaneAddr;
   rgb->paraB.PlaneAddr = (void FASTCALL(*)(void *, int, Vdp2*))&Vdp2ParameterBPlaneAddr;
@@ -7390,7 +7947,7 @@ static void Vdp2DrawRBG0(Vdp2* varVdp2Regs)
   int max = (yabsys.VBlankLineCount >= 270)?270:yabsys.VBlankLineCount;
   RBGDrawInfo *rgb;
   for (line = 2; line<max; line++) {
-    if (!sameVDP2Reg(RBG0, &Vdp2Lines[line-1], &Vdp2Lines[line])) {
+    if (!sameVDP2RegLog(RBG0, line) && !sameVDP2Reg(RBG0, &Vdp2Lines[line-1], &Vdp2Lines[line])) {
       rgb = (RBGDrawInfo *)calloc(1, sizeof(RBGDrawInfo));
       rgb->rgb_type = 0x0;
       rgb->info.startLine = lastLine;
@@ -7498,9 +8055,9 @@ void waitVdp2DrawScreensEnd(int sync) {
     if (empty == 0) {
       //Vdp2 has been evaluated we can render
       YglTmPush(YglTM_vdp2);
-      YuiUseOGLOnThisThread();
+      if (!YglPresentIsRunning()) YuiUseOGLOnThisThread();
       YglUpdateVDP1FB();
-      YuiRevokeOGLOnThisThread();
+      if (!YglPresentIsRunning()) YuiRevokeOGLOnThisThread();
       YglRender(&Vdp2Lines[0]);
     }
   }
@@ -7954,6 +8511,16 @@ void VIDOGLSetSettingValueMode(int type, int value) {
         YuiMsg("GPU tesselation is not possible - fallback on CPU tesselation\n");
         _Ygl->polygonmode = CPU_TESSERATION;
       }
+    } else if (value == GPU_COMPUTE && _Ygl->polygonmode != GPU_COMPUTE) {
+#ifdef YGL_VDP1_COMPUTE
+      if (YglVdp1ComputeInit() == 0) {
+        _Ygl->polygonmode = value;
+      } else
+#endif
+      {
+        YuiMsg("VDP1 compute rasterizer is not possible - fallback on perspective correction\n");
+        _Ygl->polygonmode = PERSPECTIVE_CORRECTION;
+      }
     } else {
 
 
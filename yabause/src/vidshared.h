@@ -95,6 +95,8 @@ typedef struct
    u32 PlaneAddrv[16];
    u8 k_mem_type;
    u16 over_pattern_name;
+   int klastindex;
+   int klastret;
    
 } vdp2rotationparameter_struct;
 
@@ -336,6 +338,30 @@ static INLINE int GenerateRotatedYPosFP(vdp2rotationparameterfp_struct *p, int x
 
 //////////////////////////////////////////////////////////////////////////////
 
+// Widest line the rotation renderers generate coordinates for in one go
+#define VDP2_ROTATION_SPAN_MAX 704
+
+// Generates the rotated coordinates of a whole line at once. Results are the
+// same as GenerateRotatedXPosFP/GenerateRotatedYPosFP for x = 0..count-1, as
+// long as kx, ky and Xp stay constant over the line. The loop has no branch
+// or dependency between pixels so the compiler can vectorize it.
+static INLINE void GenerateRotatedSpanFP(vdp2rotationparameterfp_struct *p, int count, fixed32 xmul, fixed32 ymul, fixed32 C, fixed32 F, int xmask, int ymask, int *xpos, int *ypos)
+{
+   fixed32 Xsp = mulfixed(p->A, xmul) + mulfixed(p->B, ymul) + C;
+   fixed32 Ysp = mulfixed(p->D, xmul) + mulfixed(p->E, ymul) + F;
+   fixed32 kx = p->kx, ky = p->ky, Xp = p->Xp, Yp = p->Yp, dX = p->dX, dY = p->dY;
+   int i;
+
+   for (i = 0; i < count; i++)
+   {
+      // mulfixed(d, tofixed(i)) is exactly d * i
+      xpos[i] = touint(mulfixed(kx, (Xsp + (fixed32)((s64)dX * i))) + Xp) & xmask;
+      ypos[i] = touint(mulfixed(ky, (Ysp + (fixed32)((s64)dY * i))) + Yp) & ymask;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 static INLINE void CalculateRotationValues(vdp2rotationparameter_struct *p)
 {
    p->Xp=p->A * (p->Px - p->Cx) +
@@ -104,6 +104,7 @@ void VIDSoftSync(){};
 void VIDSoftVdp2DispOff(void);void VidsoftDrawSprite(Vdp2 * vdp2_regs, u8 * sprite_window_mask, u8* vdp1_front_framebuffer, u8 * vdp2_ram, Vdp1* vdp1_regs, Vdp2* vdp2_lines, u8*color_ram);
 void VIDSoftGetNativeResolution(int *width, int *height, int*interlace);
 void VIDSoftVdp2DispOff(void);void VIDSoftVdp2DispOff(void);
+int VIDSoftGetThumbnail(u8 **pixels, int *width, int *height);
 
 VideoInterface_struct VIDSoft = {
 VIDCORE_SOFT,
@@ -137,7 +138,8 @@ VIDSoftGetGlSize,
 VIDSoftSetSettingValueMode,
 VIDSoftSync,
 VIDSoftGetNativeResolution,
-VIDSoftVdp2DispOff
+VIDSoftVdp2DispOff,
+VIDSoftGetThumbnail
 };
 
 pixel_t *dispbuffer=NULL;
@@ -429,6 +431,195 @@ static INLINE int Vdp2FetchPixel(vdp2draw_struct *info, int x, int y, u32 *color
 
 //////////////////////////////////////////////////////////////////////////////
 
+// Decoded cell cache: tile layers (NBG0-3/RBG1 and RBG0) look up already
+// decoded 8x8 cells instead of going through Vdp2FetchPixel for every pixel.
+// 16x16 patterns are handled as their four consecutive 8x8 cells. Flip is
+// applied by Vdp2MapCalcXY to the coordinates, so a cell is decoded unflipped
+// and shared by all flip states.
+// Entries are dropped in Vdp2CellCacheInvalidate when the VRAM pages or the
+// color RAM blocks they were decoded from show up in the per-frame dirty
+// bitmaps latched by Vdp2LatchDirty.
+
+#define VDP2_CELL_CACHE_LAYERS 5
+#define VDP2_CELL_CACHE_SIZE 2048
+
+typedef struct
+{
+   u32 celladdr;
+   u32 paladdr;
+   u8 colornumber;
+   u8 transparencyenable;
+   u16 firstpage;
+   u16 lastpage;
+   u32 crammask;
+   u64 opaque;
+   u32 color[64];
+   u32 dot[64];
+} vdp2cellcache_struct;
+
+static vdp2cellcache_struct * vdp2_cell_cache[VDP2_CELL_CACHE_LAYERS];
+
+static const int vdp2_cell_bytes[5] = { 32, 64, 128, 128, 256 };
+
+//////////////////////////////////////////////////////////////////////////////
+
+static u32 Vdp2CellCacheCramMask(vdp2draw_struct *info, int paladdr)
+{
+   u32 start, count, first, last;
+
+   switch (info->colornumber)
+   {
+      case 0: count = 16; break;
+      case 1: count = 256; break;
+      case 2: count = 2048; break;
+      default: return 0; // RGB cells don't use color ram
+   }
+
+   start = info->coloroffset + paladdr;
+   if (Vdp2Internal.ColorMode == 2)
+   {
+      start <<= 2;
+      count <<= 2;
+   }
+   else
+   {
+      start <<= 1;
+      count <<= 1;
+   }
+
+   if (count >= 0x1000)
+      return 0xFFFFFFFF;
+
+   start &= 0xFFF;
+   first = start >> VDP2_COLOR_RAM_BLOCK_SHIFT;
+   last = ((start + count - 1) & 0xFFF) >> VDP2_COLOR_RAM_BLOCK_SHIFT;
+   if (last >= first)
+      return (u32)((((u64)2 << last) - 1) & ~((1ULL << first) - 1));
+   // palette wraps around the end of color ram
+   return (u32)((((u64)2 << last) - 1) | ~((1ULL << first) - 1));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp2CellCacheDecode(vdp2cellcache_struct *cell, vdp2draw_struct *info, u32 celladdr, int paladdr, u8 * ram, u8* vdp2_color_ram)
+{
+   int i;
+   u32 end = (celladdr + vdp2_cell_bytes[info->colornumber] - 1) & 0x7FFFF;
+
+   cell->celladdr = celladdr;
+   cell->paladdr = info->coloroffset + paladdr;
+   cell->colornumber = info->colornumber;
+   cell->transparencyenable = info->transparencyenable;
+   cell->firstpage = (celladdr & 0x7FFFF) >> VDP2_RAM_PAGE_SHIFT;
+   cell->lastpage = end >> VDP2_RAM_PAGE_SHIFT;
+   cell->crammask = Vdp2CellCacheCramMask(info, paladdr);
+   cell->opaque = 0;
+
+   for (i = 0; i < 64; i++)
+   {
+      cell->color[i] = 0;
+      if (Vdp2FetchPixel(info, i & 7, i >> 3, &cell->color[i], &cell->dot[i], ram, celladdr, paladdr, vdp2_color_ram))
+         cell->opaque |= 1ULL << i;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static INLINE int Vdp2FetchCachedPixel(vdp2draw_struct *info, vdp2cellcache_struct **last, int x, int y, u32 *color, u32 *dot, u8 * ram, int charaddr, int paladdr, u8* vdp2_color_ram)
+{
+   vdp2cellcache_struct *cell = *last;
+   vdp2cellcache_struct *cache = vdp2_cell_cache[info->titan_which_layer];
+   u32 celladdr = charaddr + (y >> 3) * vdp2_cell_bytes[info->colornumber];
+   u32 pal = info->coloroffset + paladdr;
+   int i;
+
+   if (cache == NULL || info->colornumber > 4)
+      return Vdp2FetchPixel(info, x, y, color, dot, ram, charaddr, paladdr, vdp2_color_ram);
+
+   if (cell == NULL || cell->celladdr != celladdr || cell->paladdr != pal ||
+       cell->colornumber != info->colornumber || cell->transparencyenable != info->transparencyenable)
+   {
+      cell = &cache[((celladdr >> 5) ^ (pal * 0x9E5)) & (VDP2_CELL_CACHE_SIZE - 1)];
+      if (cell->celladdr != celladdr || cell->paladdr != pal ||
+          cell->colornumber != info->colornumber || cell->transparencyenable != info->transparencyenable)
+         Vdp2CellCacheDecode(cell, info, celladdr, paladdr, ram, vdp2_color_ram);
+      *last = cell;
+   }
+
+   i = ((y & 7) << 3) | x;
+   if (!(cell->opaque & (1ULL << i)))
+      return 0;
+   *color = cell->color[i];
+   *dot = cell->dot[i];
+   return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp2CellCacheInvalidate(void)
+{
+   u32 *vram = Vdp2RamDirtyFrame;
+   u32 cram = Vdp2ColorRamDirtyFrame;
+   u32 any = cram;
+   int i, j;
+
+   for (i = 0; i < VDP2_RAM_DIRTY_WORDS; i++)
+      any |= vram[i];
+
+   if (!any)
+      return;
+
+   for (i = 0; i < VDP2_CELL_CACHE_LAYERS; i++)
+   {
+      vdp2cellcache_struct *cache = vdp2_cell_cache[i];
+      if (cache == NULL)
+         continue;
+
+      for (j = 0; j < VDP2_CELL_CACHE_SIZE; j++)
+      {
+         vdp2cellcache_struct *cell = &cache[j];
+         if (cell->celladdr == 0xFFFFFFFF)
+            continue;
+         if ((cell->crammask & cram) ||
+             (vram[cell->firstpage >> 5] & (1 << (cell->firstpage & 0x1F))) ||
+             (vram[cell->lastpage >> 5] & (1 << (cell->lastpage & 0x1F))))
+            cell->celladdr = 0xFFFFFFFF;
+      }
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp2CellCacheInit(void)
+{
+   int i, j;
+
+   for (i = 0; i < VDP2_CELL_CACHE_LAYERS; i++)
+   {
+      vdp2_cell_cache[i] = (vdp2cellcache_struct *)malloc(sizeof(vdp2cellcache_struct) * VDP2_CELL_CACHE_SIZE);
+      if (vdp2_cell_cache[i] == NULL)
+         continue;
+      for (j = 0; j < VDP2_CELL_CACHE_SIZE; j++)
+         vdp2_cell_cache[i][j].celladdr = 0xFFFFFFFF;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Vdp2CellCacheDeInit(void)
+{
+   int i;
+
+   for (i = 0; i < VDP2_CELL_CACHE_LAYERS; i++)
+   {
+      if (vdp2_cell_cache[i])
+         free(vdp2_cell_cache[i]);
+      vdp2_cell_cache[i] = NULL;
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 static INLINE int TestWindow(int wctl, int enablemask, int inoutmask, clipping_struct *clip, int x, int y)
 {
    if (wctl & enablemask) 
@@ -790,6 +981,8 @@ static void FASTCALL Vdp2DrawScroll(vdp2draw_struct *info, Vdp2* lines, Vdp2* re
    u32 linescrolly_table[512] = { 0 };
    float lineszoom_table[512] = { 0 };
    int num_vertical_cell_scroll_enabled = 0;
+   vdp2cellcache_struct *lastcell = NULL;
+   int use_cell_cache = !info->isbitmap && info->titan_which_layer >= 0 && info->titan_which_layer < VDP2_CELL_CACHE_LAYERS;
 
    SetupScreenVars(info, &sinfo, info->PlaneAddr, regs);
 
@@ -989,7 +1182,12 @@ static void FASTCALL Vdp2DrawScroll(vdp2draw_struct *info, Vdp2* lines, Vdp2* re
             paladdr = info->pipe[0].paladdr;
          }
 
-         if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, charaddr, paladdr,color_ram))
+         if (use_cell_cache)
+         {
+            if (!Vdp2FetchCachedPixel(info, &lastcell, x, y, &color, &dot, ram, charaddr, paladdr, color_ram))
+               continue;
+         }
+         else if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, charaddr, paladdr,color_ram))
          {
             continue;
          }
@@ -1089,6 +1287,10 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
    vdp2rotationparameterfp_struct *p=&parameter[info->rotatenum];
    clipping_struct clip[2];
    u32 linewnd0addr, linewnd1addr;
+   int xpos[VDP2_ROTATION_SPAN_MAX], ypos[VDP2_ROTATION_SPAN_MAX];
+   int use_span = (rbg0width <= VDP2_ROTATION_SPAN_MAX);
+   vdp2cellcache_struct *lastcell = NULL;
+   int use_cell_cache = !info->isbitmap && info->titan_which_layer >= 0 && info->titan_which_layer < VDP2_CELL_CACHE_LAYERS;
 
    clip[0].xstart = clip[0].ystart = clip[0].xend = clip[0].yend = 0;
    clip[1].xstart = clip[1].ystart = clip[1].xend = clip[1].yend = 0;
@@ -1125,6 +1327,9 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
             info->LoadLineParams(info, &sinfo, j, lines);
             ReadLineWindowClip(info->islinewindow, clip, &linewnd0addr, &linewnd1addr, ram, regs);
 
+            if (use_span)
+               GenerateRotatedSpanFP(p, rbg0width, xmul, ymul, C, F, sinfo.xmask, sinfo.ymask, xpos, ypos);
+
             for (i = 0; i < rbg0width; i++)
             {
                u32 color, dot;
@@ -1132,8 +1337,16 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
                if (!TestBothWindow(info->wctl, clip, i, j))
                   continue;
 
-               x = GenerateRotatedXPosFP(p, i, xmul, ymul, C) & sinfo.xmask;
-               y = GenerateRotatedYPosFP(p, i, xmul, ymul, F) & sinfo.ymask;
+               if (use_span)
+               {
+                  x = xpos[i];
+                  y = ypos[i];
+               }
+               else
+               {
+                  x = GenerateRotatedXPosFP(p, i, xmul, ymul, C) & sinfo.xmask;
+                  y = GenerateRotatedYPosFP(p, i, xmul, ymul, F) & sinfo.ymask;
+               }
 
                // Convert coordinates into graphics
                if (!info->isbitmap)
@@ -1143,7 +1356,12 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
                }
  
                // Fetch pixel
-               if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, info->charaddr,info->paladdr, color_ram))
+               if (use_cell_cache)
+               {
+                  if (!Vdp2FetchCachedPixel(info, &lastcell, x, y, &color, &dot, ram, info->charaddr, info->paladdr, color_ram))
+                     continue;
+               }
+               else if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, info->charaddr,info->paladdr, color_ram))
                {
                   continue;
                }
@@ -1165,11 +1383,14 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
       u32 lineAddr, lineColor, lineInc;
       u16 lineColorAddr;
 
-      fixed32 xmul2, ymul2, C2, F2;
+      fixed32 xmul2 = 0, ymul2 = 0, C2 = 0, F2 = 0;
       u32 coefx2, coefy2;
       u32 rcoefx2, rcoefy2;
       screeninfo_struct sinfo2;
       vdp2rotationparameterfp_struct *p2 = NULL;
+      u32 coefaddr, lastcoefaddr = 0xFFFFFFFF, lastcoefaddr2 = 0xFFFFFFFF;
+      int xpos2[VDP2_ROTATION_SPAN_MAX], ypos2[VDP2_ROTATION_SPAN_MAX];
+      int line_span;
 
       clipping_struct rpwindow[2];
       int userpwindow = 0;
@@ -1265,25 +1486,46 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
          if (userpwindow)
             ReadLineWindowClip(isrplinewindow, rpwindow, &rplinewnd0addr, &rplinewnd1addr, ram, regs);
 
+         // With one coefficient per line the parameters are constant over the
+         // line, so coordinates can be generated for the whole span up front
+         line_span = use_span && (p->deltaKAx == 0) &&
+                     ((p2 == NULL) || !p2->coefenab || (p2->deltaKAx == 0));
+         if (line_span)
+         {
+            GenerateRotatedSpanFP(p, rbg0width, xmul, ymul, C, F, 0xFFFF, 0xFFFF, xpos, ypos);
+            if (p2 != NULL)
+               GenerateRotatedSpanFP(p2, rbg0width, xmul2, ymul2, C2, F2, 0xFFFF, 0xFFFF, xpos2, ypos2);
+         }
+
          for (i = 0; i < rbg0width; i++)
          {
             u32 color, dot;
 
+            // Coefficient reads only have an effect when the table entry changes,
+            // which is every few pixels at most with usual deltaKAx values
             if (p->deltaKAx != 0)
             {
-               Vdp2ReadCoefficientFP(p,
-                                     p->coeftbladdr +
-                                     (coefy + coefx + toint(rcoefx + rcoefy)) *
-                                     p->coefdatasize, ram);
+               coefaddr = p->coeftbladdr +
+                          (coefy + coefx + toint(rcoefx + rcoefy)) *
+                          p->coefdatasize;
+               if (coefaddr != lastcoefaddr)
+               {
+                  Vdp2ReadCoefficientFP(p, coefaddr, ram);
+                  lastcoefaddr = coefaddr;
+               }
                coefx += toint(p->deltaKAx);
                rcoefx += decipart(p->deltaKAx);
             }
             if ((p2 != NULL) && p2->coefenab && (p2->deltaKAx != 0))
             {
-               Vdp2ReadCoefficientFP(p2,
-                                     p2->coeftbladdr +
-                                     (coefy2 + coefx2 + toint(rcoefx2 + rcoefy2)) *
-                                     p2->coefdatasize, ram);
+               coefaddr = p2->coeftbladdr +
+                          (coefy2 + coefx2 + toint(rcoefx2 + rcoefy2)) *
+                          p2->coefdatasize;
+               if (coefaddr != lastcoefaddr2)
+               {
+                  Vdp2ReadCoefficientFP(p2, coefaddr, ram);
+                  lastcoefaddr2 = coefaddr;
+               }
                coefx2 += toint(p2->deltaKAx);
                rcoefx2 += decipart(p2->deltaKAx);
             }
@@ -1295,8 +1537,16 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
             {
                if ((p2 == NULL) || (p2->coefenab && p2->msb)) continue;
 
-               x = GenerateRotatedXPosFP(p2, i, xmul2, ymul2, C2);
-               y = GenerateRotatedYPosFP(p2, i, xmul2, ymul2, F2);
+               if (line_span)
+               {
+                  x = xpos2[i];
+                  y = ypos2[i];
+               }
+               else
+               {
+                  x = GenerateRotatedXPosFP(p2, i, xmul2, ymul2, C2);
+                  y = GenerateRotatedYPosFP(p2, i, xmul2, ymul2, F2);
+               }
 
                switch(p2->screenover) {
                   case 0:
@@ -1325,8 +1575,16 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
             else if (p->msb) continue;
             else
             {
-               x = GenerateRotatedXPosFP(p, i, xmul, ymul, C);
-               y = GenerateRotatedYPosFP(p, i, xmul, ymul, F);
+               if (line_span)
+               {
+                  x = xpos[i];
+                  y = ypos[i];
+               }
+               else
+               {
+                  x = GenerateRotatedXPosFP(p, i, xmul, ymul, C);
+                  y = GenerateRotatedYPosFP(p, i, xmul, ymul, F);
+               }
 
                switch(p->screenover) {
                   case 0:
@@ -1354,7 +1612,12 @@ static void FASTCALL Vdp2DrawRotationFP(vdp2draw_struct *info, vdp2rotationparam
             }
 
             // Fetch pixel
-            if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, info->charaddr, info->paladdr, color_ram))
+            if (use_cell_cache)
+            {
+               if (!Vdp2FetchCachedPixel(info, &lastcell, x, y, &color, &dot, ram, info->charaddr, info->paladdr, color_ram))
+                  continue;
+            }
+            else if (!Vdp2FetchPixel(info, x, y, &color, &dot, ram, info->charaddr, info->paladdr, color_ram))
             {
                continue;
             }
@@ -2131,6 +2394,8 @@ int VIDSoftInit(void)
    rbg0width = vdp2width = 320;
    vdp2height = 224;
 
+   Vdp2CellCacheInit();
+
 #ifdef USE_OPENGL
    VIDSoftSetupGL();
 #endif
@@ -2290,6 +2555,8 @@ void VIDSoftDeInit(void)
 
    if (vdp1framebuffer[1])
       free(vdp1framebuffer[1]);
+
+   Vdp2CellCacheDeInit();
   
 #if !defined(ANDROID)  
 #ifdef USE_OPENGL
@@ -3032,7 +3299,7 @@ static void drawQuad(s16 tl_x, s16 tl_y, s16 bl_x, s16 bl_y, s16 tr_x, s16 tr_y,
 	double rightLineStep = 1; 
 
 	//a lookup table for the gouraud colors
-	COLOR colors[4];
+	COLOR colors[4] = { { { 0 } } };
 
    if (is_pre_clipped(tl_x, tl_y, bl_x, bl_y, tr_x, tr_y, br_x, br_y, regs))
       return;
@@ -3811,6 +4078,7 @@ void VIDSoftVdp2Draw(void)
 {
 
    VIDSoftVdp2DrawStart();
+   Vdp2CellCacheInvalidate();
 
    if (Vdp2Regs->TVMD & 0x8000) {
      VIDSoftVdp2DrawScreens();
@@ -3969,6 +4237,7 @@ static void VIDSoftVdp2DrawScreens(void)
 void VIDSoftVdp2DrawScreen(int screen)
 {
    VIDSoftVdp2SetResolution(Vdp2Regs->TVMD);
+   Vdp2CellCacheInvalidate();
 
    switch(screen)
    {
@@ -4146,3 +4415,28 @@ void VIDSoftVdp2DispOff()
 {
    TitanErase();
 }
+
+//////////////////////////////////////////////////////////////////////////////
+
+int VIDSoftGetThumbnail(u8 **pixels, int *width, int *height)
+{
+   int y;
+   *pixels = NULL;
+   *width = 0;
+   *height = 0;
+#ifdef USE_16BPP
+   return -1;
+#else
+   if ((dispbuffer == NULL) || (vdp2width <= 0) || (vdp2height <= 0))
+      return -1;
+   if ((*pixels = (u8 *)malloc(vdp2width * vdp2height * 4)) == NULL)
+      return -1;
+   // The display buffer is top row first, thumbnails are stored like the
+   // output of glReadPixels
+   for (y = 0; y < vdp2height; y++)
+      memcpy(*pixels + y * vdp2width * 4, dispbuffer + (vdp2height - 1 - y) * vdp2width, vdp2width * 4);
+   *width = vdp2width;
+   *height = vdp2height;
+   return 0;
+#endif
+}
@@ -49,6 +49,10 @@
 #include "yui.h"
 #include "bios.h"
 #include "movie.h"
+#include "rewind.h"
+#include "audit.h"
+#include "frameskip.h"
+#include "statefile.h"
 #include "osdcore.h"
 #include "stv.h"
 
@@ -138,14 +142,21 @@ void print_usage(const char *program_name) {
 
 unsigned long nextFrameTime = 0;
 static int autoframeskipenab=0;
+static int fastforwardinterval=0;
+static int fastforwardthrottle=0;
+static u32 fastforwardcount=0;
 
-static void syncVideoMode(void) {
+static void syncVideoMode(int realtime) {
   unsigned long sleep = 0;
-  unsigned long now = YabauseGetTicks();
+  unsigned long now;
+  // Frames emulated without being shown are not paced, unless the
+  // frameskip left them out to keep up with real time
+  if (yabsys.skipRender && !realtime) return;
+  now = YabauseGetTicks();
   if (nextFrameTime == 0) nextFrameTime = YabauseGetTicks();
   if(nextFrameTime > now)
     sleep = ((nextFrameTime - now)*1000000.0)/yabsys.tickfreq;
-  if (isAutoFrameSkip() == 0) YabThreadUSleep(sleep);
+  if (YabauseGetSpeed() != 0) YabThreadUSleep(sleep);
   nextFrameTime  += yabsys.OneFrameTime;
 }
 
@@ -230,6 +241,7 @@ int YabauseSh2Init(yabauseinit_struct *init)
 
 #ifdef SPRITE_CACHE
    yabsys.useVdp1cache = init->useVdp1cache;
+   yabsys.vdp1cachesize = init->vdp1cachesize;
 #endif
 
    // Initialize both cpu's
@@ -379,6 +391,7 @@ int YabauseInit(yabauseinit_struct *init)
    yabsys.UseThreads = init->usethreads;
    yabsys.NumThreads = init->numthreads;
    yabsys.usecache = init->usecache;
+   yabsys.usePresentThread = init->presentthread;
    yabsys.isRotated = 0;
    nextFrameTime = 0;
 
@@ -387,6 +400,7 @@ int YabauseInit(yabauseinit_struct *init)
 
 #ifdef SPRITE_CACHE
    yabsys.useVdp1cache = init->useVdp1cache;
+   yabsys.vdp1cachesize = init->vdp1cachesize;
 #endif
 
    // Initialize both cpu's
@@ -586,6 +600,13 @@ int YabauseInit(yabauseinit_struct *init)
 
 #endif
 
+   if (init->rewindinterval > 0)
+      RewindInit(init->rewindinterval, init->rewindbudget);
+   AutosaveInit(init->autosaveinterval, init->autosavepath);
+   if (init->auditwindow > 0)
+      AuditInit(init->auditwindow, NULL);
+   FrameSkipInit(init->adaptiveskip);
+
    if (init->skip_load)
    {
 	   return 0;
@@ -640,6 +661,12 @@ void YabFlushBackups(void)
 
 void YabauseDeInit(void) {
    
+   FrameSkipDeInit();
+   AuditDeInit();
+   RewindDeInit();
+   AutosaveInit(0, NULL);
+   StateFileDeInit();
+
    Vdp2DeInit();
    Vdp1DeInit();
    
@@ -751,7 +778,35 @@ int YabauseExec(void) {
 	}
 #else
   ScspUnMuteAudio(SCSP_MUTE_SYSTEM);
-  YabauseEmulate();
+  if (fastforwardinterval > 1)
+  {
+     int skip = yabsys.skipRender;
+     // Only one frame out of fastforwardinterval is rendered, VDP1 still
+     // draws on the frame before it
+     fastforwardcount++;
+     if (fastforwardcount % fastforwardinterval != 0)
+     {
+        yabsys.skipRender = 1;
+        yabsys.skipVdp1 = (fastforwardcount + 1) % fastforwardinterval != 0;
+     }
+     YabauseEmulate();
+     yabsys.skipRender = skip;
+     yabsys.skipVdp1 = 0;
+  }
+  else if (FrameSkipIsEnabled() && YabauseGetSpeed() == 1)
+  {
+     int skip = yabsys.skipRender;
+     if (FrameSkipBegin())
+     {
+        yabsys.skipRender = 1;
+        yabsys.skipVdp1 = !FrameSkipNextRenders();
+     }
+     YabauseEmulate();
+     yabsys.skipRender = skip;
+     yabsys.skipVdp1 = 0;
+  }
+  else
+     YabauseEmulate();
 #endif
 	return 0;
 }
@@ -775,6 +830,8 @@ u32 YabauseGetCpuTime(){
 static int fpsframecount = 0;
 static u64 fpsticks = 0;
 static int fps = 0;
+static u32 fpsskipped = 0;
+static u32 fpsskipbase = 0;
 static void FPSDisplay(void)
 {
   fpsframecount++;
@@ -783,8 +840,14 @@ static void FPSDisplay(void)
     fps = fpsframecount;
     fpsframecount = 0;
     fpsticks = YabauseGetTicks();
+    fpsskipped = FrameSkipGetSkipped() - fpsskipbase;
+    fpsskipbase += fpsskipped;
   }
-  if (isAutoFrameSkip() == 0) {
+  if (fastforwardinterval > 1) {
+    OSDPushMessage(OSDMSG_FPS, 1, "%02d FPS x%d", fps, fastforwardinterval);
+  } else if (FrameSkipIsEnabled() && isAutoFrameSkip() == 0) {
+    OSDPushMessage(OSDMSG_FPS, 1, "%02d/%02d FPS, %d skipped", fps, yabsys.IsPal ? 50 : 60, (int)fpsskipped);
+  } else if (isAutoFrameSkip() == 0) {
     OSDPushMessage(OSDMSG_FPS, 1, "%02d/%02d FPS", fps, yabsys.IsPal ? 50 : 60);
   } else {
     OSDPushMessage(OSDMSG_FPS, 1, "%02d FPS", fps);
@@ -960,8 +1023,14 @@ int YabauseEmulate(void) {
    }
    M68KSync();
 
-   syncVideoMode();
-   FPSDisplay();
+   syncVideoMode(FrameSkipEnd());
+   // Frames played again by the audit or a rollback are not new frames
+   if (AuditFrame() == 0 && !yabsys.resimulating)
+   {
+      RewindFrame();
+      AutosaveFrame();
+      FPSDisplay();
+   }
 
 #ifdef YAB_WANT_SSF
 
@@ -1475,3 +1544,40 @@ void DisableAutoFrameSkip(void)
 }
 
 //////////////////////////////////////////////////////////////////////////////
+
+void EnableFastForward(int interval, int throttle)
+{
+   fastforwardinterval = interval;
+   fastforwardthrottle = throttle;
+   fastforwardcount = 0;
+   nextFrameTime = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int isFastForward(void)
+{
+   return fastforwardinterval > 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void DisableFastForward(void)
+{
+   fastforwardinterval = 0;
+   fastforwardthrottle = 0;
+   nextFrameTime = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YabauseGetSpeed(void)
+{
+   if (isAutoFrameSkip())
+      return 0;
+   if (fastforwardinterval > 1)
+      return fastforwardthrottle ? fastforwardinterval : 0;
+   return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
@@ -67,8 +67,16 @@ typedef struct
    int resolution_mode;
    int extend_backup;
    int usecache;
+   int presentthread; // Present frames from a dedicated thread (needs a shared GL context)
+   int rewindinterval; // Capture a rewind state every n frames, 0 disables rewind
+   u32 rewindbudget;   // Memory used by the rewind history, 0 for the default
+   int autosaveinterval;      // Save a state every n seconds, 0 disables autosave
+   const char *autosavepath;  // Directory of the autosave state
+   int auditwindow;    // Replay every n frames and compare the hashes, 0 disables the audit
+   int adaptiveskip;   // Skip rendering at most n frames in a row to keep up, 0 disables it
 #ifdef SPRITE_CACHE
    int useVdp1cache;
+   u32 vdp1cachesize; // VDP1 sprite cache budget in bytes, 0 for default
 #endif
 } yabauseinit_struct;
 
@@ -102,6 +110,17 @@ void EnableAutoFrameSkip(void);
 int isAutoFrameSkip(void);
 void DisableAutoFrameSkip(void);
 
+// Render one frame out of interval, the others are emulated with
+// yabsys.skipRender set, and yabsys.skipVdp1 too unless the next frame
+// shows what VDP1 draws. With throttle the rendered frames keep the
+// display rate, so the game runs interval times faster (turbo); without
+// it runs as fast as the host allows (fast-forward).
+void EnableFastForward(int interval, int throttle);
+int isFastForward(void);
+void DisableFastForward(void);
+// Emulated frames per displayed frame the pacing aims for, 0 when unpaced
+int YabauseGetSpeed(void);
+
 #define YABSYS_TIMING_BITS  20
 #define YABSYS_TIMING_MASK  ((1 << YABSYS_TIMING_BITS) - 1)
 
@@ -129,8 +148,13 @@ typedef struct
    int playing_ssf;
    u32 frame_count;
    int usecache;
+   int usePresentThread;
+   int skipRender;  // Emulate frames without composing or presenting them
+   int skipVdp1;    // Only walk the VDP1 command list, the next frame is not shown either
+   int resimulating; // Frames emulated again after a rollback, not new frames
 #ifdef SPRITE_CACHE
    int useVdp1cache;
+   u32 vdp1cachesize;
 #endif
 } yabsys_struct;
 
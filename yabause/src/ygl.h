@@ -202,6 +202,11 @@ extern PFNGLMEMORYBARRIERPROC glMemoryBarrier;
 #include "threads.h"
 #include "vidshared.h"
 
+// The VDP1 compute rasterizer needs the GL 4.3 entry points from GLEW
+#if defined(_USEGLEW_) && !defined(__LIBRETRO__) && defined(GL_COMPUTE_SHADER)
+#define YGL_VDP1_COMPUTE
+#endif
+
 typedef struct {
 	float vertices[8];
 	int w;
@@ -223,18 +228,95 @@ typedef struct {
 	float y;
 } YglCache;
 
+#define YGL_CRAM_SIZE 2048
+#define YGL_CRAM_DIRTY_WORDS (YGL_CRAM_SIZE / 32)
+
 typedef struct {
 	unsigned int * textdata;
 	unsigned int w;
 } YglTexture;
 
-#define HASHSIZE  (0xFFFF)
-typedef struct _YglCacheHash {
-	u64 addr;
+// 64 bit finalizer used to build texture cache keys
+static INLINE u64 YglHashMix64(u64 key) {
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	key *= 0xC4CEB9FE1A85EC53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+// Per frame cell cache: open addressing with Robin Hood probing. The table
+// starts at YGL_CACHE_INITIAL_SIZE slots and doubles up to YGL_CACHE_MAX_SIZE;
+// past that, new cells are counted as overflow and simply not cached.
+#define YGL_CACHE_INITIAL_SIZE (0x10000)
+#define YGL_CACHE_MAX_SIZE (0x100000)
+
+// Number of upload segments used when the texture managers keep their
+// pixel buffers persistently mapped (GL 4.4 / ARB_buffer_storage)
+#define YGL_TM_RING_SIZE 3
+
+typedef struct {
+	u64 key;
 	float x;
 	float y;
-	struct _YglCacheHash * next;
-} YglCacheHash;
+	u32 epoch;
+	u32 dist;
+} YglCacheSlot;
+
+typedef struct {
+	u64 hit;
+	u64 miss;
+	u64 overflow;
+} YglCacheStats;
+
+// Frame persistent part of a texture manager: the top rows of the atlas
+// are split into pages packed with a skyline allocator. Entries stay valid
+// across frames until their page is evicted; a page is only evicted when
+// it has not been used during the current frame.
+#define YGL_TM_PAGE_HEIGHT 128
+#define YGL_TM_SKYLINE_NODES 256
+#define YGL_TM_ENTRY_COUNT 0x4000
+#define YGL_TM_ENTRY_PROBE 16
+#define YGL_TM_DIRTY_MAX 1024
+#define YGL_TM_PERSISTENT_BUDGET (4 * 1024 * 1024)
+
+#define YGL_VDP1FB_DIRTY_MAX 512
+
+typedef struct {
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+} YglSkylineNode;
+
+typedef struct {
+	YglSkylineNode node[YGL_TM_SKYLINE_NODES];
+	int nodeCount;
+	u32 lastUse;
+	u32 generation;
+} YglTMPage;
+
+typedef struct {
+	u64 key;
+	unsigned short x;
+	unsigned short y;
+	u32 page;
+	u32 generation;
+} YglTMEntry;
+
+typedef struct {
+	unsigned short x;
+	unsigned short y;
+	unsigned short w;
+	unsigned short h;
+} YglTMRect;
+
+typedef struct {
+	u64 hit;
+	u64 miss;
+	u64 evict;
+	u64 full;
+} YglTMStats;
 
 typedef struct {
 	unsigned int currentX;
@@ -244,11 +326,28 @@ typedef struct {
 	unsigned int width;
 	unsigned int height;
         YabMutex *mtx;
-	YglCacheHash *HashTable[HASHSIZE];
-	YglCacheHash CashLink[HASHSIZE * 2];
-	u32 CashLink_index;
+	YglCacheSlot * cacheSlots;
+	u32 cacheCapacity;
+	u32 cacheCount;
+	u32 cacheEpoch;
+	YglCacheStats cacheStats;
+	YglCacheStats cacheStatsLast;
 	GLuint textureID;
 	GLuint pixelBufferID;
+	int persistent;
+	int ringIndex;
+	GLuint ringBufferID[YGL_TM_RING_SIZE];
+	unsigned int * ringTexture[YGL_TM_RING_SIZE];
+	GLsync ringFence[YGL_TM_RING_SIZE];
+	unsigned int persistentWidth;
+	unsigned int persistentHeight;
+	int pageCount;
+	YglTMPage * pages;
+	YglTMEntry * entries;
+	YglTMRect * dirty;
+	int dirtyCount;
+	u32 frame;
+	YglTMStats stats;
 } YglTextureManager;
 
 extern YglTextureManager * YglTM_vdp1[2];
@@ -261,6 +360,9 @@ void YglTMReserve(YglTextureManager * tm, unsigned int w, unsigned int h);
 void YglTMAllocate(YglTextureManager * tm, YglTexture *, unsigned int, unsigned int, unsigned int *, unsigned int *);
 void YglTmPush(YglTextureManager * tm);
 void YglTmPull(YglTextureManager * tm, u32 flg);
+void YglTMSetPersistentBudget(YglTextureManager * tm, u32 bytes);
+int YglTMFind(YglTextureManager * tm, u64 key, YglCache * c);
+int YglTMAllocatePersistent(YglTextureManager * tm, u64 key, YglTexture * output, unsigned int w, unsigned int h, YglCache * c);
 void YglTMCheck();
 
 void YglCacheInit(YglTextureManager * tm);
@@ -268,6 +370,7 @@ void YglCacheDeInit(YglTextureManager * tm);
 int YglIsCached(YglTextureManager * tm, u64, YglCache *);
 void YglCacheAdd(YglTextureManager * tm, u64, YglCache *);
 void YglCacheReset(YglTextureManager * tm);
+void YglCacheGetStats(YglTextureManager * tm, YglCacheStats * stats);
 
 void YglCheckFBSwitch(int sync);
 
@@ -381,6 +484,75 @@ void Ygl_Vdp1CommonGetUniformId(GLuint pgid, YglVdp1CommonParam * param);
 int Ygl_uniformVdp1CommonParam(void * p, YglTextureManager *tm, Vdp2 *varVdp2Regs);
 int Ygl_cleanupVdp1CommonParam(void * p, YglTextureManager *tm);
 void YglUpdateVDP1FB(void);
+void YglPrefetchVDP1FB(void);
+
+#define YGL_VDP1_CS_QUAD     0
+#define YGL_VDP1_CS_LINE     1
+
+#define YGL_VDP1_CS_TEXTURED 0x01
+#define YGL_VDP1_CS_SPD      0x02
+#define YGL_VDP1_CS_ECD      0x04
+#define YGL_VDP1_CS_MSB      0x08
+#define YGL_VDP1_CS_RGB      0x10
+#define YGL_VDP1_CS_AA       0x20
+#define YGL_VDP1_CS_SPRTYPE(a) (((a)&0xF)<<8)
+
+// One VDP1 command as seen by the compute rasterizer, only ints so that
+// the std430 layout of the shader matches this struct.
+typedef struct {
+  int type;
+  int pmod;
+  int dir;
+  int flags;
+  int texoffset;
+  int texw;
+  int texh;
+  int srcaddr;
+  int color;
+  int colorbank;
+  int priority;
+  int colorcl;
+  int normalshadow;
+  int uclip[4];
+  int vertex[8];
+  int gouraud[4];
+  int bbox[4];
+  int lut[16];
+} YglVdp1ComputeCmd;
+
+int YglVdp1ComputeInit(void);
+void YglVdp1ComputeDeInit(void);
+void YglVdp1ComputeAdd(YglVdp1ComputeCmd * cmd);
+void YglVdp1ComputeExecute(u8 * ram, int id);
+int YglGenFrameBuffer();
+void YglGetDisplayRect(double *x, double *y, double *w, double *h);
+
+// Final scaling and buffer swap can run on their own thread, this needs a
+// port giving a shared context through YuiRevokeOGLOnThisThread
+#if defined(YAB_ASYNC_RENDERING) && !defined(__LIBRETRO__)
+#define YGL_PRESENT_THREAD
+#endif
+
+// Displayed frames handed back in system memory through a PBO ring
+typedef void (*YglFrameCallback)(const u8 *pixels, int width, int height, void *arg);
+int YglReadbackInit(int count, YglFrameCallback callback, void *arg);
+void YglReadbackDeInit(void);
+int YglReadbackIsEnabled(void);
+void YglReadbackQueue(GLuint fbo, int x, int y, int width, int height);
+void YglReadbackFlush(void);
+void YglThumbnailCapture(GLuint fbo, int width, int height);
+int YglGetThumbnail(u8 **pixels, int *width, int *height);
+void YglThumbnailDeInit(void);
+
+#ifdef YGL_PRESENT_THREAD
+int YglPresentInit(void);
+void YglPresentDeInit(void);
+int YglPresentIsRunning(void);
+GLuint YglPresentTarget(int width, int height);
+void YglPresentQueueFrame(void);
+#else
+#define YglPresentIsRunning() (0)
+#endif
 
 // std140
 typedef struct  { 
@@ -466,7 +638,8 @@ typedef enum
 {
     PERSPECTIVE_CORRECTION = 0,
     CPU_TESSERATION,
-    GPU_TESSERATION
+    GPU_TESSERATION,
+    GPU_COMPUTE
 } POLYGONMODE;
 
 typedef enum
@@ -552,6 +725,16 @@ typedef struct {
    GLuint vdp1_pbo[2];
    GLuint vdp1IsNotEmpty[2];
    u32* vdp1fb_buf[2];
+   // CPU access to the VDP1 framebuffer: vdp1fb_buf points to a CPU copy
+   // while an access is open. The copy is only complete once vdp1fb_valid
+   // is set; writes are staged as rectangles until the next flush.
+   u32* vdp1fb_shadow[2];
+   int vdp1fb_valid[2];
+   GLsync vdp1fb_sync[2];
+   YglTMRect vdp1fb_dirty[2][YGL_VDP1FB_DIRTY_MAX];
+   int vdp1fb_dirtycount[2];
+   int vdp1fb_accessed;
+   int vdp1fb_predict;
    GLuint original_fbo;
    GLuint original_fbotex;
    GLuint original_stencil;
@@ -612,8 +795,10 @@ typedef struct {
    GLuint cram_tex;
    GLuint cram_tex_pbo;
    u32 * cram_tex_buf;
-   u32 colupd_min_addr;
-   u32 colupd_max_addr;
+   // Color RAM texels written since the last upload, one bit per texel
+   // and one bit per 32 texel bank in cram_dirty_banks
+   u32 cram_dirty[YGL_CRAM_DIRTY_WORDS];
+   u64 cram_dirty_banks;
    YabMutex * crammutex;
 
    UniformFrameBuffer fbu_;
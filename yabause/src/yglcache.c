@@ -19,98 +19,140 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
 */
 
-
+#include <stdlib.h>
 #include "ygl.h"
 #include "yui.h"
 #include "vidshared.h"
 
 
 
-static u32 YglgetHash(u64 addr)
-{
-  return ((addr>>4) & HASHSIZE);
+void YglCacheInit(YglTextureManager * tm) {
+  tm->cacheCapacity = YGL_CACHE_INITIAL_SIZE;
+  tm->cacheSlots = (YglCacheSlot *)calloc(tm->cacheCapacity, sizeof(YglCacheSlot));
+  tm->cacheCount = 0;
+  tm->cacheEpoch = 1;
+  memset(&tm->cacheStats, 0, sizeof(tm->cacheStats));
+  memset(&tm->cacheStatsLast, 0, sizeof(tm->cacheStatsLast));
 }
 
-static YglCacheHash * YglgetNewCash(YglTextureManager * tm) {
+//////////////////////////////////////////////////////////////////////////////
 
-  YglCacheHash * rtn;
+void YglCacheDeInit(YglTextureManager * tm) {
+  free(tm->cacheSlots);
+  tm->cacheSlots = NULL;
+  tm->cacheCapacity = 0;
+  tm->cacheCount = 0;
+}
 
-  if (tm->CashLink_index >= HASHSIZE * 2){
-    printf("not enough cash");
-    return NULL;
+//////////////////////////////////////////////////////////////////////////////
+
+// Slots whose epoch differs from the table epoch are empty, so a reset
+// does not need to touch the table.
+static int YglCacheInsert(YglCacheSlot * slots, u32 mask, u32 epoch, u64 key, float x, float y) {
+  YglCacheSlot cur;
+  u32 index = (u32)YglHashMix64(key) & mask;
+
+  cur.key = key;
+  cur.x = x;
+  cur.y = y;
+  cur.epoch = epoch;
+  cur.dist = 0;
+
+  for (;;) {
+    YglCacheSlot * at = &slots[index];
+    if (at->epoch != epoch) {
+      *at = cur;
+      return 1;
+    }
+    if (at->key == cur.key) {
+      at->x = cur.x;
+      at->y = cur.y;
+      return 0;
+    }
+    // Robin Hood: the entry further from its home slot keeps the place
+    if (at->dist < cur.dist) {
+      YglCacheSlot tmp = *at;
+      *at = cur;
+      cur = tmp;
+    }
+    cur.dist++;
+    index = (index + 1) & mask;
   }
-  rtn = &tm->CashLink[tm->CashLink_index];
-  tm->CashLink_index++;
-  return rtn;
 }
 
-int YglIsCached(YglTextureManager * tm, u64 addr, YglCache * c) {
+//////////////////////////////////////////////////////////////////////////////
+
+static int YglCacheGrow(YglTextureManager * tm) {
+  YglCacheSlot * slots;
+  u32 capacity = tm->cacheCapacity << 1;
+  u32 i;
 
-  u32 hashkey;
-  hashkey = YglgetHash(addr);  /* get hash */
+  if (capacity > YGL_CACHE_MAX_SIZE) return 0;
+  slots = (YglCacheSlot *)calloc(capacity, sizeof(YglCacheSlot));
+  if (slots == NULL) return 0;
 
-  if (tm->HashTable[hashkey] == NULL) {  /* Empty Hash */
-    return 0;        /* Not Found */
+  for (i = 0; i < tm->cacheCapacity; i++) {
+    YglCacheSlot * at = &tm->cacheSlots[i];
+    if (at->epoch == tm->cacheEpoch)
+      YglCacheInsert(slots, capacity - 1, tm->cacheEpoch, at->key, at->x, at->y);
   }
-  else {  /* needs liner search */
-	  YglCacheHash *at = tm->HashTable[hashkey];
-    while (at != NULL) {
-      if (at->addr == addr) {  /* Find! */
-        c->x = at->x;
-        c->y = at->y;
-        return 1;
-      }
-      at = at->next; 
+  free(tm->cacheSlots);
+  tm->cacheSlots = slots;
+  tm->cacheCapacity = capacity;
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglIsCached(YglTextureManager * tm, u64 addr, YglCache * c) {
+  u32 mask = tm->cacheCapacity - 1;
+  u32 index = (u32)YglHashMix64(addr) & mask;
+  u32 dist = 0;
+
+  for (;;) {
+    YglCacheSlot * at = &tm->cacheSlots[index];
+    if ((at->epoch != tm->cacheEpoch) || (at->dist < dist)) break;
+    if (at->key == addr) {  /* Find! */
+      c->x = at->x;
+      c->y = at->y;
+      tm->cacheStats.hit++;
+      return 1;
     }
-    return 0;  /* Not found */
+    dist++;
+    index = (index + 1) & mask;
   }
-
-  return 1;
+  tm->cacheStats.miss++;
+  return 0;  /* Not found */
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
 void YglCacheAdd(YglTextureManager * tm, u64 addr, YglCache * c) {
-
-  u32 hashkey;
-  YglCacheHash *add;
-  hashkey = YglgetHash(addr);
-
-  if (tm->HashTable[hashkey] == NULL){
-	add = YglgetNewCash(tm);
-    add->addr = addr;
-    add->x = c->x;
-    add->y = c->y;
-    add->next = NULL;
-	tm->HashTable[hashkey] = add;
-  }
-  else{
-	  YglCacheHash *at = tm->HashTable[hashkey];
-    while (at != NULL) {
-      if (at->addr == addr  ) { 
-        at->addr = addr;
-        at->x = c->x;
-        at->y = c->y;
-        return;
-      }
-      at = at->next; 
+  // Keep the load factor under 7/8 so that probe sequences stay short
+  if ((tm->cacheCount + 1) > (tm->cacheCapacity - (tm->cacheCapacity >> 3))) {
+    if (!YglCacheGrow(tm)) {
+      tm->cacheStats.overflow++;
+      return;
     }
-
-	add = YglgetNewCash(tm);
-    add->addr = addr;
-    add->x = c->x;
-    add->y = c->y;
-	add->next = tm->HashTable[hashkey];
-	tm->HashTable[hashkey] = add;
   }
-
+  tm->cacheCount += YglCacheInsert(tm->cacheSlots, tm->cacheCapacity - 1, tm->cacheEpoch, addr, c->x, c->y);
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
 void YglCacheReset(YglTextureManager * tm) {
-	memset(tm->HashTable, 0, sizeof(tm->HashTable));
-	tm->CashLink_index = 0;
+  tm->cacheCount = 0;
+  tm->cacheEpoch++;
+  if (tm->cacheEpoch == 0) {
+    memset(tm->cacheSlots, 0, tm->cacheCapacity * sizeof(YglCacheSlot));
+    tm->cacheEpoch = 1;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglCacheGetStats(YglTextureManager * tm, YglCacheStats * stats) {
+  *stats = tm->cacheStats;
 }
 
 //////////////////////////////////////////////////////////////////////////////
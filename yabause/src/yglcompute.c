@@ -0,0 +1,643 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*
+  VDP1 compute rasterizer
+
+  The command list is flattened on the CPU (clipping, local coordinates,
+  zoom points, priorities and palettes are resolved there), then two
+  compute passes run on the GPU:
+    - decode: one invocation per sprite line turns raw VDP1 RAM into
+      VDP1COLOR texels, following Vdp1ReadTexture_in_sync.
+    - raster: one invocation per framebuffer pixel walks, in list order,
+      the commands binned to its screen tile, so overdraw and color
+      calculation keep the VDP1 order without atomics.
+  Binning is a CPU prepass over the command bounding boxes: each 32x32
+  VDP1 pixel tile gets the list of the commands touching it, so a pixel
+  only tests the few commands that can cover it instead of the whole list.
+  Quads are drawn like the VDP1 does: the left (A-D) and right (B-C) edges
+  are stepped together and a line is drawn between each pair of points,
+  with an extra pixel on diagonal steps so that no hole is left.
+*/
+
+#include <stdlib.h>
+#include "ygl.h"
+#include "yui.h"
+#include "vdp1.h"
+
+#ifdef YGL_VDP1_COMPUTE
+
+#define VDP1_CS_RAM_SIZE      0x80000
+#define VDP1_CS_LOCAL_SIZE    16
+#define VDP1_CS_DECODE_SIZE   64
+#define VDP1_CS_TEXEL_INITIAL (1024 * 1024)
+#define VDP1_CS_TILE_SHIFT    5
+
+extern float vdp1wratio;
+extern float vdp1hratio;
+
+#define SHADER_VERSION_COMPUTE "#version 430 core \n"
+#define VDP1_CS_STR2(x) #x
+#define VDP1_CS_STR(x) VDP1_CS_STR2(x)
+
+static const GLchar Yglprg_vdp1_cs_common[] =
+"struct Vdp1Cmd {\n"
+"  int type;\n"
+"  int pmod;\n"
+"  int dir;\n"
+"  int flags;\n"
+"  int texoffset;\n"
+"  int texw;\n"
+"  int texh;\n"
+"  int srcaddr;\n"
+"  int color;\n"
+"  int colorbank;\n"
+"  int priority;\n"
+"  int colorcl;\n"
+"  int normalshadow;\n"
+"  int uclip[4];\n"
+"  int vertex[8];\n"
+"  int gouraud[4];\n"
+"  int bbox[4];\n"
+"  int lut[16];\n"
+"};\n"
+"layout(std430, binding = 0) readonly buffer VDP1RAM { uint vram[]; };\n"
+"layout(std430, binding = 1) readonly buffer CMDS { Vdp1Cmd cmds[]; };\n"
+"layout(std430, binding = 2) buffer TEXELS { uint texels[]; };\n"
+"#define CS_QUAD 0\n"
+"#define CS_LINE 1\n"
+"#define CS_TEXTURED 0x01\n"
+"#define CS_SPD 0x02\n"
+"#define CS_ECD 0x04\n"
+"#define CS_MSB 0x08\n"
+"#define CS_RGB 0x10\n"
+"#define CS_AA 0x20\n";
+
+/*------------------------------------------------------------------------------------
+ *  Texture decode, one invocation per sprite line
+ * ----------------------------------------------------------------------------------*/
+static const GLchar Yglprg_vdp1_cs_decode[] =
+"layout(local_size_x = 64) in;\n"
+// Sprite types: priority shift/mask, color calculation shift/mask, data mask
+"const int pri_shift[16] = int[16](14,13,14,13,13,12,12,12,7,7,6,0,7,7,6,0);\n"
+"const int pri_mask[16] = int[16](3,7,1,3,3,7,7,7,1,1,3,0,1,1,3,0);\n"
+"const int cc_shift[16] = int[16](11,11,11,11,10,11,10,9,0,6,0,6,0,6,0,6);\n"
+"const int cc_mask[16] = int[16](7,3,7,3,7,1,3,7,0,1,0,3,0,1,0,3);\n"
+"const int data_mask[16] = int[16](0x7FF,0x7FF,0x7FF,0x7FF,0x3FF,0x7FF,0x3FF,0x1FF,0x7F,0x3F,0x3F,0x3F,0xFFFF,0xFFFF,0xFFFF,0xFFFF);\n"
+"uint readByte(uint a) {\n"
+"  a &= 0x7FFFFu;\n"
+"  return (vram[a >> 2] >> ((a & 3u) * 8u)) & 0xFFu;\n"
+"}\n"
+"uint readWord(uint a) {\n"
+"  return (readByte(a) << 8) | readByte(a + 1u);\n"
+"}\n"
+"uint vdp1Color(uint c, uint a, uint p, uint s, uint col) {\n"
+"  col &= (c == 1u) ? 0x7FFFu : 0xFFFFFFu;\n"
+"  return 0x80000000u | (c << 30) | (a << 27) | (p << 24) | (s << 23) | col;\n"
+"}\n"
+"uint color16To24(uint c) {\n"
+"  return ((c & 0x1Fu) << 3) | ((c & 0x3E0u) << 6) | ((c & 0x7C00u) << 9);\n"
+"}\n"
+"uint bankColor(int ci, uint index, uint pri, uint cc) {\n"
+"  if ((index & 0x8000u) != 0u && (cmds[ci].flags & CS_RGB) != 0)\n"
+"    return vdp1Color(0u, cc, pri, 0u, color16To24(index));\n"
+"  return vdp1Color(1u, cc, pri, 0u, index);\n"
+"}\n"
+"void main() {\n"
+"  int ci = int(gl_WorkGroupID.y);\n"
+"  int row = int(gl_GlobalInvocationID.x);\n"
+"  int flags = cmds[ci].flags;\n"
+"  int w = cmds[ci].texw;\n"
+"  if ((flags & CS_TEXTURED) == 0 || row >= cmds[ci].texh) return;\n"
+"  bool spd = (flags & CS_SPD) != 0;\n"
+"  bool ecd = (flags & CS_ECD) != 0;\n"
+"  bool msb = (flags & CS_MSB) != 0;\n"
+"  int mode = (cmds[ci].pmod >> 3) & 0x7;\n"
+"  uint bank = uint(cmds[ci].colorbank);\n"
+"  uint ns = uint(cmds[ci].normalshadow);\n"
+"  uint pri = uint(cmds[ci].priority);\n"
+"  uint cc = uint(cmds[ci].colorcl);\n"
+"  uint src = uint(cmds[ci].srcaddr);\n"
+"  int dst = cmds[ci].texoffset + row * w;\n"
+"  int endcnt = 0;\n"
+"  for (int j = 0; j < w; j++) {\n"
+"    uint col = 0u;\n"
+"    if (mode == 0 || mode == 1) {\n"
+"      uint dot = readByte(src + uint(row * (w >> 1) + (j >> 1)));\n"
+"      uint nib = ((j & 1) == 0) ? (dot >> 4) : (dot & 0xFu);\n"
+"      if (mode == 1) {\n"
+"        if (!ecd && endcnt >= 2) col = 0u;\n"
+"        else if (nib == 0u && !spd) col = 0u;\n"
+"        else if (nib == 0xFu && !ecd) { col = 0u; endcnt++; }\n"
+"        else col = uint(cmds[ci].lut[nib]);\n"
+"      } else {\n"
+"        if (nib == 0u && !spd) col = 0u;\n"
+"        else if (nib == 0xFu && !ecd) col = 0u;\n"
+"        else if (msb || (nib | bank) == ns) col = vdp1Color(1u, 0u, pri, 1u, 0u);\n"
+"        else col = bankColor(ci, nib | bank, pri, cc);\n"
+"      }\n"
+"    } else if (mode <= 4) {\n"
+"      uint dot = readByte(src + uint(row * w + j));\n"
+"      uint mask = (mode == 2) ? 0x3Fu : ((mode == 3) ? 0x7Fu : 0xFFu);\n"
+"      if (dot == 0u && !spd) col = 0u;\n"
+"      else if (dot == 0xFFu && !ecd) col = 0u;\n"
+"      else if (msb || ((dot & mask) | bank) == ns) col = vdp1Color(1u, 0u, pri, 1u, 0u);\n"
+"      else col = bankColor(ci, (dot & mask) | bank, pri, cc);\n"
+"    } else if (mode == 5) {\n"
+"      uint temp = readWord(src + uint((row * w + j) * 2));\n"
+"      if ((temp & 0x8000u) == 0u && !spd) col = 0u;\n"
+"      else if (temp == 0x7FFFu && !ecd) col = 0u;\n"
+"      else if (msb || (ns != 0u && temp == ns)) col = vdp1Color(0u, 1u, pri, 1u, 0u);\n"
+"      else if ((temp & 0x8000u) != 0u && (flags & CS_RGB) != 0) col = vdp1Color(0u, cc, pri, 0u, color16To24(temp));\n"
+"      else {\n"
+"        int t = (flags >> 8) & 0xF;\n"
+"        pri = (temp >> pri_shift[t]) & uint(pri_mask[t]);\n"
+"        cc = (temp >> cc_shift[t]) & uint(cc_mask[t]);\n"
+"        col = vdp1Color(1u, cc, pri, 0u, temp & uint(data_mask[t]));\n"
+"      }\n"
+"    }\n"
+"    texels[dst + j] = col;\n"
+"  }\n"
+"}\n";
+
+/*------------------------------------------------------------------------------------
+ *  Rasterization, one invocation per framebuffer pixel
+ * ----------------------------------------------------------------------------------*/
+static const GLchar Yglprg_vdp1_cs_raster[] =
+"layout(local_size_x = 16, local_size_y = 16) in;\n"
+"layout(rgba8, binding = 0) uniform image2D u_fb;\n"
+// tiles[t] .. tiles[t + 1] are the indices in tiles[] of the commands of tile t
+"layout(std430, binding = 3) readonly buffer TILES { uint tiles[]; };\n"
+"uniform int u_tilesx;\n"
+"uniform ivec2 u_fbsize;\n"
+"uniform vec2 u_scale;\n"
+"uniform ivec2 u_sysclip;\n"
+"int roundDiv(int a, int n) {\n"
+"  if (n == 0) return 0;\n"
+"  if (a >= 0) return (2 * a + n) / (2 * n);\n"
+"  return -((-2 * a + n) / (2 * n));\n"
+"}\n"
+// Step index of p on the line p0-p1, or -1 when the line does not touch p
+"int onLine(ivec2 p, ivec2 p0, ivec2 p1, bool aa, out int len) {\n"
+"  ivec2 d = p1 - p0;\n"
+"  ivec2 ad = abs(d);\n"
+"  len = max(ad.x, ad.y);\n"
+"  if (len == 0) return (p == p0) ? 0 : -1;\n"
+"  if (ad.x >= ad.y) {\n"
+"    int t = (p.x - p0.x) * ((d.x >= 0) ? 1 : -1);\n"
+"    if (t < 0 || t > len) return -1;\n"
+"    int y = p0.y + roundDiv(d.y * t, len);\n"
+"    if (p.y == y) return t;\n"
+"    if (aa && t > 0) {\n"
+"      int yp = p0.y + roundDiv(d.y * (t - 1), len);\n"
+"      if (yp != y && p.y == yp) return t;\n"
+"    }\n"
+"  } else {\n"
+"    int t = (p.y - p0.y) * ((d.y >= 0) ? 1 : -1);\n"
+"    if (t < 0 || t > len) return -1;\n"
+"    int x = p0.x + roundDiv(d.x * t, len);\n"
+"    if (p.x == x) return t;\n"
+"    if (aa && t > 0) {\n"
+"      int xp = p0.x + roundDiv(d.x * (t - 1), len);\n"
+"      if (xp != x && p.x == xp) return t;\n"
+"    }\n"
+"  }\n"
+"  return -1;\n"
+"}\n"
+"float cross2(vec2 a, vec2 b) { return a.x * b.y - a.y * b.x; }\n"
+// Position of p along the A-D edge, used to pick the candidate lines
+"float edgeParam(vec2 p, vec2 a, vec2 b, vec2 c, vec2 d) {\n"
+"  vec2 e = b - a;\n"
+"  vec2 f = d - a;\n"
+"  vec2 g = a - b + c - d;\n"
+"  vec2 h = p - a;\n"
+"  float k2 = cross2(g, f);\n"
+"  float k1 = cross2(e, f) + cross2(h, g);\n"
+"  float k0 = cross2(h, e);\n"
+"  if (abs(k2) < 0.0001) {\n"
+"    if (abs(k1) < 0.0001) return -1000.0;\n"
+"    return -k0 / k1;\n"
+"  }\n"
+"  float w = k1 * k1 - 4.0 * k0 * k2;\n"
+"  if (w < 0.0) return -1000.0;\n"
+"  w = sqrt(w);\n"
+"  float v = (-k1 - w) / (2.0 * k2);\n"
+"  if (v < 0.0 || v > 1.0) v = (-k1 + w) / (2.0 * k2);\n"
+"  return v;\n"
+"}\n"
+"int gouraudMix(int a, int b, int i, int n) {\n"
+"  if (n == 0) return a;\n"
+"  ivec3 ca = ivec3(a & 0x1F, (a >> 5) & 0x1F, (a >> 10) & 0x1F);\n"
+"  ivec3 cb = ivec3(b & 0x1F, (b >> 5) & 0x1F, (b >> 10) & 0x1F);\n"
+"  ivec3 c = ca + ((cb - ca) * i) / n;\n"
+"  return c.r | (c.g << 5) | (c.b << 10);\n"
+"}\n"
+"uint applyGouraud(uint src, int g) {\n"
+"  ivec3 c = ivec3(int(src & 0xFFu), int((src >> 8) & 0xFFu), int((src >> 16) & 0xFFu));\n"
+"  c += (ivec3(g & 0x1F, (g >> 5) & 0x1F, (g >> 10) & 0x1F) - 16) << 3;\n"
+"  c = clamp(c, 0, 255);\n"
+"  return (src & 0xFF000000u) | uint(c.r) | (uint(c.g) << 8) | (uint(c.b) << 16);\n"
+"}\n"
+"void main() {\n"
+"  ivec2 pos = ivec2(gl_GlobalInvocationID.xy);\n"
+"  if (pos.x >= u_fbsize.x || pos.y >= u_fbsize.y) return;\n"
+"  ivec2 p = ivec2(floor((vec2(pos.x, u_fbsize.y - 1 - pos.y) + 0.5) * u_scale));\n"
+"  if (p.x > u_sysclip.x || p.y > u_sysclip.y) return;\n"
+"  uint dst = packUnorm4x8(imageLoad(u_fb, pos));\n"
+"  bool written = false;\n"
+"  int tile = (p.y >> " VDP1_CS_STR(VDP1_CS_TILE_SHIFT) ") * u_tilesx + (p.x >> " VDP1_CS_STR(VDP1_CS_TILE_SHIFT) ");\n"
+"  for (uint j = tiles[tile]; j < tiles[tile + 1]; j++) {\n"
+"    int i = int(tiles[j]);\n"
+"    if (p.x < cmds[i].bbox[0] || p.y < cmds[i].bbox[1] || p.x > cmds[i].bbox[2] || p.y > cmds[i].bbox[3]) continue;\n"
+"    int pmod = cmds[i].pmod;\n"
+"    if ((pmod & 0x400) != 0) {\n"
+"      bool inside = p.x >= cmds[i].uclip[0] && p.y >= cmds[i].uclip[1] && p.x <= cmds[i].uclip[2] && p.y <= cmds[i].uclip[3];\n"
+"      if (inside == ((pmod & 0x200) != 0)) continue;\n"
+"    }\n"
+"    if ((pmod & 0x100) != 0 && ((p.x ^ p.y) & 1) != 0) continue;\n"
+"    ivec2 va = ivec2(cmds[i].vertex[0], cmds[i].vertex[1]);\n"
+"    ivec2 vb = ivec2(cmds[i].vertex[2], cmds[i].vertex[3]);\n"
+"    int t = -1;\n"
+"    int len = 0;\n"
+"    int k = 0;\n"
+"    int n = 0;\n"
+"    if (cmds[i].type == CS_LINE) {\n"
+"      t = onLine(p, va, vb, false, len);\n"
+"    } else {\n"
+"      ivec2 vc = ivec2(cmds[i].vertex[4], cmds[i].vertex[5]);\n"
+"      ivec2 vd = ivec2(cmds[i].vertex[6], cmds[i].vertex[7]);\n"
+"      ivec2 dl = abs(vd - va);\n"
+"      ivec2 dr = abs(vc - vb);\n"
+"      n = max(max(dl.x, dl.y), max(dr.x, dr.y));\n"
+"      float s = edgeParam(vec2(p), vec2(va), vec2(vb), vec2(vc), vec2(vd));\n"
+"      int k0 = 0;\n"
+"      int k1 = n;\n"
+"      if (s > -999.0) {\n"
+"        int kc = clamp(int(floor(s * float(n) + 0.5)), 0, n);\n"
+"        k0 = max(0, kc - 2);\n"
+"        k1 = min(n, kc + 2);\n"
+"      }\n"
+       // Later lines overwrite earlier ones on the VDP1
+"      for (k = k1; k >= k0; k--) {\n"
+"        ivec2 pl = va + ivec2(roundDiv((vd.x - va.x) * k, n), roundDiv((vd.y - va.y) * k, n));\n"
+"        ivec2 pr = vb + ivec2(roundDiv((vc.x - vb.x) * k, n), roundDiv((vc.y - vb.y) * k, n));\n"
+"        t = onLine(p, pl, pr, (cmds[i].flags & CS_AA) != 0, len);\n"
+"        if (t >= 0) break;\n"
+"      }\n"
+"    }\n"
+"    if (t < 0) continue;\n"
+"    uint src;\n"
+"    if ((cmds[i].flags & CS_TEXTURED) != 0) {\n"
+"      int w = cmds[i].texw;\n"
+"      int h = cmds[i].texh;\n"
+"      int u = (t * w) / (len + 1);\n"
+"      int v = (k * h) / (n + 1);\n"
+"      if ((cmds[i].dir & 1) != 0) u = w - 1 - u;\n"
+"      if ((cmds[i].dir & 2) != 0) v = h - 1 - v;\n"
+"      src = texels[cmds[i].texoffset + v * w + u];\n"
+"    } else {\n"
+"      src = uint(cmds[i].color);\n"
+"    }\n"
+"    if (src == 0u) continue;\n"
+"    if ((pmod & 0x4) != 0 && (src & 0x40000000u) == 0u) {\n"
+"      int g;\n"
+"      if (cmds[i].type == CS_LINE) {\n"
+"        g = gouraudMix(cmds[i].gouraud[0], cmds[i].gouraud[1], t, len);\n"
+"      } else {\n"
+"        int gl = gouraudMix(cmds[i].gouraud[0], cmds[i].gouraud[3], k, n);\n"
+"        int gr = gouraudMix(cmds[i].gouraud[1], cmds[i].gouraud[2], k, n);\n"
+"        g = gouraudMix(gl, gr, t, len);\n"
+"      }\n"
+"      src = applyGouraud(src, g);\n"
+"    }\n"
+"    int cl = pmod & 0x3;\n"
+"    if (cl == 0) {\n"
+"      dst = src;\n"
+"    } else if (cl == 1) {\n"
+       // Shadow only darkens pixels already holding an RGB color
+"      if (((dst >> 24) & 0xC0u) != 0x80u) continue;\n"
+"      dst = (dst & 0xFF000000u) | ((dst >> 1) & 0x7F7F7Fu);\n"
+"    } else if (cl == 2) {\n"
+"      dst = (src & 0xFF000000u) | ((src >> 1) & 0x7F7F7Fu);\n"
+"    } else {\n"
+"      if (((dst >> 24) & 0x40u) == 0u) {\n"
+"        uint a = ((pmod & 0x4) != 0) ? (src & 0xFF000000u) : (dst & 0xFF000000u);\n"
+"        dst = a | (((src >> 1) & 0x7F7F7Fu) + ((dst >> 1) & 0x7F7F7Fu));\n"
+"      } else {\n"
+"        dst = src;\n"
+"      }\n"
+"    }\n"
+"    written = true;\n"
+"  }\n"
+"  if (written) imageStore(u_fb, pos, unpackUnorm4x8(dst));\n"
+"}\n";
+
+static GLuint vdp1_cs_decode_prg = 0;
+static GLuint vdp1_cs_raster_prg = 0;
+static GLuint vdp1_cs_ssbo[4] = { 0 };
+static GLint vdp1_cs_id_tilesx = -1;
+static GLint vdp1_cs_id_fbsize = -1;
+static GLint vdp1_cs_id_scale = -1;
+static GLint vdp1_cs_id_sysclip = -1;
+
+static YglVdp1ComputeCmd * vdp1_cs_cmds = NULL;
+static int vdp1_cs_count = 0;
+static int vdp1_cs_capacity = 0;
+static int vdp1_cs_texels = 0;
+static int vdp1_cs_texel_capacity = 0;
+static int vdp1_cs_maxh = 0;
+static u32 * vdp1_cs_tiles = NULL;
+static int vdp1_cs_tile_capacity = 0;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void Ygl_printComputeError(GLuint shader, int program)
+{
+  GLsizei bufSize = 0;
+
+  if (program) glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
+  else glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &bufSize);
+
+  if (bufSize > 1) {
+    GLchar *infoLog;
+
+    infoLog = (GLchar *)malloc(bufSize);
+    if (infoLog != NULL) {
+      GLsizei length;
+      if (program) glGetProgramInfoLog(shader, bufSize, &length, infoLog);
+      else glGetShaderInfoLog(shader, bufSize, &length, infoLog);
+      YuiMsg("Compute shaderlog:\n%s\n", infoLog);
+      free(infoLog);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static GLuint YglCreateComputeProgram(const GLchar * body)
+{
+  const GLchar * src[3] = { SHADER_VERSION_COMPUTE, Yglprg_vdp1_cs_common, body };
+  GLuint shader;
+  GLuint prg;
+  GLint status;
+
+  shader = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(shader, 3, src, NULL);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status == GL_FALSE) {
+    YuiMsg("Compile error in VDP1 compute shader.\n");
+    Ygl_printComputeError(shader, 0);
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  prg = glCreateProgram();
+  glAttachShader(prg, shader);
+  glLinkProgram(prg);
+  glDeleteShader(shader);
+  glGetProgramiv(prg, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    YuiMsg("Link error in VDP1 compute shader.\n");
+    Ygl_printComputeError(prg, 1);
+    glDeleteProgram(prg);
+    return 0;
+  }
+  return prg;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglVdp1ComputeInit(void)
+{
+  GLint maj = 0, min = 0;
+
+  if (vdp1_cs_raster_prg != 0) return 0;
+
+  glGetIntegerv(GL_MAJOR_VERSION, &maj);
+  glGetIntegerv(GL_MINOR_VERSION, &min);
+  if ((maj < 4) || ((maj == 4) && (min < 3)) || (glDispatchCompute == NULL)) {
+    YuiMsg("VDP1 compute rasterizer needs OpenGL 4.3 (found %d.%d)\n", maj, min);
+    return -1;
+  }
+
+  vdp1_cs_decode_prg = YglCreateComputeProgram(Yglprg_vdp1_cs_decode);
+  vdp1_cs_raster_prg = YglCreateComputeProgram(Yglprg_vdp1_cs_raster);
+  if ((vdp1_cs_decode_prg == 0) || (vdp1_cs_raster_prg == 0)) {
+    YglVdp1ComputeDeInit();
+    return -1;
+  }
+  vdp1_cs_id_tilesx = glGetUniformLocation(vdp1_cs_raster_prg, "u_tilesx");
+  vdp1_cs_id_fbsize = glGetUniformLocation(vdp1_cs_raster_prg, "u_fbsize");
+  vdp1_cs_id_scale = glGetUniformLocation(vdp1_cs_raster_prg, "u_scale");
+  vdp1_cs_id_sysclip = glGetUniformLocation(vdp1_cs_raster_prg, "u_sysclip");
+
+  glGenBuffers(4, vdp1_cs_ssbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[0]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, VDP1_CS_RAM_SIZE, NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[2]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, VDP1_CS_TEXEL_INITIAL * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  vdp1_cs_texel_capacity = VDP1_CS_TEXEL_INITIAL;
+
+  vdp1_cs_count = 0;
+  vdp1_cs_texels = 0;
+  vdp1_cs_maxh = 0;
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglVdp1ComputeDeInit(void)
+{
+  if (vdp1_cs_decode_prg != 0) glDeleteProgram(vdp1_cs_decode_prg);
+  if (vdp1_cs_raster_prg != 0) glDeleteProgram(vdp1_cs_raster_prg);
+  vdp1_cs_decode_prg = 0;
+  vdp1_cs_raster_prg = 0;
+  if (vdp1_cs_ssbo[0] != 0) glDeleteBuffers(4, vdp1_cs_ssbo);
+  memset(vdp1_cs_ssbo, 0, sizeof(vdp1_cs_ssbo));
+  free(vdp1_cs_cmds);
+  vdp1_cs_cmds = NULL;
+  vdp1_cs_capacity = 0;
+  free(vdp1_cs_tiles);
+  vdp1_cs_tiles = NULL;
+  vdp1_cs_tile_capacity = 0;
+  vdp1_cs_count = 0;
+  vdp1_cs_texels = 0;
+  vdp1_cs_texel_capacity = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglVdp1ComputeAdd(YglVdp1ComputeCmd * cmd)
+{
+  if (vdp1_cs_raster_prg == 0) return;
+
+  if (vdp1_cs_count >= vdp1_cs_capacity) {
+    int capacity = (vdp1_cs_capacity == 0) ? 256 : vdp1_cs_capacity * 2;
+    YglVdp1ComputeCmd * cmds = (YglVdp1ComputeCmd *)realloc(vdp1_cs_cmds, capacity * sizeof(YglVdp1ComputeCmd));
+    if (cmds == NULL) return;
+    vdp1_cs_cmds = cmds;
+    vdp1_cs_capacity = capacity;
+  }
+
+  if (cmd->flags & YGL_VDP1_CS_TEXTURED) {
+    cmd->texoffset = vdp1_cs_texels;
+    vdp1_cs_texels += cmd->texw * cmd->texh;
+    if (cmd->texh > vdp1_cs_maxh) vdp1_cs_maxh = cmd->texh;
+  }
+  memcpy(&vdp1_cs_cmds[vdp1_cs_count++], cmd, sizeof(YglVdp1ComputeCmd));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int YglVdp1ComputeTileGrow(int size)
+{
+  u32 * tiles;
+  int capacity = (vdp1_cs_tile_capacity == 0) ? 4096 : vdp1_cs_tile_capacity;
+
+  if (size <= vdp1_cs_tile_capacity) return 0;
+  while (capacity < size) capacity *= 2;
+  tiles = (u32 *)realloc(vdp1_cs_tiles, capacity * sizeof(u32));
+  if (tiles == NULL) return -1;
+  vdp1_cs_tiles = tiles;
+  vdp1_cs_tile_capacity = capacity;
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int YglVdp1ComputeTileRange(YglVdp1ComputeCmd * cmd, int clipx, int clipy, int * range)
+{
+  if ((cmd->bbox[2] < 0) || (cmd->bbox[3] < 0) || (cmd->bbox[0] > clipx) || (cmd->bbox[1] > clipy))
+    return 0;
+  range[0] = MAX(cmd->bbox[0], 0) >> VDP1_CS_TILE_SHIFT;
+  range[1] = MAX(cmd->bbox[1], 0) >> VDP1_CS_TILE_SHIFT;
+  range[2] = MIN(cmd->bbox[2], clipx) >> VDP1_CS_TILE_SHIFT;
+  range[3] = MIN(cmd->bbox[3], clipy) >> VDP1_CS_TILE_SHIFT;
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Builds the per tile command lists, tile t owns tiles[tiles[t]] ..
+// tiles[tiles[t + 1] - 1] and each list keeps the command list order.
+// Returns the size of the table, or 0 on failure.
+static int YglVdp1ComputeBin(int clipx, int clipy)
+{
+  int tilesx = (clipx >> VDP1_CS_TILE_SHIFT) + 1;
+  int ntiles = tilesx * ((clipy >> VDP1_CS_TILE_SHIFT) + 1);
+  int range[4];
+  u32 total;
+  int i, t, x, y;
+
+  if (YglVdp1ComputeTileGrow(ntiles + 1) != 0) return 0;
+  memset(vdp1_cs_tiles, 0, (ntiles + 1) * sizeof(u32));
+
+  // Count the commands of each tile in tiles[t + 1]
+  for (i = 0; i < vdp1_cs_count; i++) {
+    if (!YglVdp1ComputeTileRange(&vdp1_cs_cmds[i], clipx, clipy, range)) continue;
+    for (y = range[1]; y <= range[3]; y++)
+      for (x = range[0]; x <= range[2]; x++)
+        vdp1_cs_tiles[y * tilesx + x + 1]++;
+  }
+
+  // Turn the counts into the start of each list
+  total = ntiles + 1;
+  for (t = 0; t < ntiles; t++) {
+    u32 count = vdp1_cs_tiles[t + 1];
+    vdp1_cs_tiles[t + 1] = total;
+    total += count;
+  }
+  vdp1_cs_tiles[0] = ntiles + 1;
+  if (YglVdp1ComputeTileGrow(total) != 0) return 0;
+
+  // Fill the lists, tiles[t + 1] ends up on the end of the list of tile t
+  for (i = 0; i < vdp1_cs_count; i++) {
+    if (!YglVdp1ComputeTileRange(&vdp1_cs_cmds[i], clipx, clipy, range)) continue;
+    for (y = range[1]; y <= range[3]; y++)
+      for (x = range[0]; x <= range[2]; x++)
+        vdp1_cs_tiles[vdp1_cs_tiles[y * tilesx + x + 1]++] = i;
+  }
+  return total;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglVdp1ComputeExecute(u8 * ram, int id)
+{
+  int clipx = Vdp1Regs->systemclipX2;
+  int clipy = Vdp1Regs->systemclipY2;
+  int tilesize;
+
+  if ((vdp1_cs_raster_prg == 0) || (vdp1_cs_count == 0)) return;
+
+  tilesize = YglVdp1ComputeBin(clipx, clipy);
+  if (tilesize == 0) {
+    vdp1_cs_count = 0;
+    vdp1_cs_texels = 0;
+    vdp1_cs_maxh = 0;
+    return;
+  }
+
+  YglGenFrameBuffer();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[0]);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, VDP1_CS_RAM_SIZE, ram);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[1]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, vdp1_cs_count * sizeof(YglVdp1ComputeCmd), vdp1_cs_cmds, GL_STREAM_DRAW);
+  if (vdp1_cs_texels > vdp1_cs_texel_capacity) {
+    while (vdp1_cs_texel_capacity < vdp1_cs_texels) vdp1_cs_texel_capacity *= 2;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[2]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, vdp1_cs_texel_capacity * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, vdp1_cs_ssbo[3]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, tilesize * sizeof(u32), vdp1_cs_tiles, GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vdp1_cs_ssbo[0]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vdp1_cs_ssbo[1]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, vdp1_cs_ssbo[2]);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, vdp1_cs_ssbo[3]);
+
+  if (vdp1_cs_texels != 0) {
+    glUseProgram(vdp1_cs_decode_prg);
+    glDispatchCompute((vdp1_cs_maxh + VDP1_CS_DECODE_SIZE - 1) / VDP1_CS_DECODE_SIZE, vdp1_cs_count, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+
+  glUseProgram(vdp1_cs_raster_prg);
+  glUniform1i(vdp1_cs_id_tilesx, (clipx >> VDP1_CS_TILE_SHIFT) + 1);
+  glUniform2i(vdp1_cs_id_fbsize, _Ygl->width, _Ygl->height);
+  glUniform2f(vdp1_cs_id_scale,
+    (float)_Ygl->rwidth / (float)_Ygl->width / vdp1wratio,
+    (float)_Ygl->rheight / (float)_Ygl->height / vdp1hratio);
+  glUniform2i(vdp1_cs_id_sysclip, clipx, clipy);
+  glBindImageTexture(0, _Ygl->vdp1FrameBuff[id], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+  glDispatchCompute((_Ygl->width + VDP1_CS_LOCAL_SIZE - 1) / VDP1_CS_LOCAL_SIZE,
+    (_Ygl->height + VDP1_CS_LOCAL_SIZE - 1) / VDP1_CS_LOCAL_SIZE, 1);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+  glUseProgram(0);
+
+  vdp1_cs_count = 0;
+  vdp1_cs_texels = 0;
+  vdp1_cs_maxh = 0;
+}
+
+#endif
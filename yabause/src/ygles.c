@@ -51,6 +51,13 @@ static void YglRenderDestinationAlpha(Vdp2 *varVdp2Regs);
 static void waitVdp1End(int id);
 static void executeTMVDP1(int in, int out);
 
+// Persistent mapped upload buffers need glBufferStorage, only resolved
+// through GLEW on desktop builds; other ports keep the map/unmap path.
+#if defined(_USEGLEW_) && !defined(__LIBRETRO__) && defined(GL_MAP_PERSISTENT_BIT)
+#define YGL_TM_PERSISTENT
+#endif
+static int YglTMPersistentSupported = 0;
+
 u32 * YglGetColorRamPointer();
 
 int YglGenFrameBuffer();
@@ -61,7 +68,7 @@ void Ygl_uniformVDP2DrawFramebuffer_perline(void * p, float from, float to, u32
 
 extern vdp2rotationparameter_struct  Vdp1ParaA;
 #ifdef VDP1_TEXTURE_ASYNC
-extern int waitVdp1Textures( int sync);
+extern int waitVdp1Textures(int id, int sync);
 #endif
 
 #define ATLAS_BIAS (0.025f)
@@ -515,6 +522,60 @@ int YglCalcTextureQ(
 
 //////////////////////////////////////////////////////////////////////////////
 
+#ifdef YGL_TM_PERSISTENT
+static void YglTMWaitFence(GLsync * fence) {
+  int end = 0;
+  if (*fence == 0) return;
+  while (end == 0) {
+    GLenum ret = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 20000000);
+    if ((ret == GL_CONDITION_SATISFIED) || (ret == GL_ALREADY_SIGNALED) || (ret == GL_WAIT_FAILED)) end = 1;
+  }
+  glDeleteSync(*fence);
+  *fence = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglTMDeleteRing(GLuint * buffers, GLsync * fences) {
+  int i;
+  for (i = 0; i < YGL_TM_RING_SIZE; i++) {
+    if (fences[i] != 0) glDeleteSync(fences[i]);
+    fences[i] = 0;
+  }
+  // Deleting the buffers also releases their persistent mappings
+  glDeleteBuffers(YGL_TM_RING_SIZE, buffers);
+  for (i = 0; i < YGL_TM_RING_SIZE; i++) buffers[i] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Allocates YGL_TM_RING_SIZE immutable pixel buffers mapped once for the
+// lifetime of the texture manager. Each push uploads from one segment and
+// fences it, so the CPU only waits when it wraps around to a segment the
+// GPU is still reading.
+static int YglTMCreateRing(unsigned int width, unsigned int height, GLuint * buffers, unsigned int ** ptrs, GLsync * fences) {
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  int i;
+
+  glGenBuffers(YGL_TM_RING_SIZE, buffers);
+  for (i = 0; i < YGL_TM_RING_SIZE; i++) {
+    fences[i] = 0;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, width * height * 4, NULL, flags);
+    ptrs[i] = (unsigned int *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, width * height * 4, flags);
+    if (ptrs[i] == NULL) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      YglTMDeleteRing(buffers, fences);
+      return -1;
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return 0;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
 YglTextureManager * YglTMInit(unsigned int w, unsigned int h) {
 
   GLuint error;
@@ -524,15 +585,25 @@ YglTextureManager * YglTMInit(unsigned int w, unsigned int h) {
   tm->width = w;
   tm->height = h;
   tm->mtx =  YabThreadCreateMutex();
+  YglCacheInit(tm);
 
   tm->currentX = 0;
   tm->currentY = 0;
   tm->yMax = 0;
 
-  glGenBuffers(1, &tm->pixelBufferID);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, tm->width * tm->height * 4, NULL, GL_DYNAMIC_DRAW);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#ifdef YGL_TM_PERSISTENT
+  if (YglTMPersistentSupported && (YglTMCreateRing(tm->width, tm->height, tm->ringBufferID, tm->ringTexture, tm->ringFence) == 0)) {
+    tm->persistent = 1;
+    tm->ringIndex = 0;
+  }
+#endif
+
+  if (tm->persistent == 0) {
+    glGenBuffers(1, &tm->pixelBufferID);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, tm->width * tm->height * 4, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
 
   glGenTextures(1, &tm->textureID);
   glBindTexture(GL_TEXTURE_2D, tm->textureID);
@@ -542,10 +613,14 @@ YglTextureManager * YglTMInit(unsigned int w, unsigned int h) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-  glBindTexture(GL_TEXTURE_2D, tm->textureID);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
-  tm->texture = (unsigned int *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, tm->width * tm->height * 4, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (tm->persistent) {
+    tm->texture = tm->ringTexture[tm->ringIndex];
+  } else {
+    glBindTexture(GL_TEXTURE_2D, tm->textureID);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
+    tm->texture = (unsigned int *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, tm->width * tm->height * 4, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
 
   YglGetColorRamPointer();
 
@@ -555,8 +630,15 @@ YglTextureManager * YglTMInit(unsigned int w, unsigned int h) {
 //////////////////////////////////////////////////////////////////////////////
 
 void YglTMDeInit(YglTextureManager * tm) {
+  YglCacheDeInit(tm);
+  free(tm->pages);
+  free(tm->entries);
+  free(tm->dirty);
   glDeleteTextures(1, &tm->textureID);
-  glDeleteBuffers(1, &tm->pixelBufferID);
+#ifdef YGL_TM_PERSISTENT
+  if (tm->persistent) YglTMDeleteRing(tm->ringBufferID, tm->ringFence);
+#endif
+  if (tm->pixelBufferID != 0) glDeleteBuffers(1, &tm->pixelBufferID);
   free(tm);
 }
 
@@ -565,9 +647,311 @@ void YglTMDeInit(YglTextureManager * tm) {
 void YglTMReset(YglTextureManager * tm  ) {
   YabThreadLock(tm->mtx);
   tm->currentX = 0;
-  tm->currentY = 0;
-  tm->yMax = 0;
+  tm->currentY = tm->persistentHeight;
+  tm->yMax = tm->persistentHeight;
+  YabThreadUnLock(tm->mtx);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglTMPageReset(YglTextureManager * tm, YglTMPage * page) {
+  page->nodeCount = 1;
+  page->node[0].x = 0;
+  page->node[0].y = 0;
+  page->node[0].w = tm->persistentWidth;
+  page->lastUse = 0;
+  page->generation++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglTMSetPersistentBudget(YglTextureManager * tm, u32 bytes) {
+  unsigned int rows;
+  int i;
+
+  YabThreadLock(tm->mtx);
+  free(tm->pages);
+  free(tm->entries);
+  free(tm->dirty);
+  tm->pages = NULL;
+  tm->entries = NULL;
+  tm->dirty = NULL;
+  tm->dirtyCount = 0;
+  tm->persistentWidth = 0;
+  tm->persistentHeight = 0;
+
+  // Keep at least half of the atlas for the per frame allocations
+  rows = bytes / (tm->width * 4);
+  if (rows > tm->height / 2) rows = tm->height / 2;
+  tm->pageCount = rows / YGL_TM_PAGE_HEIGHT;
+
+  if (tm->pageCount != 0) {
+    tm->pages = (YglTMPage *)calloc(tm->pageCount, sizeof(YglTMPage));
+    tm->entries = (YglTMEntry *)calloc(YGL_TM_ENTRY_COUNT, sizeof(YglTMEntry));
+    tm->dirty = (YglTMRect *)malloc(YGL_TM_DIRTY_MAX * sizeof(YglTMRect));
+    tm->persistentWidth = tm->width;
+    tm->persistentHeight = tm->pageCount * YGL_TM_PAGE_HEIGHT;
+    tm->frame = 1;
+    for (i = 0; i < tm->pageCount; i++) YglTMPageReset(tm, &tm->pages[i]);
+  }
+  YabThreadUnLock(tm->mtx);
+  YglTMReset(tm);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Returns the lowest y at which a w x h block fits when its left edge is
+// placed on skyline node 'index', or -1 when it does not fit.
+static int YglSkylineFit(YglTextureManager * tm, YglTMPage * page, int index, unsigned int w, unsigned int h) {
+  unsigned int remaining = w;
+  unsigned int top = 0;
+  int i = index;
+
+  if (page->node[index].x + w > tm->persistentWidth) return -1;
+  for (;;) {
+    if (i >= page->nodeCount) return -1;
+    if (page->node[i].y > top) top = page->node[i].y;
+    if (top + h > YGL_TM_PAGE_HEIGHT) return -1;
+    if (page->node[i].w >= remaining) break;
+    remaining -= page->node[i].w;
+    i++;
+  }
+  return top;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static int YglSkylineAllocate(YglTextureManager * tm, YglTMPage * page, unsigned int w, unsigned int h, unsigned int * x, unsigned int * y) {
+  int best = -1;
+  unsigned int bestBottom = 0xFFFFFFFF;
+  unsigned int bestWidth = 0xFFFFFFFF;
+  unsigned int bestY = 0;
+  int i;
+
+  if (page->nodeCount >= YGL_TM_SKYLINE_NODES) return 0;
+
+  // Bottom-left rule: lowest resulting top edge, then the tightest node
+  for (i = 0; i < page->nodeCount; i++) {
+    int top = YglSkylineFit(tm, page, i, w, h);
+    if (top < 0) continue;
+    if ((top + h < bestBottom) || ((top + h == bestBottom) && (page->node[i].w < bestWidth))) {
+      best = i;
+      bestBottom = top + h;
+      bestWidth = page->node[i].w;
+      bestY = top;
+    }
+  }
+  if (best < 0) return 0;
+
+  *x = page->node[best].x;
+  *y = bestY;
+
+  memmove(&page->node[best + 1], &page->node[best], (page->nodeCount - best) * sizeof(YglSkylineNode));
+  page->node[best].y = bestY + h;
+  page->node[best].w = w;
+  page->nodeCount++;
+
+  // Trim the nodes now covered by the new one
+  for (i = best + 1; i < page->nodeCount; i++) {
+    unsigned int end = page->node[i - 1].x + page->node[i - 1].w;
+    unsigned int shrink;
+    if (page->node[i].x >= end) break;
+    shrink = end - page->node[i].x;
+    if (page->node[i].w > shrink) {
+      page->node[i].x += shrink;
+      page->node[i].w -= shrink;
+      break;
+    }
+    memmove(&page->node[i], &page->node[i + 1], (page->nodeCount - i - 1) * sizeof(YglSkylineNode));
+    page->nodeCount--;
+    i--;
+  }
+
+  // Merge neighbours at the same height
+  for (i = 0; i < page->nodeCount - 1; i++) {
+    if (page->node[i].y == page->node[i + 1].y) {
+      page->node[i].w += page->node[i + 1].w;
+      memmove(&page->node[i + 1], &page->node[i + 2], (page->nodeCount - i - 2) * sizeof(YglSkylineNode));
+      page->nodeCount--;
+      i--;
+    }
+  }
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglTMFind(YglTextureManager * tm, u64 key, YglCache * c) {
+  u32 index;
+  int i;
+
+  if (tm->entries == NULL) return 0;
+
+  YabThreadLock(tm->mtx);
+  index = (u32)YglHashMix64(key);
+  for (i = 0; i < YGL_TM_ENTRY_PROBE; i++) {
+    YglTMEntry * e = &tm->entries[(index + i) & (YGL_TM_ENTRY_COUNT - 1)];
+    if (e->key == 0) break;
+    if (e->key == key) {
+      YglTMPage * page = &tm->pages[e->page];
+      if (e->generation != page->generation) break;
+      page->lastUse = tm->frame;
+      c->x = e->x;
+      c->y = e->y;
+      tm->stats.hit++;
+      YabThreadUnLock(tm->mtx);
+      return 1;
+    }
+  }
+  tm->stats.miss++;
+  YabThreadUnLock(tm->mtx);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglTMAddDirty(YglTextureManager * tm, unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
+  if (tm->dirtyCount != 0) {
+    YglTMRect * last = &tm->dirty[tm->dirtyCount - 1];
+    if ((last->y == y) && (last->h == h) && (last->x + last->w == x)) {
+      last->w += w;
+      return;
+    }
+  }
+  tm->dirty[tm->dirtyCount].x = x;
+  tm->dirty[tm->dirtyCount].y = y;
+  tm->dirty[tm->dirtyCount].w = w;
+  tm->dirty[tm->dirtyCount].h = h;
+  tm->dirtyCount++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Reserves a block that survives YglTmPush. Returns 0 when the caller has
+// to fall back to a per frame allocation.
+int YglTMAllocatePersistent(YglTextureManager * tm, u64 key, YglTexture * output, unsigned int w, unsigned int h, YglCache * c) {
+  YglTMEntry * slot = NULL;
+  u32 index;
+  unsigned int x, y;
+  int pageid = -1;
+  int i;
+
+  if ((tm->entries == NULL) || (key == 0) || (h > YGL_TM_PAGE_HEIGHT) || (w > tm->persistentWidth)) return 0;
+
+  YabThreadLock(tm->mtx);
+  if ((tm->texture == NULL) || (tm->dirtyCount >= YGL_TM_DIRTY_MAX)) {
+    tm->stats.full++;
+    YabThreadUnLock(tm->mtx);
+    return 0;
+  }
+
+  // Any probed slot that is empty, stale or holds this key can be reused
+  index = (u32)YglHashMix64(key);
+  for (i = 0; i < YGL_TM_ENTRY_PROBE; i++) {
+    YglTMEntry * e = &tm->entries[(index + i) & (YGL_TM_ENTRY_COUNT - 1)];
+    if ((e->key == 0) || (e->key == key) || (e->generation != tm->pages[e->page].generation)) {
+      slot = e;
+      break;
+    }
+  }
+  if (slot == NULL) {
+    tm->stats.full++;
+    YabThreadUnLock(tm->mtx);
+    return 0;
+  }
+
+  for (i = 0; i < tm->pageCount; i++) {
+    if (YglSkylineAllocate(tm, &tm->pages[i], w, h, &x, &y)) {
+      pageid = i;
+      break;
+    }
+  }
+
+  if (pageid < 0) {
+    // Evict the least recently used page not referenced by this frame
+    u32 oldest = tm->frame;
+    for (i = 0; i < tm->pageCount; i++) {
+      if (tm->pages[i].lastUse < oldest) {
+        oldest = tm->pages[i].lastUse;
+        pageid = i;
+      }
+    }
+    if (pageid < 0) {
+      tm->stats.full++;
+      YabThreadUnLock(tm->mtx);
+      return 0;
+    }
+    YGLDEBUG("evict texture page %d\n", pageid);
+    YglTMPageReset(tm, &tm->pages[pageid]);
+    tm->stats.evict++;
+    if (!YglSkylineAllocate(tm, &tm->pages[pageid], w, h, &x, &y)) {
+      YabThreadUnLock(tm->mtx);
+      return 0;
+    }
+  }
+
+  y += pageid * YGL_TM_PAGE_HEIGHT;
+  tm->pages[pageid].lastUse = tm->frame;
+
+  slot->key = key;
+  slot->x = x;
+  slot->y = y;
+  slot->page = pageid;
+  slot->generation = tm->pages[pageid].generation;
+
+  YglTMAddDirty(tm, x, y, w, h);
+
+  output->w = tm->width - w;
+  output->textdata = tm->texture + y * tm->width + x;
+  c->x = x;
+  c->y = y;
   YabThreadUnLock(tm->mtx);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Uploads the persistent blocks written this frame. The source pixel buffer
+// and the atlas texture have to be bound by the caller.
+static void YglTMFlushPersistent(YglTextureManager * tm) {
+  int i;
+  if (tm->dirtyCount == 0) return;
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, tm->width);
+  for (i = 0; i < tm->dirtyCount; i++) {
+    YglTMRect * r = &tm->dirty[i];
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r->x, r->y, r->w, r->h, GL_RGBA, GL_UNSIGNED_BYTE, (void *)(pointer)((r->y * tm->width + r->x) * 4));
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  tm->dirtyCount = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// The persistent blocks only live in the texture, so they have to be copied
+// on the GPU when the atlas is reallocated.
+static void YglTMCopyPersistent(YglTextureManager * tm, GLuint src, GLuint dst) {
+  GLuint fbo[2];
+  GLint draw_fbo, read_fbo;
+  GLboolean scissor;
+
+  if (tm->persistentHeight == 0) return;
+
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+  scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+
+  glGenFramebuffers(2, fbo);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[0]);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, src, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[1]);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0);
+  glBlitFramebuffer(0, 0, tm->persistentWidth, tm->persistentHeight, 0, 0, tm->persistentWidth, tm->persistentHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+  glDeleteFramebuffers(2, fbo);
+  if (scissor) glEnable(GL_SCISSOR_TEST);
 }
 
 #if 0
@@ -586,22 +970,54 @@ void YglTMReserve(YglTextureManager * tm, unsigned int w, unsigned int h){
 #endif
 void YglTmPush(YglTextureManager * tm){
 #ifdef VDP1_TEXTURE_ASYNC
-  if ((tm == YglTM_vdp1[0]) || (tm == YglTM_vdp1[1]))
-    waitVdp1Textures(1);
+  if (tm == YglTM_vdp1[0])
+    waitVdp1Textures(0, 1);
+  else if (tm == YglTM_vdp1[1])
+    waitVdp1Textures(1, 1);
   else WaitVdp2Async(1);
 #endif
   YabThreadLock(tm->mtx);
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, tm->textureID);
   if (tm->texture != NULL ) {
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tm->width, tm->yMax, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#ifdef YGL_TM_PERSISTENT
+    if (tm->persistent) {
+      // Upload from the current segment and fence it; the next pull moves
+      // on to another segment instead of remapping this one.
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->ringBufferID[tm->ringIndex]);
+      YglTMFlushPersistent(tm);
+      if (tm->yMax > tm->persistentHeight)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tm->persistentHeight, tm->width, tm->yMax - tm->persistentHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void *)(pointer)(tm->persistentHeight * tm->width * 4));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      tm->ringFence[tm->ringIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      tm->ringIndex = (tm->ringIndex + 1) % YGL_TM_RING_SIZE;
+    } else
+#endif
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      YglTMFlushPersistent(tm);
+      if (tm->yMax > tm->persistentHeight)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tm->persistentHeight, tm->width, tm->yMax - tm->persistentHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void *)(pointer)(tm->persistentHeight * tm->width * 4));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
     tm->texture = NULL;
   }
+  tm->frame++;
   YabThreadUnLock(tm->mtx);
   YglTMReset(tm);
+#ifdef _VDP_PROFILE_
+  // Cell cache hit/miss/overflow counts of the frame
+  if (tm == YglTM_vdp2) {
+    char event[32];
+    snprintf(event, sizeof(event), "C%u/%u/%u",
+      (u32)MIN(tm->cacheStats.hit - tm->cacheStatsLast.hit, 99999),
+      (u32)MIN(tm->cacheStats.miss - tm->cacheStatsLast.miss, 99999),
+      (u32)MIN(tm->cacheStats.overflow - tm->cacheStatsLast.overflow, 99999));
+    FrameProfileAdd(event);
+  }
+  tm->cacheStatsLast = tm->cacheStats;
+#endif
   YglCacheReset(tm);
 }
 
@@ -611,6 +1027,12 @@ void YglTmPull(YglTextureManager * tm, u32 flg){
   if (tm == YglTM_vdp1[1])
     waitVdp1End(1);
   YabThreadLock(tm->mtx);
+#ifdef YGL_TM_PERSISTENT
+  if ((tm->texture == NULL) && tm->persistent) {
+    YglTMWaitFence(&tm->ringFence[tm->ringIndex]);
+    tm->texture = tm->ringTexture[tm->ringIndex];
+  }
+#endif
   if (tm->texture == NULL) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tm->textureID);
@@ -632,6 +1054,63 @@ void YglTMCheck()
   }
 }
 
+#ifdef YGL_TM_PERSISTENT
+static void YglTMReallocRing(YglTextureManager * tm, unsigned int width, unsigned int height) {
+  GLuint new_textureID;
+  GLuint new_buffers[YGL_TM_RING_SIZE];
+  unsigned int * new_ptrs[YGL_TM_RING_SIZE];
+  GLsync new_fences[YGL_TM_RING_SIZE];
+  GLsync copy;
+  int dh;
+
+  if (YglTMCreateRing(width, height, new_buffers, new_ptrs, new_fences) != 0) {
+    YGLLOG("can't allocate persistent texture buffers: %dx%d\n", width, height);
+    abort();
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, tm->textureID);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->ringBufferID[tm->ringIndex]);
+  YglTMFlushPersistent(tm);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  glGenTextures(1, &new_textureID);
+  glBindTexture(GL_TEXTURE_2D, new_textureID);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  YglTMCopyPersistent(tm, tm->textureID, new_textureID);
+
+  dh = tm->height;
+  if (dh > height) dh = height;
+
+  // Carry the current segment over on the GPU, and wait for it before the
+  // CPU starts writing into the new mapping
+  glBindBuffer(GL_COPY_READ_BUFFER, tm->ringBufferID[tm->ringIndex]);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffers[0]);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, tm->width * dh * 4);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  copy = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  YglTMWaitFence(&copy);
+
+  glDeleteTextures(1, &tm->textureID);
+  YglTMDeleteRing(tm->ringBufferID, tm->ringFence);
+
+  memcpy(tm->ringBufferID, new_buffers, sizeof(new_buffers));
+  memcpy(tm->ringTexture, new_ptrs, sizeof(new_ptrs));
+  memcpy(tm->ringFence, new_fences, sizeof(new_fences));
+  tm->ringIndex = 0;
+  tm->width = width;
+  tm->height = height;
+  tm->texture = tm->ringTexture[0];
+  tm->textureID = new_textureID;
+}
+#endif
+
 static void YglTMRealloc(YglTextureManager * tm, unsigned int width, unsigned int height ){
   GLuint new_textureID;
   GLuint new_pixelBufferID;
@@ -640,16 +1119,26 @@ static void YglTMRealloc(YglTextureManager * tm, unsigned int width, unsigned in
   int dh;
 
 #ifdef VDP1_TEXTURE_ASYNC
-  if ((tm == YglTM_vdp1[0]) || (tm == YglTM_vdp1[1]))
-    waitVdp1Textures(1);
+  if (tm == YglTM_vdp1[0])
+    waitVdp1Textures(0, 1);
+  else if (tm == YglTM_vdp1[1])
+    waitVdp1Textures(1, 1);
   else WaitVdp2Async(1);
 #endif
 
+#ifdef YGL_TM_PERSISTENT
+  if (tm->persistent) {
+    YglTMReallocRing(tm, width, height);
+    return;
+  }
+#endif
+
   if (tm->texture != NULL) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tm->textureID);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tm->pixelBufferID);
     glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    YglTMFlushPersistent(tm);
     tm->texture = NULL;
   }
 
@@ -663,6 +1152,8 @@ static void YglTMRealloc(YglTextureManager * tm, unsigned int width, unsigned in
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 
+  YglTMCopyPersistent(tm, tm->textureID, new_textureID);
+
   glGenBuffers(1, &new_pixelBufferID);
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, new_pixelBufferID);
   glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * 4, NULL, GL_DYNAMIC_DRAW);
@@ -730,11 +1221,11 @@ static void YglTMAllocate_in(YglTextureManager * tm, YglTexture * output, unsign
 
 void getCurrentOpenGLContext() {
   YabThreadLock(_Ygl->mutex);
-  YuiUseOGLOnThisThread();
+  if (!YglPresentIsRunning()) YuiUseOGLOnThisThread();
 }
 
 void releaseCurrentOpenGLContext() {
-  YuiRevokeOGLOnThisThread();
+  if (!YglPresentIsRunning()) YuiRevokeOGLOnThisThread();
   YabThreadUnLock(_Ygl->mutex);
 }
 
@@ -744,9 +1235,24 @@ void YglTMAllocate(YglTextureManager * tm, YglTexture * output, unsigned int w,
   YabThreadUnLock(tm->mtx);
 }
 
-u32* getVdp1DrawingFBMem(int id) {
-  u32* fbptr = NULL;
-  GLuint error;
+#define VDP1FB_ACCESS_SIZE (512 * 256 * 4)
+
+static void YglVdp1FBWait(int id) {
+  int end = 0;
+  if (_Ygl->vdp1fb_sync[id] == 0) return;
+  while (end == 0) {
+    GLenum ret = glClientWaitSync(_Ygl->vdp1fb_sync[id], GL_SYNC_FLUSH_COMMANDS_BIT, 20000000);
+    if ((ret == GL_CONDITION_SATISFIED) || (ret == GL_ALREADY_SIGNALED) || (ret == GL_WAIT_FAILED)) end = 1;
+  }
+  glDeleteSync(_Ygl->vdp1fb_sync[id]);
+  _Ygl->vdp1fb_sync[id] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Renders the pending VDP1 commands and converts the framebuffer into the
+// 512x256 access texture, in the layout used by the CPU copy.
+static void YglVdp1FBBlitAccess(int id) {
   executeTMVDP1(id, id);
   YglGenFrameBuffer();
   glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->vdp1AccessFB);
@@ -754,14 +1260,158 @@ u32* getVdp1DrawingFBMem(int id) {
   glViewport(0,0,_Ygl->rwidth,_Ygl->rheight);
   YglBlitVDP1(_Ygl->vdp1FrameBuff[id], 512.0, 256.0, 0);
   glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->default_fbo);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Queues a copy of the access texture into the readback buffer
+static void YglVdp1FBReadback(int id) {
+  glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->vdp1AccessFB);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _Ygl->vdp1AccessTex[id], 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _Ygl->vdp1_pbo[id]);
+  glReadPixels(0, 0, 512, 256, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->default_fbo);
+  if (_Ygl->vdp1fb_sync[id] != 0) glDeleteSync(_Ygl->vdp1fb_sync[id]);
+  _Ygl->vdp1fb_sync[id] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
 
+static void YglVdp1FBCopyReadback(int id) {
+  void * src;
+  YglVdp1FBWait(id);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _Ygl->vdp1_pbo[id]);
+  src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, VDP1FB_ACCESS_SIZE, GL_MAP_READ_BIT);
+  if (src != NULL) {
+    memcpy(_Ygl->vdp1fb_shadow[id], src, VDP1FB_ACCESS_SIZE);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _Ygl->vdp1fb_valid[id] = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Uploads the staged writes to the access texture in one pass, joining
+// rectangles that stack vertically with the same span.
+static void YglVdp1FBFlushDirty(int id) {
+  YglTMRect * r = _Ygl->vdp1fb_dirty[id];
+  int count = _Ygl->vdp1fb_dirtycount[id];
+  int i = 0;
+
+  if (count == 0) return;
+  glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, _Ygl->vdp1AccessTex[id]);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _Ygl->vdp1_pbo[id]);
-  fbptr = (u32 *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 0x40000*2, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  return fbptr;
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 512);
+  while (i < count) {
+    int j = i + 1;
+    int h = r[i].h;
+    while ((j < count) && (r[j].x == r[i].x) && (r[j].w == r[i].w) && (r[j].y == r[i].y + h)) {
+      h += r[j].h;
+      j++;
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r[i].x, r[i].y, r[i].w, h, GL_RGBA, GL_UNSIGNED_BYTE, _Ygl->vdp1fb_shadow[id] + r[i].y * 512 + r[i].x);
+    i = j;
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  _Ygl->vdp1fb_dirtycount[id] = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Makes the whole CPU copy valid while keeping the writes already staged
+static void YglVdp1FBSync(int id) {
+  YglVdp1FBFlushDirty(id);
+  YglVdp1FBReadback(id);
+  YglVdp1FBCopyReadback(id);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Called at the end of VDP1 drawing: when the CPU touched the framebuffer
+// in the previous frame, start the readback now so that the first access
+// of this frame finds a completed copy instead of stalling on the GPU.
+void YglPrefetchVDP1FB(void) {
+  int id = _Ygl->drawframe;
+  if ((_Ygl->vdp1fb_predict == 0) || (_Ygl->vdp1fb_buf[id] != NULL)) return;
+  if (_Ygl->vdp1AccessTex[0] == 0) return;
+  YglVdp1FBBlitAccess(id);
+  YglVdp1FBReadback(id);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+u32* getVdp1DrawingFBMem(int id) {
+  _Ygl->vdp1fb_accessed = 1;
+  if (_Ygl->vdp1fb_shadow[id] == NULL)
+    _Ygl->vdp1fb_shadow[id] = (u32 *)malloc(VDP1FB_ACCESS_SIZE);
+  _Ygl->vdp1fb_valid[id] = 0;
+  _Ygl->vdp1fb_dirtycount[id] = 0;
+
+  if ((_Ygl->vdp1fb_sync[id] != 0) && (_Ygl->needVdp1Render == 0)) {
+    // Prefetched at draw end and nothing was drawn since
+    YglVdp1FBCopyReadback(id);
+  } else {
+    if (_Ygl->vdp1fb_sync[id] != 0) {
+      glDeleteSync(_Ygl->vdp1fb_sync[id]);
+      _Ygl->vdp1fb_sync[id] = 0;
+    }
+    YglVdp1FBBlitAccess(id);
+  }
+  return _Ygl->vdp1fb_shadow[id];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglVdp1FBAddDirty(int id, u32 addr, int w) {
+  YglTMRect * r;
+  int count = _Ygl->vdp1fb_dirtycount[id];
+  u32 x = (addr >> 1) & 0x1FF;
+  u32 y = (addr >> 10) & 0xFF;
+
+  if (x + w > 512) w = 512 - x;
+  if (count != 0) {
+    r = &_Ygl->vdp1fb_dirty[id][count - 1];
+    if (_Ygl->vdp1fb_valid[id]) {
+      // The copy is complete: any bounding box can be uploaded
+      if ((x + w >= r->x) && (x <= r->x + r->w) && (y + 1 >= r->y) && (y <= r->y + r->h)) {
+        u32 x1 = MAX(r->x + r->w, x + w);
+        u32 y1 = MAX(r->y + r->h, y + 1);
+        r->x = MIN(r->x, x);
+        r->y = MIN(r->y, y);
+        r->w = x1 - r->x;
+        r->h = y1 - r->y;
+        return;
+      }
+    } else {
+      // Only written pixels are known, extend runs on the same line
+      if ((r->h == 1) && (r->y == y) && (x >= r->x) && (x <= r->x + r->w)) {
+        if (x + w > r->x + r->w) r->w = x + w - r->x;
+        return;
+      }
+    }
+  }
+
+  if (count >= YGL_VDP1FB_DIRTY_MAX) {
+    if (!_Ygl->vdp1fb_valid[id]) {
+      YglVdp1FBSync(id);
+    } else {
+      YglVdp1FBFlushDirty(id);
+    }
+    count = 0;
+  }
+  r = &_Ygl->vdp1fb_dirty[id][count];
+  r->x = x;
+  r->y = y;
+  r->w = w;
+  r->h = 1;
+  _Ygl->vdp1fb_dirtycount[id] = count + 1;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
 u32 COLOR16TO24(u16 temp) {
   if ((temp>>15)&0x1 == 1)
     return (((u32)temp & 0x1F) << 3 | ((u32)temp & 0x3E0) << 6 | ((u32)temp & 0x7C00) << 9);
@@ -788,11 +1438,13 @@ void VIDOGLVdp1WriteFrameBuffer(u32 type, u32 addr, u32 val ) {
     break;
   case 1:
     T1WriteLong((u8*)_Ygl->vdp1fb_buf[_Ygl->drawframe], addr*2, VDP1COLOR(rgb, 0, priority, 0, COLOR16TO24(val&0xFFFF)));
+    YglVdp1FBAddDirty(_Ygl->drawframe, addr, 1);
     break;
   case 2:
     T1WriteLong((u8*)_Ygl->vdp1fb_buf[_Ygl->drawframe], addr*2+4, VDP1COLOR(rgb, 0, priority, 0, COLOR16TO24(val&0xFFFF)));
     rgb = !(((val>>16)>>15)&0x1);
     T1WriteLong((u8*)_Ygl->vdp1fb_buf[_Ygl->drawframe], addr*2, VDP1COLOR(rgb, 0, priority, 0, COLOR16TO24((val>>16)&0xFFFF)));
+    YglVdp1FBAddDirty(_Ygl->drawframe, addr, 2);
     break;
   default:
     break;
@@ -804,6 +1456,7 @@ void VIDOGLVdp1ReadFrameBuffer(u32 type, u32 addr, void * out) {
     if (_Ygl->vdp1fb_buf[_Ygl->drawframe] == NULL) {
       _Ygl->vdp1fb_buf[_Ygl->drawframe] =  getVdp1DrawingFBMem(_Ygl->drawframe);
     }
+    if (!_Ygl->vdp1fb_valid[_Ygl->drawframe]) YglVdp1FBSync(_Ygl->drawframe);
     switch (type)
     {
     case 0:
@@ -873,7 +1526,7 @@ int YglGenFrameBuffer() {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
     glBindBuffer(GL_PIXEL_PACK_BUFFER, _Ygl->vdp1_pbo[0]);
-    glBufferData(GL_PIXEL_PACK_BUFFER, 0x40000*2, NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 0x40000*2, NULL, GL_STREAM_READ);
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -884,7 +1537,7 @@ int YglGenFrameBuffer() {
     glBindTexture(GL_TEXTURE_2D, _Ygl->vdp1AccessTex[1]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glBindBuffer(GL_PIXEL_PACK_BUFFER, _Ygl->vdp1_pbo[1]);
-    glBufferData(GL_PIXEL_PACK_BUFFER, 0x40000*2, NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 0x40000*2, NULL, GL_STREAM_READ);
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -1091,6 +1744,18 @@ int YglInit(int width, int height, unsigned int depth) {
 
   memset(_Ygl,0,sizeof(Ygl));
 
+#ifdef YGL_PRESENT_THREAD
+  // The display context goes to the presentation thread, the rendering
+  // objects are created in the shared context of this thread
+  if (yabsys.usePresentThread) {
+    YuiRevokeOGLOnThisThread();
+    if (YglPresentInit() != 0) {
+      YuiMsg("Presentation thread is not possible - fallback on presenting from the emulation thread\n");
+      YuiUseOGLOnThisThread();
+    }
+  }
+#endif
+
   _Ygl->depth = depth;
   _Ygl->rwidth = 320;
   _Ygl->rheight = 240;
@@ -1111,14 +1776,23 @@ int YglInit(int width, int height, unsigned int depth) {
 
 
 #if defined(_USEGLEW_) && !defined(__LIBRETRO__)
-  glewExperimental=GL_TRUE;
-  if (glewInit() != 0) {
-    printf("Glew can not init\n");
-    YabSetError(YAB_ERR_CANNOTINIT, _("Glew"));
-    exit(-1);
+  {
+    GLenum glewerr;
+    glewExperimental=GL_TRUE;
+    glewerr = glewInit();
+    // No GLX display on EGL contexts, the GL entry points are loaded anyway
+    if ((glewerr != GLEW_OK) && (glewerr != GLEW_ERROR_NO_GLX_DISPLAY)) {
+      printf("Glew can not init\n");
+      YabSetError(YAB_ERR_CANNOTINIT, _("Glew"));
+      exit(-1);
+    }
   }
 #endif
 
+#ifdef YGL_TM_PERSISTENT
+  YglTMPersistentSupported = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && (glBufferStorage != NULL);
+#endif
+
   glGenBuffers(1, &_Ygl->quads_buf);
   glGenBuffers(1, &_Ygl->textcoords_buf);
   glGenBuffers(1, &_Ygl->vertexAttribute_buf);
@@ -1178,6 +1852,7 @@ int YglInit(int width, int height, unsigned int depth) {
   YglTM_vdp1[0] = YglTMInit(2048, 2048);
   YglTM_vdp1[1] = YglTMInit(2048, 2048);
   YglTM_vdp2 = YglTMInit(2048, 2048);
+  YglTMSetPersistentBudget(YglTM_vdp2, YGL_TM_PERSISTENT_BUDGET);
 
   _Ygl->smallfbo = 0;
   _Ygl->smallfbotex = 0;
@@ -1208,6 +1883,13 @@ int YglInit(int width, int height, unsigned int depth) {
 void YglDeInit(void) {
    unsigned int i,j;
 
+#ifdef YGL_PRESENT_THREAD
+   // The window context stays with the presentation thread, the objects
+   // below live in the shared context of this thread
+   YglPresentDeInit();
+#endif
+   YglReadbackDeInit();
+   YglThumbnailDeInit();
    if (YglTM_vdp1[0] != NULL) YglTMDeInit(YglTM_vdp1[0]);
    if (YglTM_vdp1[1] != NULL) YglTMDeInit(YglTM_vdp1[1]);
    if (YglTM_vdp2 != NULL)    YglTMDeInit(YglTM_vdp2);
@@ -1224,6 +1906,11 @@ void YglDeInit(void) {
       deinitLevels(_Ygl->vdp1levels[0]);
       if (_Ygl->vdp1levels[1])
       deinitLevels(_Ygl->vdp1levels[1]);
+      if (_Ygl->vdp1fb_shadow[0]) free(_Ygl->vdp1fb_shadow[0]);
+      if (_Ygl->vdp1fb_shadow[1]) free(_Ygl->vdp1fb_shadow[1]);
+#ifdef YGL_VDP1_COMPUTE
+      YglVdp1ComputeDeInit();
+#endif
 
       free(_Ygl);
    }
@@ -2459,16 +3146,22 @@ void YglEraseWriteVDP1(void) {
   if (_Ygl->vdp1FrameBuff[0] == 0) return;
 
   if(_Ygl->vdp1IsNotEmpty[_Ygl->readframe] != 0) {
+    int id = _Ygl->readframe;
+    // The erase replaces everything, no need to read the framebuffer back
+    if (_Ygl->vdp1fb_shadow[id] == NULL) _Ygl->vdp1fb_shadow[id] = (u32 *)malloc(VDP1FB_ACCESS_SIZE);
+    if (_Ygl->vdp1fb_sync[id] != 0) {
+      glDeleteSync(_Ygl->vdp1fb_sync[id]);
+      _Ygl->vdp1fb_sync[id] = 0;
+    }
+    memset(_Ygl->vdp1fb_shadow[id], 0x0, VDP1FB_ACCESS_SIZE);
     glActiveTexture(GL_TEXTURE0);
-    if (_Ygl->vdp1fb_buf[_Ygl->readframe] == NULL) _Ygl->vdp1fb_buf[_Ygl->readframe] =  getVdp1DrawingFBMem(_Ygl->readframe);
-    memset(_Ygl->vdp1fb_buf[_Ygl->readframe], 0x0, 0x40000*2);
-    glBindTexture(GL_TEXTURE_2D, _Ygl->vdp1AccessTex[_Ygl->readframe]);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _Ygl->vdp1_pbo[_Ygl->readframe]);
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 256, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, _Ygl->vdp1AccessTex[id]);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    _Ygl->vdp1IsNotEmpty[_Ygl->readframe] = 0;
-    _Ygl->vdp1fb_buf[_Ygl->readframe] = NULL;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 256, GL_RGBA, GL_UNSIGNED_BYTE, _Ygl->vdp1fb_shadow[id]);
+    _Ygl->vdp1IsNotEmpty[id] = 0;
+    _Ygl->vdp1fb_buf[id] = NULL;
+    _Ygl->vdp1fb_valid[id] = 0;
+    _Ygl->vdp1fb_dirtycount[id] = 0;
   }
 
   glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->vdp1fbo);
@@ -2549,9 +3242,9 @@ static void waitVdp1End(int id) {
 static void executeTMVDP1(int in, int out) {
   if (_Ygl->needVdp1Render != 0){
     YglTmPush(YglTM_vdp1[in]);
-    YuiUseOGLOnThisThread();
+    if (!YglPresentIsRunning()) YuiUseOGLOnThisThread();
     YglRenderVDP1();
-    YuiRevokeOGLOnThisThread();
+    if (!YglPresentIsRunning()) YuiRevokeOGLOnThisThread();
     _Ygl->syncVdp1[in] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
     YglReset(_Ygl->vdp1levels[out]);
     YglTmPull(YglTM_vdp1[out], 0);
@@ -2562,7 +3255,15 @@ static void executeTMVDP1(int in, int out) {
 //////////////////////////////////////////////////////////////////////////////
 void YglFrameChangeVDP1(){
   u32 current_drawframe = 0;
+  int i;
   executeTMVDP1(_Ygl->drawframe, _Ygl->readframe);
+  _Ygl->vdp1fb_predict = _Ygl->vdp1fb_accessed;
+  _Ygl->vdp1fb_accessed = 0;
+  // A prefetch not consumed before the swap would be stale afterwards
+  for (i = 0; i < 2; i++) {
+    if (_Ygl->vdp1fb_sync[i] != 0) glDeleteSync(_Ygl->vdp1fb_sync[i]);
+    _Ygl->vdp1fb_sync[i] = 0;
+  }
   current_drawframe = _Ygl->drawframe;
   _Ygl->drawframe = _Ygl->readframe;
   _Ygl->readframe = current_drawframe;
@@ -3238,13 +3939,9 @@ void YglUpdateVDP1FB(void) {
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _Ygl->rboid_stencil);
     glViewport(0, 0, _Ygl->width, _Ygl->height);
     if (_Ygl->vdp1fb_buf[_Ygl->readframe] != NULL) {
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, _Ygl->vdp1AccessTex[_Ygl->readframe]);
-      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _Ygl->vdp1_pbo[_Ygl->readframe]);
-      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 256, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      YglVdp1FBFlushDirty(_Ygl->readframe);
       _Ygl->vdp1fb_buf[_Ygl->readframe] = NULL;
+      _Ygl->vdp1fb_valid[_Ygl->readframe] = 0;
     }
     YglBlitVDP1(_Ygl->vdp1AccessTex[_Ygl->readframe], (float)_Ygl->rwidth, (float)_Ygl->rheight, 0);
     // clean up
@@ -3271,6 +3968,27 @@ void YglCheckFBSwitch(int sync) {
   }
 }
 
+// Area of the window showing the Saturn screen, keeping the aspect ratio
+// unless the picture is stretched
+void YglGetDisplayRect(double *x, double *y, double *w, double *h) {
+   if (_Ygl->stretch == 0) {
+     double dar = (double)GlWidth/(double)GlHeight;
+     double par = 4.0/3.0;
+
+     if (yabsys.isRotated) par = 1.0/par;
+
+     *w = (dar>par)?(double)GlHeight*par:GlWidth;
+     *h = (dar>par)?(double)GlHeight:(double)GlWidth/par;
+     *x = (GlWidth-*w)/2;
+     *y = (GlHeight-*h)/2;
+   } else {
+     *w = GlWidth;
+     *h = GlHeight;
+     *x = 0;
+     *y = 0;
+   }
+}
+
 void YglRender(Vdp2 *varVdp2Regs) {
    YglLevel * level;
    GLuint cprg=0;
@@ -3288,22 +4006,7 @@ void YglRender(Vdp2 *varVdp2Regs) {
    YGLLOG("YglRender\n");
    glBindVertexArray(_Ygl->vao);
 
-   if (_Ygl->stretch == 0) {
-     double dar = (double)GlWidth/(double)GlHeight;
-     double par = 4.0/3.0;
-
-     if (yabsys.isRotated) par = 1.0/par;
-
-     w = (dar>par)?(double)GlHeight*par:GlWidth;
-     h = (dar>par)?(double)GlHeight:(double)GlWidth/par;
-     x = (GlWidth-w)/2;
-     y = (GlHeight-h)/2;
-   } else {
-     w = GlWidth;
-     h = GlHeight;
-     x = 0;
-     y = 0;
-   }
+   YglGetDisplayRect(&x, &y, &w, &h);
 
    FrameProfileAdd("YglRender start");
    glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->default_fbo);
@@ -3486,9 +4189,20 @@ void YglRender(Vdp2 *varVdp2Regs) {
    if ((varVdp2Regs->SDCTL & 0xFF) != 0 || _Ygl->msb_shadow_count_[_Ygl->readframe] != 0 ) {
      YglRenderFrameBufferShadow();
    }
-   glViewport(x, y, w, h);
-   glScissor(x, y, w, h);
-   YglBlitFramebuffer(_Ygl->original_fbotex, _Ygl->default_fbo, _Ygl->width, _Ygl->height, w, h);
+#ifdef YGL_PRESENT_THREAD
+   if (YglPresentIsRunning()) {
+     // Scale into a presentation slot, the window is updated by the presentation thread
+     GLuint slot = YglPresentTarget((int)w, (int)h);
+     glViewport(0, 0, (int)w, (int)h);
+     glScissor(0, 0, (int)w, (int)h);
+     YglBlitFramebuffer(_Ygl->original_fbotex, slot, _Ygl->width, _Ygl->height, w, h);
+   } else
+#endif
+   {
+     glViewport(x, y, w, h);
+     glScissor(x, y, w, h);
+     YglBlitFramebuffer(_Ygl->original_fbotex, _Ygl->default_fbo, _Ygl->width, _Ygl->height, w, h);
+   }
 
 render_finish:
 
@@ -3504,8 +4218,19 @@ render_finish:
   glDisable(GL_SCISSOR_TEST);
   glDisable(GL_STENCIL_TEST);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  if ((Vdp2Regs->TVMD & 0x8000) != 0) YglThumbnailCapture(_Ygl->original_fbo, _Ygl->width, _Ygl->height);
+#ifdef YGL_PRESENT_THREAD
+  if (YglPresentIsRunning()) {
+    // OSD goes into the slot, the swap is done by the presentation thread
+    YglPresentQueueFrame();
+    FrameProfileAdd("YglRender end");
+    return;
+  }
+#endif
   OSDDisplayMessages(NULL,0,0);
 
+  if (YglReadbackIsEnabled()) YglReadbackQueue(_Ygl->default_fbo, (int)x, (int)y, (int)w, (int)h);
+
   _Ygl->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
   glFlush();
   FrameProfileAdd("YglRender end");
@@ -3929,11 +4654,8 @@ u32 * YglGetColorRamPointer() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    _Ygl->colupd_min_addr = 0xFFFFFFFF ;
-    _Ygl->colupd_max_addr = 0x00000000;
-
-
-
+    memset(_Ygl->cram_dirty, 0, sizeof(_Ygl->cram_dirty));
+    _Ygl->cram_dirty_banks = 0;
   }
 
   if (_Ygl->cram_tex_buf == NULL) {
@@ -3951,19 +4673,20 @@ u32 * YglGetColorRamPointer() {
   return _Ygl->cram_tex_buf;
 }
 
+static INLINE void YglColorRamSetDirty(u32 index) {
+  _Ygl->cram_dirty[index >> 5] |= 1u << (index & 0x1F);
+  _Ygl->cram_dirty_banks |= (u64)1 << (index >> 5);
+}
+
 void YglOnUpdateColorRamWord(u32 addr) {
 
   u32 * buf;
+  u32 index;
   if (_Ygl == NULL) return;
 
   //YabThreadLock(_Ygl->crammutex);
   Vdp2ColorRamUpdated = 1;
 
-  if (_Ygl->colupd_min_addr > addr)
-    _Ygl->colupd_min_addr = addr;
-  if (_Ygl->colupd_max_addr < addr)
-    _Ygl->colupd_max_addr = addr;
-
   buf = _Ygl->cram_tex_buf;
   if (buf == NULL) {
     //YabThreadUnLock(_Ygl->crammutex);
@@ -3979,7 +4702,9 @@ void YglOnUpdateColorRamWord(u32 addr) {
     u8 alpha = 0;
     tmp = T2ReadWord(Vdp2ColorRam, addr);
     if (tmp & 0x8000) alpha = 0xFF;
-    buf[(addr >> 1) & 0x7FF] = SAT2YAB1(alpha, tmp);
+    index = (addr >> 1) & 0x7FF;
+    buf[index] = SAT2YAB1(alpha, tmp);
+    YglColorRamSetDirty(index);
     break;
   }
   case 2:
@@ -3988,7 +4713,9 @@ void YglOnUpdateColorRamWord(u32 addr) {
     u32 tmp2 = T2ReadWord(Vdp2ColorRam, (addr&0xFFC)+2);
     u8 alpha = 0;
     if (tmp1 & 0x8000) alpha = 0xFF;
-    buf[(addr >> 2) & 0x7FF] = SAT2YAB2(alpha, tmp1, tmp2);
+    index = (addr >> 2) & 0x7FF;
+    buf[index] = SAT2YAB2(alpha, tmp1, tmp2);
+    YglColorRamSetDirty(index);
     break;
   }
   default: 
@@ -3997,46 +4724,61 @@ void YglOnUpdateColorRamWord(u32 addr) {
   //YabThreadUnLock(_Ygl->crammutex);
 }
 
+// Dirty runs closer than this are sent in a single upload
+#define YGL_CRAM_MERGE_GAP 16
+
+static void YglUploadColorRamRange(u32 * buf, u32 start, u32 end) {
+  glTexSubImage2D(GL_TEXTURE_2D, 
+    0, 
+    start, 0,
+    end - start + 1, 1,
+    GL_RGBA, GL_UNSIGNED_BYTE, 
+    &buf[start] );
+}
 
 void YglUpdateColorRam() {
   u32 * buf;
-  int index_shft  = 1;
-  u32 start_addr,size;
+  u64 banks;
+  u32 start = 0, end = 0;
+  int pending = 0;
+  int i;
   //YabThreadLock(_Ygl->crammutex);
   if (Vdp2ColorRamUpdated) {
     Vdp2ColorRamUpdated = 0;
-    if (_Ygl->colupd_min_addr > _Ygl->colupd_max_addr) {
+    banks = _Ygl->cram_dirty_banks;
+    if (banks == 0) {
       //YabThreadUnLock(_Ygl->crammutex);
-      return; // !? not initilized?
+      return;
     }
 
     buf = YglGetColorRamPointer();
-    if (Vdp2Internal.ColorMode == 2) {
-      index_shft = 2;
-    }
     glBindTexture(GL_TEXTURE_2D, _Ygl->cram_tex);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    _Ygl->colupd_min_addr &= 0xFFF;
-    _Ygl->colupd_max_addr &= 0xFFF;
-    start_addr = (_Ygl->colupd_min_addr >> index_shft);
-    size = ((_Ygl->colupd_max_addr - _Ygl->colupd_min_addr) >> index_shft) + 1;
-#if 0
-    glTexSubImage2D(GL_TEXTURE_2D,
-      0,
-      0, 0,
-      2048, 1,
-      GL_RGBA, GL_UNSIGNED_BYTE,
-      buf);
-#else
-    glTexSubImage2D(GL_TEXTURE_2D, 
-      0, 
-      start_addr, 0,
-      size, 1,
-      GL_RGBA, GL_UNSIGNED_BYTE, 
-      &buf[start_addr] );
-#endif
-    _Ygl->colupd_min_addr = 0xFFFFFFFF;
-    _Ygl->colupd_max_addr = 0x00000000;
+
+    // Walk the dirty texels of the dirty banks only, and upload them as
+    // a few runs instead of one range spanning every write of the frame
+    for (i = 0; i < YGL_CRAM_DIRTY_WORDS; i++) {
+      u32 bits;
+      if ((banks & ((u64)1 << i)) == 0) continue;
+      bits = _Ygl->cram_dirty[i];
+      _Ygl->cram_dirty[i] = 0;
+      while (bits != 0) {
+        u32 bit = 0;
+        u32 index;
+        while ((bits & (1u << bit)) == 0) bit++;
+        bits &= bits - 1;
+        index = (i << 5) + bit;
+        if (pending && (index <= end + YGL_CRAM_MERGE_GAP)) {
+          end = index;
+        } else {
+          if (pending) YglUploadColorRamRange(buf, start, end);
+          start = end = index;
+          pending = 1;
+        }
+      }
+    }
+    if (pending) YglUploadColorRamRange(buf, start, end);
+    _Ygl->cram_dirty_banks = 0;
   }
   //YabThreadUnLock(_Ygl->crammutex);
   return;
@@ -4160,6 +4902,14 @@ void YglChangeResolution(int w, int h) {
          _Ygl->pFrameBuffer = NULL;
        }
        if (_Ygl->vdp1_pbo[0] != 0) {
+         int i;
+         for (i = 0; i < 2; i++) {
+           if (_Ygl->vdp1fb_sync[i] != 0) glDeleteSync(_Ygl->vdp1fb_sync[i]);
+           _Ygl->vdp1fb_sync[i] = 0;
+           _Ygl->vdp1fb_buf[i] = NULL;
+           _Ygl->vdp1fb_valid[i] = 0;
+           _Ygl->vdp1fb_dirtycount[i] = 0;
+         }
          glDeleteBuffers(2, _Ygl->vdp1_pbo);
          _Ygl->vdp1_pbo[0] = 0;
          _Ygl->vdp1_pbo[1] = 0;
@@ -0,0 +1,263 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*
+  Presentation thread
+
+  The emulation thread renders in the shared (offscreen) context and ends
+  each frame by scaling the picture into one of three slot textures. The
+  presentation thread owns the window context and only copies the newest
+  slot to the window before swapping, so a blocking vsync never stalls the
+  emulation.
+
+  Slots rotate like a classic triple buffer:
+    - write:   filled by the emulation thread
+    - ready:   last complete frame, not yet shown
+    - display: shown by the presentation thread
+  Publishing a frame swaps write and ready, showing one swaps ready and
+  display. A frame that is not shown in time is simply replaced by the next
+  one. Each slot carries two fences: one set when the frame is rendered
+  (waited on by the presentation thread) and one set when it has been
+  copied to the window (waited on before the emulation thread reuses it).
+
+  Textures and fences are shared between the contexts, the framebuffer
+  objects are not: the emulation thread attaches the slots to its own FBO,
+  the presentation thread to another one.
+*/
+
+#include "ygl.h"
+#include "yui.h"
+#include "threads.h"
+#include "osdcore.h"
+
+#ifdef YGL_PRESENT_THREAD
+
+#define YGL_PRESENT_SLOTS 3
+
+extern int GlWidth;
+extern int GlHeight;
+
+typedef struct {
+  GLuint tex;
+  int width;
+  int height;
+  GLsync rendered;
+  GLsync presented;
+} YglPresentSlot;
+
+static struct {
+  YglPresentSlot slot[YGL_PRESENT_SLOTS];
+  int write;
+  int ready;
+  int display;
+  int fresh;
+  int targeted;
+  GLuint fbo;
+  YabMutex *mutex;
+  YabSem *sem;
+  volatile int running;
+} present;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglPresentWaitFence(GLsync *sync) {
+  if (*sync == 0) return;
+  glClientWaitSync(*sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(*sync);
+  *sync = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglPresentThread(void *arg) {
+  GLuint readfbo = 0;
+  YuiUseOGLOnThisThread();
+  glGenFramebuffers(1, &readfbo);
+
+  while (present.running) {
+    YglPresentSlot *slot;
+    GLsync rendered;
+    double x, y, w, h;
+    int tmp;
+
+    YabSemWait(present.sem);
+    if (!present.running) break;
+
+    YabThreadLock(present.mutex);
+    if (!present.fresh) {
+      YabThreadUnLock(present.mutex);
+      continue;
+    }
+    present.fresh = 0;
+    tmp = present.display;
+    present.display = present.ready;
+    present.ready = tmp;
+    slot = &present.slot[present.display];
+    rendered = slot->rendered;
+    slot->rendered = 0;
+    YabThreadUnLock(present.mutex);
+
+    if (rendered != 0) {
+      glWaitSync(rendered, 0, GL_TIMEOUT_IGNORED);
+      glDeleteSync(rendered);
+    }
+
+    // The window may have been resized since the slot was scaled
+    YglGetDisplayRect(&x, &y, &w, &h);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readfbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slot->tex, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _Ygl->default_fbo);
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, GlWidth, GlHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlitFramebuffer(0, 0, slot->width, slot->height, (int)x, (int)y, (int)(x + w), (int)(y + h), GL_COLOR_BUFFER_BIT,
+      ((slot->width == (int)w) && (slot->height == (int)h)) ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    YabThreadLock(present.mutex);
+    if (slot->presented != 0) glDeleteSync(slot->presented);
+    slot->presented = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    YabThreadUnLock(present.mutex);
+
+    YuiSwapBuffers();
+  }
+
+  glDeleteFramebuffers(1, &readfbo);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglPresentInit(void) {
+  memset(&present, 0, sizeof(present));
+  present.write = 0;
+  present.ready = 1;
+  present.display = 2;
+  present.mutex = YabThreadCreateMutex();
+  present.sem = YabThreadCreateSem(0);
+  glGenFramebuffers(1, &present.fbo);
+  present.running = 1;
+  if (YabThreadStart(YAB_THREAD_PRESENT, YglPresentThread, NULL) != 0) {
+    present.running = 0;
+    glDeleteFramebuffers(1, &present.fbo);
+    present.fbo = 0;
+    YabThreadFreeMutex(present.mutex);
+    YabThreadFreeSem(present.sem);
+    return -1;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglPresentDeInit(void) {
+  int i;
+  if (!present.running) return;
+  present.running = 0;
+  YabSemPost(present.sem);
+  YabThreadWait(YAB_THREAD_PRESENT);
+
+  for (i = 0; i < YGL_PRESENT_SLOTS; i++) {
+    YglPresentSlot *slot = &present.slot[i];
+    if (slot->rendered != 0) glDeleteSync(slot->rendered);
+    if (slot->presented != 0) glDeleteSync(slot->presented);
+    if (slot->tex != 0) glDeleteTextures(1, &slot->tex);
+  }
+  glDeleteFramebuffers(1, &present.fbo);
+  YabThreadFreeMutex(present.mutex);
+  YabThreadFreeSem(present.sem);
+  memset(&present, 0, sizeof(present));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglPresentIsRunning(void) {
+  return present.running;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+GLuint YglPresentTarget(int width, int height) {
+  YglPresentSlot *slot = &present.slot[present.write];
+  GLsync presented;
+
+  if (width < 1) width = 1;
+  if (height < 1) height = 1;
+
+  // The slot may still be read by the presentation thread
+  YabThreadLock(present.mutex);
+  presented = slot->presented;
+  slot->presented = 0;
+  YabThreadUnLock(present.mutex);
+  YglPresentWaitFence(&presented);
+
+  if ((slot->tex == 0) || (slot->width != width) || (slot->height != height)) {
+    if (slot->tex == 0) glGenTextures(1, &slot->tex);
+    glBindTexture(GL_TEXTURE_2D, slot->tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    slot->width = width;
+    slot->height = height;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, present.fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slot->tex, 0);
+  present.targeted = 1;
+  return present.fbo;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglPresentQueueFrame(void) {
+  YglPresentSlot *slot;
+  double x, y, w, h;
+  int tmp;
+
+  if (!present.targeted) {
+    // Display is off, present a black screen
+    YglGetDisplayRect(&x, &y, &w, &h);
+    YglPresentTarget((int)w, (int)h);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  present.targeted = 0;
+  slot = &present.slot[present.write];
+
+  glBindFramebuffer(GL_FRAMEBUFFER, present.fbo);
+  glViewport(0, 0, slot->width, slot->height);
+  OSDDisplayMessages(NULL, 0, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, _Ygl->default_fbo);
+
+  YabThreadLock(present.mutex);
+  if (slot->rendered != 0) glDeleteSync(slot->rendered);
+  slot->rendered = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+  tmp = present.ready;
+  present.ready = present.write;
+  present.write = tmp;
+  present.fresh = 1;
+  YabThreadUnLock(present.mutex);
+  YabSemPost(present.sem);
+}
+
+#endif
@@ -0,0 +1,246 @@
+/*  This file is part of Yabause.
+
+    Yabause is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Yabause is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Yabause; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+*/
+
+/*
+  Frame readback
+
+  Hands the displayed frames to the port in system memory, for headless
+  runs, recording and regression tests. At the end of each frame the
+  displayed area is read into a pixel buffer object of a small ring and
+  a fence is set; the buffer is mapped once the GPU is done with it, a few
+  frames later, and the mapped memory is given to the callback directly.
+  The emulation only waits on the GPU when the whole ring is in flight.
+
+  Pixels are RGBA8, rows bottom to top as returned by glReadPixels. The
+  pointer is only valid during the callback.
+*/
+
+#include "ygl.h"
+
+#define YGL_READBACK_MAX 8
+
+typedef struct {
+  GLuint pbo;
+  u32 size;
+  int width;
+  int height;
+  GLsync sync;
+} YglReadbackSlot;
+
+static struct {
+  YglReadbackSlot slot[YGL_READBACK_MAX];
+  int count;
+  int head;
+  int pending;
+  YglFrameCallback callback;
+  void *arg;
+} readback;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void YglReadbackDeliver(int wait) {
+  YglReadbackSlot *slot = &readback.slot[(readback.head + readback.count - readback.pending) % readback.count];
+  GLenum ret;
+  void *pixels;
+
+  ret = glClientWaitSync(slot->sync, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+  if ((ret != GL_CONDITION_SATISFIED) && (ret != GL_ALREADY_SIGNALED)) return;
+  glDeleteSync(slot->sync);
+  slot->sync = 0;
+  readback.pending--;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->size, GL_MAP_READ_BIT);
+  if (pixels != NULL) {
+    readback.callback((const u8 *)pixels, slot->width, slot->height, readback.arg);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Can be called before the video core is started, a NULL callback stops
+// the readback
+int YglReadbackInit(int count, YglFrameCallback callback, void *arg) {
+  if (count <= 0) count = 3;
+  if (count > YGL_READBACK_MAX) count = YGL_READBACK_MAX;
+  // Pending frames go to the previous callback, slots are reallocated on first use
+  YglReadbackDeInit();
+  readback.count = count;
+  readback.callback = callback;
+  readback.arg = arg;
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Releases the GL objects, the callback stays registered for the next
+// video core
+void YglReadbackDeInit(void) {
+  int i;
+  YglReadbackFlush();
+  for (i = 0; i < YGL_READBACK_MAX; i++) {
+    if (readback.slot[i].pbo != 0) glDeleteBuffers(1, &readback.slot[i].pbo);
+  }
+  memset(readback.slot, 0, sizeof(readback.slot));
+  readback.head = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglReadbackIsEnabled(void) {
+  return (readback.callback != NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglReadbackQueue(GLuint fbo, int x, int y, int width, int height) {
+  YglReadbackSlot *slot;
+  u32 size;
+
+  if ((readback.callback == NULL) || (width <= 0) || (height <= 0)) return;
+
+  // Hand over what is already done, block only when the ring is full
+  while (readback.pending > 0) {
+    int before = readback.pending;
+    YglReadbackDeliver(readback.pending == readback.count);
+    if (readback.pending == before) break;
+  }
+
+  slot = &readback.slot[readback.head];
+  size = width * height * 4;
+  if (slot->pbo == 0) glGenBuffers(1, &slot->pbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  if (slot->size != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    slot->size = size;
+  }
+  slot->width = width;
+  slot->height = height;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  readback.head = (readback.head + 1) % readback.count;
+  readback.pending++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglReadbackFlush(void) {
+  while (readback.pending > 0) YglReadbackDeliver(1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+  Savestate thumbnails
+
+  Once a thumbnail has been asked for, every presented frame is read at
+  the native resolution into one of two pixel buffer objects. A save then
+  copies the newest readback the GPU has completed, it never waits for
+  the GPU nor adds a read to the frame being built.
+*/
+
+#define YGL_THUMBNAIL_SLOTS 2
+
+static struct {
+  GLuint pbo[YGL_THUMBNAIL_SLOTS];
+  u32 size[YGL_THUMBNAIL_SLOTS];
+  int width[YGL_THUMBNAIL_SLOTS];
+  int height[YGL_THUMBNAIL_SLOTS];
+  GLsync sync[YGL_THUMBNAIL_SLOTS];
+  int next;
+  int armed;
+} thumbnail;
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglThumbnailCapture(GLuint fbo, int width, int height) {
+  int i = thumbnail.next;
+  u32 size = width * height * 4;
+
+  if (!thumbnail.armed || (width <= 0) || (height <= 0)) return;
+
+  if (thumbnail.sync[i] != 0) glDeleteSync(thumbnail.sync[i]);
+  if (thumbnail.pbo[i] == 0) glGenBuffers(1, &thumbnail.pbo[i]);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, thumbnail.pbo[i]);
+  if (thumbnail.size[i] != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    thumbnail.size[i] = size;
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  thumbnail.sync[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  thumbnail.width[i] = width;
+  thumbnail.height[i] = height;
+  thumbnail.next = (i + 1) % YGL_THUMBNAIL_SLOTS;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int YglGetThumbnail(u8 **pixels, int *width, int *height) {
+  int n;
+
+  *pixels = NULL;
+  *width = 0;
+  *height = 0;
+  // The first request only starts the capture
+  thumbnail.armed = 1;
+
+  // Newest slot first
+  for (n = 1; n <= YGL_THUMBNAIL_SLOTS; n++) {
+    int i = (thumbnail.next + YGL_THUMBNAIL_SLOTS - n) % YGL_THUMBNAIL_SLOTS;
+    GLenum ret;
+    void *map;
+    if (thumbnail.sync[i] == 0) continue;
+    ret = glClientWaitSync(thumbnail.sync[i], 0, 0);
+    if ((ret != GL_CONDITION_SATISFIED) && (ret != GL_ALREADY_SIGNALED)) continue;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, thumbnail.pbo[i]);
+    map = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, thumbnail.size[i], GL_MAP_READ_BIT);
+    if (map != NULL) {
+      *pixels = (u8 *)malloc(thumbnail.size[i]);
+      if (*pixels != NULL) {
+        memcpy(*pixels, map, thumbnail.size[i]);
+        *width = thumbnail.width[i];
+        *height = thumbnail.height[i];
+      }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return (*pixels != NULL) ? 0 : -1;
+  }
+  return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void YglThumbnailDeInit(void) {
+  int i;
+  for (i = 0; i < YGL_THUMBNAIL_SLOTS; i++) {
+    if (thumbnail.sync[i] != 0) glDeleteSync(thumbnail.sync[i]);
+    if (thumbnail.pbo[i] != 0) glDeleteBuffers(1, &thumbnail.pbo[i]);
+  }
+  memset(&thumbnail, 0, sizeof(thumbnail));
+}